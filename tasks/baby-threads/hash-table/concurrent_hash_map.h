@@ -1,13 +1,27 @@
 #pragma once
 
+#include <algorithm>
 #include <atomic>
-#include <deque>
-#include <list>
-#include <unordered_map>
-#include <mutex>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <type_traits>
 #include <utility>
+#include <vector>
 
+// Open-addressing hash map split into independently locked stripes. Every stripe is a
+// linear probing table of its own and grows on its own, so a resize migrates one stripe
+// at a time and only blocks the operations that hash into it.
+//
+// Find doesn't lock when the keys and values fit lock-free atomics: every stripe is a
+// seqlock, a reader copies the entry out and retries if a writer got in meanwhile. The
+// entries are then written and read through std::atomic_ref, so that the racing copy is
+// a well-defined one.
 template <class K, class V, class Hash = std::hash<K>>
 class ConcurrentHashMap {
 public:
@@ -20,91 +34,106 @@ public:
 
     [[maybe_unused]] ConcurrentHashMap(int expected_size, int expected_threads_count,
                                        const Hash& hasher = Hash())
-        : hasher_(hasher) {
-
-        locks_.resize(expected_threads_count);
-        allocated_size_ = expected_size + (expected_size % expected_threads_count);
-        table_.resize(allocated_size_);
+        : hasher_(hasher),
+          seed_(RandomSeed()),
+          stripes_(StripeCount(expected_threads_count)),
+          stripe_shift_(64 - std::countr_zero(stripes_.size())) {
+        size_t expected_per_stripe = std::max(expected_size, 0) / stripes_.size() + 1;
+        auto capacity = std::bit_ceil(std::max(kMinCapacity, kGrowthFactor * expected_per_stripe));
+        for (auto& stripe : stripes_) {
+            Publish(stripe, std::make_unique<Table>(capacity));
+        }
     }
 
     bool Insert(const K& key, const V& value) {
-        auto hash_value = hasher_(key);
-        locks_[hash_value % locks_.size()].lock();
-        auto& cur_list = table_[hash_value % table_.size()];
-        for (auto it = cur_list.begin(); it != cur_list.end(); ++it) {
-            if (key == it->first) {
-                locks_[hash_value % locks_.size()].unlock();
-                return false;
-            }
+        auto hash = HashOf(key);
+        auto& stripe = StripeOf(hash);
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        auto* table = stripe.tables.back().get();
+        auto index = Probe(*table, hash, key);
+        if (Occupied(*table, index)) {
+            return false;
         }
 
-        cur_list.emplace_back(key, value);
-        ++size_;
-
-        if (cur_list.size() == 14) {
-            locks_[hash_value % locks_.size()].unlock();
-            for (auto& mutex : locks_) {
-                mutex.lock();
-            }
-
-            allocated_size_ = allocated_size_ * 3;
-            std::deque<std::list<std::pair<K, V>>> buf(allocated_size_);
-
-            for (auto list : table_) {
-                for (auto [key, value] : list) {
-                    buf[hasher_(key) % buf.size()].emplace_back(key, value);
-                }
-            }
-
-            table_ = std::move(buf);
-
-            for (auto& mutex : locks_) {
-                mutex.unlock();
-            }
-        } else {
-            locks_[hash_value % locks_.size()].unlock();
+        BeginWrite(stripe);
+        auto size = stripe.size.load(std::memory_order_relaxed);
+        if (kGrowthFactor * (size + 1) > table->capacity) {
+            table = Rehash(stripe, kGrowthFactor * table->capacity);
+            index = Probe(*table, hash, key);
         }
-
+        table->control[index].store(Fingerprint(hash), std::memory_order_release);
+        StoreSlot(*table, index, key, value);
+        stripe.size.store(size + 1, std::memory_order_relaxed);
+        EndWrite(stripe);
         return true;
     }
 
     bool Erase(const K& key) {
-        auto hash_value = hasher_(key);
-        std::lock_guard<std::mutex> lock(locks_[hash_value % locks_.size()]);
-        auto& cur_list = table_[hash_value % table_.size()];
-        for (auto it = cur_list.begin(); it != cur_list.end(); ++it) {
-            if (key == it->first) {
-                cur_list.erase(it);
-                --size_;
-                return true;
+        auto hash = HashOf(key);
+        auto& stripe = StripeOf(hash);
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        auto& table = *stripe.tables.back();
+        auto hole = Probe(table, hash, key);
+        if (!Occupied(table, hole)) {
+            return false;
+        }
+
+        // Backward shift deletion: pulls the rest of the cluster into the hole so that
+        // probing never needs tombstones.
+        BeginWrite(stripe);
+        auto capacity = table.capacity;
+        for (auto i = Next(hole, capacity); Occupied(table, i); i = Next(i, capacity)) {
+            auto home = Home(HashOf(table.slots[i].first), capacity);
+            if (((i - home) & (capacity - 1)) >= ((i - hole) & (capacity - 1))) {
+                table.control[hole].store(table.control[i].load(std::memory_order_relaxed),
+                                          std::memory_order_release);
+                StoreSlot(table, hole, std::move(table.slots[i].first),
+                          std::move(table.slots[i].second));
+                hole = i;
             }
         }
-        return false;
+        table.control[hole].store(kEmpty, std::memory_order_release);
+        StoreSlot(table, hole, K(), V());
+        stripe.size.fetch_sub(1, std::memory_order_relaxed);
+        EndWrite(stripe);
+        return true;
     }
 
+    // Keeps the capacity of every stripe.
     void Clear() {
-        for (auto& mutex : locks_) {
-            mutex.lock();
-        }
-
-        table_.assign(allocated_size_, {});
-        size_ = 0;
-
-        for (auto& mutex : locks_) {
-            mutex.unlock();
+        for (auto& stripe : stripes_) {
+            std::lock_guard<std::mutex> lock(stripe.mutex);
+            auto& table = *stripe.tables.back();
+            BeginWrite(stripe);
+            for (size_t i = 0; i < table.capacity; ++i) {
+                table.control[i].store(kEmpty, std::memory_order_release);
+                StoreSlot(table, i, K(), V());
+            }
+            stripe.size.store(0, std::memory_order_relaxed);
+            EndWrite(stripe);
         }
     }
 
     std::pair<bool, V> Find(const K& key) const {
-        auto hash_value = hasher_(key);
-        std::lock_guard<std::mutex> lock(locks_[hash_value % locks_.size()]);
-        auto cur_list = table_[hash_value % table_.size()];
-        for (auto& [cur_key, value] : cur_list) {
-            if (key == cur_key) {
-                return std::make_pair(true, value);
+        auto hash = HashOf(key);
+        const auto& stripe = StripeOf(hash);
+        if constexpr (kOptimisticFind) {
+            for (int attempt = 0; attempt < kOptimisticAttempts; ++attempt) {
+                auto version = stripe.version.load(std::memory_order_acquire);
+                if (version % 2) {
+                    continue;
+                }
+                auto result = FindIn(*stripe.table.load(std::memory_order_acquire), hash, key);
+                // FindIn reads with acquire loads, which keep this one after them.
+                if (stripe.version.load(std::memory_order_relaxed) == version) {
+                    return result;
+                }
             }
         }
-        return std::make_pair(false, V());
+
+        // Either the entries can't be copied racily or the writers keep getting in.
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        return FindIn(*stripe.tables.back(), hash, key);
     }
 
     const V At(const K& key) const {
@@ -116,18 +145,209 @@ public:
     }
 
     size_t Size() const {
-        return size_;
+        size_t size = 0;
+        for (const auto& stripe : stripes_) {
+            size += stripe.size.load(std::memory_order_relaxed);
+        }
+        return size;
     }
 
     static const int kDefaultConcurrencyLevel;
     static const int kUndefinedSize;
 
 private:
+    static constexpr uint8_t kEmpty = 0;
+    // Capacities and the stripe count are powers of two.
+    static constexpr size_t kMinCapacity = 8;
+    // A stripe is kept at most half full and doubles when it gets there.
+    static constexpr size_t kGrowthFactor = 2;
+    static constexpr size_t kStripesPerThread = 4;
+    // Clear of both the slot bits and the stripe bits for any sane table.
+    static constexpr int kFingerprintShift = 40;
+    // Optimistic reads that fail this many times in a row fall back to the mutex.
+    static constexpr int kOptimisticAttempts = 4;
+    template <class T>
+    static constexpr bool IsLockFreeWord() {
+        if constexpr (std::is_trivially_copyable_v<T>) {
+            return std::atomic_ref<T>::is_always_lock_free &&
+                   alignof(T) >= std::atomic_ref<T>::required_alignment;
+        } else {
+            return false;
+        }
+    }
+
+    static constexpr bool kOptimisticFind = IsLockFreeWord<K>() && IsLockFreeWord<V>();
+
+    struct Table {
+        explicit Table(size_t capacity)
+            : capacity(capacity), control(new std::atomic<uint8_t>[capacity]()), slots(capacity) {
+        }
+
+        size_t capacity;
+        // kEmpty or a few bits of the hash, checked before comparing the keys. Atomic
+        // because optimistic readers probe it while a writer may be changing it.
+        std::unique_ptr<std::atomic<uint8_t>[]> control;
+        std::vector<std::pair<K, V>> slots;
+    };
+
+    // Padded to a cache line so that neighbouring mutexes don't share one.
+    struct alignas(64) Stripe {
+        mutable std::mutex mutex;
+        // Odd while a writer is changing the stripe.
+        std::atomic<uint64_t> version = 0;
+        std::atomic<const Table*> table = nullptr;
+        // The current table is the last one. With optimistic reads the older ones may
+        // still be probed, so they stay until the map dies: each is half the size of the
+        // next, together they take less memory than the current one.
+        std::vector<std::unique_ptr<Table>> tables;
+        std::atomic<size_t> size = 0;
+    };
+
+    static size_t StripeCount(int expected_threads_count) {
+        return std::bit_ceil(kStripesPerThread * std::max(expected_threads_count, 1));
+    }
+
+    static uint64_t RandomSeed() {
+        std::random_device device;
+        return (static_cast<uint64_t>(device()) << 32) | device();
+    }
+
+    // std::hash of an integer is the identity: keys that differ only in their high bits
+    // would share a stripe and a slot without mixing. The seed is per map, so a set of
+    // keys colliding in one map doesn't collide in another. This is the finalizer of
+    // MurmurHash3, every bit of the result depends on every bit of the input.
+    //
+    // The slot comes from the low bits of the result, the stripe from the top ones and
+    // the fingerprint from the ones below the stripe bits.
+    size_t HashOf(const K& key) const {
+        uint64_t hash = hasher_(key) ^ seed_;
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ULL;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+    static size_t Next(size_t index, size_t capacity) {
+        return (index + 1) & (capacity - 1);
+    }
+
+    static uint8_t Fingerprint(size_t hash) {
+        return 0x80 | ((hash >> kFingerprintShift) & 0x7f);
+    }
+
+    static bool Occupied(const Table& table, size_t index) {
+        return table.control[index].load(std::memory_order_relaxed) != kEmpty;
+    }
+
+    static size_t Home(size_t hash, size_t capacity) {
+        return hash & (capacity - 1);
+    }
+
+    Stripe& StripeOf(size_t hash) {
+        return stripes_[hash >> stripe_shift_];
+    }
+
+    const Stripe& StripeOf(size_t hash) const {
+        return stripes_[hash >> stripe_shift_];
+    }
+
+    // The slot holding |key| or the empty slot that ends its probe sequence.
+    size_t Probe(const Table& table, size_t hash, const K& key) const {
+        auto fingerprint = Fingerprint(hash);
+        for (auto i = Home(hash, table.capacity);; i = Next(i, table.capacity)) {
+            auto control = table.control[i].load(std::memory_order_relaxed);
+            if (control == kEmpty || (control == fingerprint && table.slots[i].first == key)) {
+                return i;
+            }
+        }
+    }
+
+    // Also runs without the lock, so it gives up after a full circle: a torn table may
+    // have no empty slot to stop at. Whatever it returns then is discarded by the version
+    // check.
+    std::pair<bool, V> FindIn(const Table& table, size_t hash, const K& key) const {
+        auto fingerprint = Fingerprint(hash);
+        auto index = Home(hash, table.capacity);
+        for (size_t step = 0; step < table.capacity; ++step) {
+            auto control = table.control[index].load(std::memory_order_acquire);
+            if (control == kEmpty) {
+                break;
+            }
+            if (control == fingerprint && Load(table.slots[index].first) == key) {
+                return std::make_pair(true, Load(table.slots[index].second));
+            }
+            index = Next(index, table.capacity);
+        }
+        return std::make_pair(false, V());
+    }
+
+    // Under the stripe's mutex. The entries stored after it are release stores: a reader
+    // that sees one of them also sees the odd version.
+    static void StoreSlot(Table& table, size_t index, K key, V value) {
+        auto& slot = table.slots[index];
+        if constexpr (kOptimisticFind) {
+            std::atomic_ref<K>(slot.first).store(key, std::memory_order_release);
+            std::atomic_ref<V>(slot.second).store(value, std::memory_order_release);
+        } else {
+            slot.first = std::move(key);
+            slot.second = std::move(value);
+        }
+    }
+
+    template <class T>
+    static T Load(const T& word) {
+        if constexpr (kOptimisticFind) {
+            return std::atomic_ref<T>(const_cast<T&>(word)).load(std::memory_order_acquire);
+        } else {
+            return word;
+        }
+    }
+
+    static void BeginWrite(Stripe& stripe) {
+        stripe.version.store(stripe.version.load(std::memory_order_relaxed) + 1,
+                             std::memory_order_relaxed);
+    }
+
+    static void EndWrite(Stripe& stripe) {
+        stripe.version.store(stripe.version.load(std::memory_order_relaxed) + 1,
+                             std::memory_order_release);
+    }
+
+    static void Publish(Stripe& stripe, std::unique_ptr<Table> table) {
+        if constexpr (!kOptimisticFind) {
+            stripe.tables.clear();
+        }
+        stripe.table.store(table.get(), std::memory_order_release);
+        stripe.tables.push_back(std::move(table));
+    }
+
+    // Must be called inside a write section.
+    Table* Rehash(Stripe& stripe, size_t capacity) {
+        auto& old_table = *stripe.tables.back();
+        auto table = std::make_unique<Table>(capacity);
+        for (size_t i = 0; i < old_table.capacity; ++i) {
+            if (!Occupied(old_table, i)) {
+                continue;
+            }
+            auto j = Home(HashOf(old_table.slots[i].first), capacity);
+            while (Occupied(*table, j)) {
+                j = Next(j, capacity);
+            }
+            table->control[j].store(old_table.control[i].load(std::memory_order_relaxed),
+                                    std::memory_order_relaxed);
+            table->slots[j] = std::move(old_table.slots[i]);
+        }
+        auto* result = table.get();
+        Publish(stripe, std::move(table));
+        return result;
+    }
+
     Hash hasher_;
-    std::deque<std::list<std::pair<K, V>>> table_;
-    mutable std::deque<std::mutex> locks_;
-    std::atomic<size_t> size_ = 0;
-    std::atomic<size_t> allocated_size_ = 0;
+    uint64_t seed_;
+    std::vector<Stripe> stripes_;
+    int stripe_shift_;
 };
 
 template <class K, class V, class Hash>
@@ -86,9 +86,35 @@ void Deletions(benchmark::State& state) {
     }
 }
 
+// One writer churning the table and many readers, most lookups hit.
+void ReadHeavy(benchmark::State& state) {
+    const int kKeys = 100000;
+    if (state.thread_index == 0) {
+        test_table.reset(new ConcurrentHashMap<int, int>(kKeys, state.threads));
+        DummyLogger logger;
+        MakeQueries(*test_table, logger, kKeys, QueryType::INSERT, Increment(0));
+    }
+
+    Random rnd(kSeed + state.thread_index, 0, 2 * kKeys);
+    while (state.KeepRunning()) {
+        if (state.thread_index == 0) {
+            auto key = rnd() / 2;
+            test_table->Erase(key);
+            test_table->Insert(key, 1);
+        } else {
+            test_table->Find(rnd() / 2);
+        }
+    }
+
+    if (state.thread_index == 0) {
+        test_table.reset();
+    }
+}
+
 BENCHMARK(RandomInsertions)->Threads(4)->Threads(8)->UseRealTime();
 BENCHMARK(SpecialInsertions)->Threads(4)->Threads(8)->UseRealTime();
 BENCHMARK(ManySearches)->Threads(4)->Threads(8)->UseRealTime();
 BENCHMARK(Deletions)->Threads(4)->Threads(8)->UseRealTime();
+BENCHMARK(ReadHeavy)->ThreadRange(2, 16)->UseRealTime();
 
 BENCHMARK_MAIN();
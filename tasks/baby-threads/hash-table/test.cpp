@@ -82,6 +82,30 @@ TEST(Correctness, Clear) {
     ASSERT_TRUE(table.Insert(1, 1));
 }
 
+size_t ConstantHash(int) {
+    return 42;
+}
+
+TEST(Correctness, PoorHashes) {
+    ConcurrentHashMap<int, int> low_bits_table;
+    ConcurrentHashMap<int, int, size_t (*)(int)> constant_table(ConstantHash);
+    const int count = 1000;
+    for (int i = 0; i < count; ++i) {
+        ASSERT_TRUE(low_bits_table.Insert(i << 20, i));
+        ASSERT_TRUE(constant_table.Insert(i, i));
+    }
+    for (int i = 0; i < count; i += 2) {
+        ASSERT_TRUE(low_bits_table.Erase(i << 20));
+        ASSERT_TRUE(constant_table.Erase(i));
+    }
+    ASSERT_EQ(count / 2, low_bits_table.Size());
+    ASSERT_EQ(count / 2, constant_table.Size());
+    for (int i = 0; i < count; ++i) {
+        ASSERT_EQ(std::make_pair(i % 2 == 1, i % 2 ? i : 0), low_bits_table.Find(i << 20));
+        ASSERT_EQ(std::make_pair(i % 2 == 1, i % 2 ? i : 0), constant_table.Find(i));
+    }
+}
+
 void CheckOutput(const ConcurrentHashMap<int, int>& table, std::vector<std::vector<int>> queries) {
     struct Item {
         int value;
@@ -1,51 +1,282 @@
 #include "is_prime.h"
-#include <sys/types.h>
-#include <cmath>
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <condition_variable>
 #include <cstdint>
-#include <iostream>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <thread>
 #include <vector>
 
-void Work(uint64_t x, uint64_t from, uint64_t to, std::atomic<bool>& ans) {
-    uint64_t i = std::max(from, 2ul);
-    while (i <= to) {
-        if (!ans) {
-            return;
+namespace {
+
+__extension__ using uint128_t = unsigned __int128;
+
+// Numbers below this are looked up in a sieve.
+constexpr uint64_t kSieveLimit = 1 << 16;
+// Trial division by these weeds out most composites before the Miller-Rabin rounds,
+// each of which costs about as much as a hundred divisions.
+constexpr std::array<uint64_t, 18> kSmallPrimes = {2,  3,  5,  7,  11, 13, 17, 19, 23,
+                                                   29, 31, 37, 41, 43, 47, 53, 59, 61};
+// Enough for a deterministic answer for every n < 2^64 (Jim Sinclair's set) and for
+// n < kFewWitnessesLimit respectively.
+constexpr std::array<uint64_t, 7> kWitnesses = {2,      325,     9375,      28178,
+                                                450775, 9780504, 1795265022};
+constexpr std::array<uint64_t, 3> kFewWitnesses = {2, 7, 61};
+constexpr uint64_t kFewWitnessesLimit = 4759123141;
+// Below this many numbers per chunk a batch is not worth handing to another thread.
+// Above it, a few chunks per thread let the faster threads take over the work of the
+// slower ones.
+constexpr size_t kMinBatchChunk = 256;
+constexpr size_t kChunksPerThread = 4;
+
+const std::vector<bool>& Sieve() {
+    static const std::vector<bool> sieve = [] {
+        std::vector<bool> is_prime(kSieveLimit, true);
+        is_prime[0] = is_prime[1] = false;
+        for (uint64_t i = 2; i * i < kSieveLimit; ++i) {
+            if (is_prime[i]) {
+                for (uint64_t j = i * i; j < kSieveLimit; j += i) {
+                    is_prime[j] = false;
+                }
+            }
         }
-        for (uint64_t next = std::min(to, i + 100000); i <= next; ++i) {
-            if (!(x % i)) {
-                ans = false;
-                return;
+        return is_prime;
+    }();
+    return sieve;
+}
+
+// Arithmetic modulo an odd n on numbers kept multiplied by 2^64, where the product
+// needs no division: REDC replaces it with two multiplications.
+class Montgomery {
+public:
+    explicit Montgomery(uint64_t n) : n_(n), n_inverse_(n) {
+        // Newton's iteration doubles the correct low bits, n * n = 1 (mod 8) gives 3.
+        for (int i = 0; i < 5; ++i) {
+            n_inverse_ *= 2 - n * n_inverse_;
+        }
+        uint64_t r = -n % n;
+        r_squared_ = static_cast<uint128_t>(r) * r % n;
+        one_ = r;
+    }
+
+    uint64_t To(uint64_t x) const {
+        return Multiply(x % n_, r_squared_);
+    }
+
+    uint64_t One() const {
+        return one_;
+    }
+
+    uint64_t MinusOne() const {
+        return n_ - one_;
+    }
+
+    // Both arguments and the result are in [0, n).
+    uint64_t Multiply(uint64_t a, uint64_t b) const {
+        return Reduce(static_cast<uint128_t>(a) * b);
+    }
+
+    uint64_t Power(uint64_t base, uint64_t exponent) const {
+        uint64_t result = one_;
+        for (; exponent; exponent >>= 1) {
+            if (exponent & 1) {
+                result = Multiply(result, base);
             }
+            base = Multiply(base, base);
         }
+        return result;
     }
+
+private:
+    // t / 2^64 mod n for t < n * 2^64. Subtracting m * n, which agrees with t in the
+    // low word, avoids the overflow of the textbook t + m * n.
+    uint64_t Reduce(uint128_t t) const {
+        uint64_t m = static_cast<uint64_t>(t) * n_inverse_;
+        uint64_t high = t >> 64;
+        uint64_t subtrahend = (static_cast<uint128_t>(m) * n_) >> 64;
+        return high >= subtrahend ? high - subtrahend : high - subtrahend + n_;
+    }
+
+    uint64_t n_;
+    uint64_t n_inverse_;
+    uint64_t r_squared_;
+    uint64_t one_;
+};
+
+template <size_t kCount>
+bool MillerRabin(uint64_t n, const std::array<uint64_t, kCount>& witnesses) {
+    Montgomery montgomery(n);
+    int shift = std::countr_zero(n - 1);
+    uint64_t odd = (n - 1) >> shift;
+    auto minus_one = montgomery.MinusOne();
+    for (auto witness : witnesses) {
+        if (witness % n == 0) {
+            continue;
+        }
+        auto x = montgomery.Power(montgomery.To(witness), odd);
+        if (x == montgomery.One() || x == minus_one) {
+            continue;
+        }
+        int i = 1;
+        for (; i < shift && x != minus_one; ++i) {
+            x = montgomery.Multiply(x, x);
+        }
+        if (x != minus_one) {
+            return false;
+        }
+    }
+    return true;
 }
 
-bool IsPrime(uint64_t x) {
-    if (x <= 1) {
-        return false;
+// Started on the first batch and kept for the next ones, the workers sleep in between.
+// Run() hands out chunk indices to the workers and to the calling thread, which takes
+// chunks too rather than just wait.
+class ThreadPool {
+public:
+    static ThreadPool& Instance() {
+        static ThreadPool pool(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+        return pool;
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Counting the calling thread.
+    size_t Concurrency() const {
+        return workers_.size() + 1;
     }
 
-    std::vector<std::thread> threads_pool;
-    size_t threads_count = 1;
-    std::atomic<bool> ans = true;
-    uint64_t step = sqrt(x);
+    // Calls task(i) for every i in [0, count) and returns once they are all done. Calls
+    // from different threads take turns; a call from inside a task runs sequentially.
+    void Run(size_t count, const std::function<void(size_t)>& task) {
+        if (count <= 1 || workers_.empty() || is_worker) {
+            for (size_t i = 0; i < count; ++i) {
+                task(i);
+            }
+            return;
+        }
+
+        std::lock_guard<std::mutex> run_lock(run_mutex_);
+        Job job{&task, count};
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            job_ = &job;
+            ++generation_;
+            ++job.users;
+        }
+        has_job_.notify_all();
+        Work(job);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        job_done_.wait(lock, [&job] { return job.finished == job.count && !job.users; });
+        job_ = nullptr;
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        has_job_.notify_all();
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+    }
+
+private:
+    struct Job {
+        const std::function<void(size_t)>* task;
+        size_t count;
+        std::atomic<size_t> next = 0;
+        // Guarded by mutex_. The job lives on the stack of Run, which waits for every
+        // thread that took it to let go.
+        size_t finished = 0;
+        size_t users = 0;
+    };
+
+    explicit ThreadPool(size_t workers) {
+        workers_.reserve(workers);
+        for (size_t i = 0; i < workers; ++i) {
+            workers_.emplace_back([this] { WorkerLoop(); });
+        }
+    }
 
-    if (x > 1000000 && std::thread::hardware_concurrency() > 2) {
-        threads_count += std::thread::hardware_concurrency() - 1;
-        step /= threads_count;
+    void WorkerLoop() {
+        is_worker = true;
+        uint64_t seen_generation = 0;
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            has_job_.wait(lock, [&] { return stop_ || (job_ && generation_ != seen_generation); });
+            if (stop_) {
+                return;
+            }
+            seen_generation = generation_;
+            auto& job = *job_;
+            ++job.users;
+            lock.unlock();
+            Work(job);
+            lock.lock();
+        }
+    }
 
-        for (uint64_t i = 0; i < threads_count - 1; ++i) {
-            threads_pool.emplace_back(Work, x, i * step, (i + 1) * step, std::ref(ans));
+    // Called with job.users already counting this thread, leaves it uncounted.
+    void Work(Job& job) {
+        size_t done = 0;
+        for (size_t i; (i = job.next.fetch_add(1, std::memory_order_relaxed)) < job.count;) {
+            (*job.task)(i);
+            ++done;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        job.finished += done;
+        if (--job.users == 0 && job.finished == job.count) {
+            job_done_.notify_one();
         }
     }
 
-    threads_pool.emplace_back(Work, x, (threads_count - 1) * step, sqrt(x), std::ref(ans));
+    static inline thread_local bool is_worker = false;
+
+    std::vector<std::thread> workers_;
+    std::mutex run_mutex_;
+    std::mutex mutex_;
+    std::condition_variable has_job_;
+    std::condition_variable job_done_;
+    Job* job_ = nullptr;
+    uint64_t generation_ = 0;
+    bool stop_ = false;
+};
 
-    for (auto& thread : threads_pool) {
-        thread.join();
+}  // namespace
+
+bool IsPrime(uint64_t x) {
+    if (x < kSieveLimit) {
+        return Sieve()[x];
+    }
+    for (auto p : kSmallPrimes) {
+        if (x % p == 0) {
+            return false;
+        }
     }
+    if (x < kFewWitnessesLimit) {
+        return MillerRabin(x, kFewWitnesses);
+    }
+    return MillerRabin(x, kWitnesses);
+}
 
-    return ans;
+std::vector<bool> IsPrimeBatch(std::span<const uint64_t> numbers) {
+    auto& pool = ThreadPool::Instance();
+    auto max_chunks = pool.Concurrency() * kChunksPerThread;
+    auto chunks = std::clamp<size_t>(numbers.size() / kMinBatchChunk, 1, max_chunks);
+    // Bytes rather than vector<bool> bits, which neighbouring chunks would share.
+    auto results = std::make_unique<bool[]>(numbers.size());
+    pool.Run(chunks, [&](size_t chunk) {
+        size_t last = numbers.size() * (chunk + 1) / chunks;
+        for (size_t i = numbers.size() * chunk / chunks; i < last; ++i) {
+            results[i] = IsPrime(numbers[i]);
+        }
+    });
+    return std::vector<bool>(results.get(), results.get() + numbers.size());
 }
@@ -1,3 +1,9 @@
 #include <cstdint>
+#include <span>
+#include <vector>
 
+// Deterministic for every 64-bit number.
 bool IsPrime(uint64_t);
+
+// Same as calling IsPrime on every number, large batches are split between threads.
+std::vector<bool> IsPrimeBatch(std::span<const uint64_t> numbers);
@@ -1,5 +1,6 @@
 #include <cstdint>
 #include <array>
+#include <vector>
 #include <benchmark/benchmark.h>
 #include "is_prime.h"
 
@@ -18,9 +19,21 @@ void CheckNumbers(benchmark::State& state) {
     }
 }
 
+void CheckBatch(benchmark::State& state) {
+    std::vector<uint64_t> numbers(1024);
+    for (size_t i = 0; i < numbers.size(); ++i) {
+        numbers[i] = kNumbers[0] + 2 * i;
+    }
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(IsPrimeBatch(numbers));
+    }
+    state.SetItemsProcessed(state.iterations() * numbers.size());
+}
+
 BENCHMARK(CheckNumbers)
     ->DenseRange(0, static_cast<int>(kNumbers.size()) - 1)
     ->Unit(benchmark::kMicrosecond)
     ->UseRealTime();
+BENCHMARK(CheckBatch)->Unit(benchmark::kMicrosecond)->UseRealTime();
 
 BENCHMARK_MAIN();
@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 #include <iostream>
+#include <vector>
 #include "is_prime.h"
 
 TEST(basic_tests, just_test) {
@@ -13,3 +14,55 @@ TEST(basic_tests, just_test) {
     ASSERT_TRUE(IsPrime(mul));
     ASSERT_FALSE(IsPrime(static_cast<uint64_t>(mul) * mul));
 }
+
+bool TrialDivision(uint64_t x) {
+    if (x < 2) {
+        return false;
+    }
+    for (uint64_t i = 2; i * i <= x; ++i) {
+        if (x % i == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+TEST(basic_tests, large_numbers) {
+    ASSERT_TRUE(IsPrime(18446744073709551557ull));
+    ASSERT_FALSE(IsPrime(18446744073709551615ull));
+    ASSERT_TRUE(IsPrime(1000000000000000177ull));
+    ASSERT_FALSE(IsPrime(3778118040573702001ull));
+    // Squares of primes and strong pseudoprimes to several small bases.
+    ASSERT_FALSE(IsPrime(4294967291ull * 4294967291ull));
+    ASSERT_FALSE(IsPrime(3215031751ull));
+    ASSERT_FALSE(IsPrime(3825123056546413051ull));
+    ASSERT_FALSE(IsPrime(341550071728321ull));
+    ASSERT_FALSE(IsPrime(561));
+    ASSERT_FALSE(IsPrime(1ull << 63));
+}
+
+TEST(basic_tests, matches_trial_division) {
+    for (uint64_t x = 0; x < 200000; ++x) {
+        ASSERT_EQ(TrialDivision(x), IsPrime(x)) << x;
+    }
+    for (uint64_t x = 1000000000000ull; x < 1000000000000ull + 2000; ++x) {
+        ASSERT_EQ(TrialDivision(x), IsPrime(x)) << x;
+    }
+}
+
+TEST(basic_tests, batch) {
+    // Cut into at least four chunks of uneven sizes whatever the number of cores, and
+    // checked twice over the same pool.
+    std::vector<uint64_t> numbers;
+    for (uint64_t x = 0; x < 3001; ++x) {
+        numbers.push_back(x * x * x * 1000003 + x);
+    }
+    for (int round = 0; round < 2; ++round) {
+        auto results = IsPrimeBatch(numbers);
+        ASSERT_EQ(numbers.size(), results.size());
+        for (size_t i = 0; i < numbers.size(); ++i) {
+            ASSERT_EQ(IsPrime(numbers[i]), results[i]) << numbers[i];
+        }
+    }
+    ASSERT_TRUE(IsPrimeBatch({}).empty());
+}
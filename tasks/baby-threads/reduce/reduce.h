@@ -1,38 +1,191 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <optional>
 #include <thread>
 #include <vector>
 
-template <class RandomAccessIterator, class T, class Func>
-T Reduce(RandomAccessIterator first, RandomAccessIterator last, const T& initial_value, Func func) {
-    std::vector<std::thread> threads_pool;
-    size_t threads_count = 1;
-    std::atomic<T> ans(initial_value);
-    uint64_t n = last - first;
-    uint64_t step = n;
-
-    if (n > 1000 && std::thread::hardware_concurrency() > 2) {
-        threads_count += std::thread::hardware_concurrency() - 1;
-        step /= threads_count;
-    }
-
-    for (uint64_t thread_num = 0; thread_num < threads_count; ++thread_num) {
-        threads_pool.emplace_back(
-            [&](RandomAccessIterator first, RandomAccessIterator last) {
-                auto cur_value{initial_value};
-                while (first != last) {
-                    cur_value = func(cur_value, *first++);
-                }
-                ans = func(ans, cur_value);
+namespace reduce_internal {
+
+// Workers are started once and sleep between calls. Run() hands out task indices to
+// the workers and to the calling thread, which helps instead of just waiting.
+class ThreadPool {
+public:
+    static ThreadPool& Instance() {
+        static ThreadPool pool(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+        return pool;
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Counting the calling thread.
+    size_t Concurrency() const {
+        return workers_.size() + 1;
+    }
+
+    // Calls task(i) for every i in [0, count) and returns once they are all done. Calls
+    // from different threads take turns; a call from inside a task runs sequentially.
+    void Run(size_t count, const std::function<void(size_t)>& task) {
+        if (count <= 1 || workers_.empty() || is_worker) {
+            for (size_t i = 0; i < count; ++i) {
+                task(i);
+            }
+            return;
+        }
+
+        std::lock_guard<std::mutex> run_lock(run_mutex_);
+        Job job{&task, count};
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            job_ = &job;
+            ++generation_;
+            ++job.users;
+        }
+        has_job_.notify_all();
+        Work(job);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        job_done_.wait(lock, [&job] { return job.finished == job.count && !job.users; });
+        job_ = nullptr;
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        has_job_.notify_all();
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+    }
+
+private:
+    struct Job {
+        const std::function<void(size_t)>* task;
+        size_t count;
+        std::atomic<size_t> next = 0;
+        // Guarded by mutex_. The job lives on the stack of Run, which waits for every
+        // thread that took it to let go.
+        size_t finished = 0;
+        size_t users = 0;
+    };
+
+    explicit ThreadPool(size_t workers) {
+        workers_.reserve(workers);
+        for (size_t i = 0; i < workers; ++i) {
+            workers_.emplace_back([this] { WorkerLoop(); });
+        }
+    }
+
+    void WorkerLoop() {
+        is_worker = true;
+        uint64_t seen_generation = 0;
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            has_job_.wait(lock, [&] { return stop_ || (job_ && generation_ != seen_generation); });
+            if (stop_) {
                 return;
-            },
-            first + thread_num * step, first + std::min((thread_num + 1) * step, n));
+            }
+            seen_generation = generation_;
+            auto& job = *job_;
+            ++job.users;
+            lock.unlock();
+            Work(job);
+            lock.lock();
+        }
     }
 
-    for (auto& thread : threads_pool) {
-        thread.join();
+    // Called with job.users already counting this thread, leaves it uncounted.
+    void Work(Job& job) {
+        size_t done = 0;
+        for (size_t i; (i = job.next.fetch_add(1, std::memory_order_relaxed)) < job.count;) {
+            (*job.task)(i);
+            ++done;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        job.finished += done;
+        if (--job.users == 0 && job.finished == job.count) {
+            job_done_.notify_one();
+        }
     }
 
-    return ans;
+    static inline thread_local bool is_worker = false;
+
+    std::vector<std::thread> workers_;
+    std::mutex run_mutex_;
+    std::mutex mutex_;
+    std::condition_variable has_job_;
+    std::condition_variable job_done_;
+    Job* job_ = nullptr;
+    uint64_t generation_ = 0;
+    bool stop_ = false;
+};
+
+// Below this many elements per chunk handing the chunk to another thread costs more than
+// folding it. Above it, a few chunks per thread let the faster threads take over the
+// work of the slower ones.
+inline constexpr size_t kMinGrainSize = 4096;
+inline constexpr size_t kChunksPerThread = 4;
+
+// Each partial gets a cache line of its own so that threads folding neighbouring chunks
+// don't invalidate each other's.
+template <class T>
+struct alignas(64) Partial {
+    std::optional<T> value;
+};
+
+}  // namespace reduce_internal
+
+// Folds transform(*it) over [first, last) with an associative |reduce|. The range is cut
+// into chunks folded in parallel, the first one starting from |initial_value| and the
+// rest from their first element, so |initial_value| is used exactly once. The chunk
+// results are combined in a fixed pairwise tree: the result doesn't depend on scheduling.
+template <class RandomAccessIterator, class T, class BinaryOp, class UnaryOp>
+T TransformReduce(RandomAccessIterator first, RandomAccessIterator last, const T& initial_value,
+                  BinaryOp reduce, UnaryOp transform) {
+    using reduce_internal::kChunksPerThread;
+    using reduce_internal::kMinGrainSize;
+
+    auto& pool = reduce_internal::ThreadPool::Instance();
+    size_t n = std::distance(first, last);
+    size_t chunks = std::min(n / kMinGrainSize, pool.Concurrency() * kChunksPerThread);
+    if (chunks <= 1) {
+        T value(initial_value);
+        for (; first != last; ++first) {
+            value = reduce(value, transform(*first));
+        }
+        return value;
+    }
+
+    std::vector<reduce_internal::Partial<T>> partials(chunks);
+    pool.Run(chunks, [&](size_t chunk) {
+        auto chunk_first = first + n * chunk / chunks;
+        auto chunk_last = first + n * (chunk + 1) / chunks;
+        T value = chunk ? T(transform(*chunk_first++)) : initial_value;
+        for (; chunk_first != chunk_last; ++chunk_first) {
+            value = reduce(value, transform(*chunk_first));
+        }
+        partials[chunk].value.emplace(std::move(value));
+    });
+
+    for (size_t stride = 1; stride < chunks; stride *= 2) {
+        for (size_t i = 0; i + stride < chunks; i += 2 * stride) {
+            partials[i].value = reduce(*partials[i].value, *partials[i + stride].value);
+        }
+    }
+    return *partials[0].value;
+}
+
+template <class RandomAccessIterator, class T, class Func>
+T Reduce(RandomAccessIterator first, RandomAccessIterator last, const T& initial_value, Func func) {
+    return TransformReduce(first, last, initial_value, func, std::identity());
 }
@@ -3,6 +3,7 @@
 #include <vector>
 #include <algorithm>
 #include <chrono>
+#include <string>
 #include "commons.h"
 
 TEST(Correctness, Empty) {
@@ -36,6 +37,35 @@ TEST(VectorBool, Tricky) {
               Reduce(go.begin(), go.end(), true, func));
 }
 
+TEST(Correctness, UnevenChunks) {
+    for (int size : {4095, 4096, 4097, 3 * 4096 + 1, 100003}) {
+        std::vector<uint32_t> lst(GenTest<uint32_t>(size));
+        ASSERT_EQ(std::accumulate(lst.begin(), lst.end(), 1u, Summator<uint32_t>()),
+                  Reduce(lst.begin(), lst.end(), 1u, Summator<uint32_t>()));
+    }
+}
+
+TEST(Correctness, KeepsOrder) {
+    std::vector<std::string> letters(100000);
+    for (size_t i = 0; i < letters.size(); ++i) {
+        letters[i] = static_cast<char>('a' + i % 26);
+    }
+    std::string initial("!");
+    ASSERT_EQ(std::accumulate(letters.begin(), letters.end(), initial),
+              Reduce(letters.begin(), letters.end(), initial, Summator<std::string>()));
+}
+
+TEST(Correctness, TransformReduce) {
+    std::vector<uint64_t> lst(GenTest<uint64_t>(100000));
+    auto square = [](uint64_t x) { return (x % 1000) * (x % 1000); };
+    uint64_t expected = 0;
+    for (auto x : lst) {
+        expected += square(x);
+    }
+    ASSERT_EQ(expected, TransformReduce(lst.begin(), lst.end(), uint64_t{0},
+                                        Summator<uint64_t>(), square));
+}
+
 template <class RandomAccessIterator, class T, class Func>
 __attribute__((noinline)) T CanonicalReduce(RandomAccessIterator first, RandomAccessIterator last,
                                             const T& initial_value, Func func) {
@@ -1,191 +1,406 @@
 #include "find_subsets.h"
-#include <bitset>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
 #include <cstddef>
-#include <iostream>
+#include <functional>
 #include <mutex>
-#include <stdexcept>
+#include <optional>
+#include <span>
 #include <thread>
-#include <unordered_map>
 #include <utility>
 #include <vector>
 
-Subsets FindEqualSumSubsets(const std::vector<int64_t>& data) {
-    std::unordered_map<int64_t, size_t> map;
+// Two disjoint subsets with equal sums are a nonzero vector of coefficients in {-1, 0, 1}
+// with a zero dot product, which has both a 1 and a -1. The elements are split into a
+// left and a right part, whose 3^k sums are enumerated and sorted once, and the rest,
+// whose assignments are tried one by one: for each, the sorted parts are merge-joined
+// looking for left + right = -rest. Memory is bounded by the size of the sorted parts.
 
-    std::mutex find_ans;
-    Subsets ans{{}, {}, false};
+namespace {
 
-    size_t first_part_n = std::max(0l, static_cast<int64_t>(data.size() / 2) - 2);
-    size_t second_part_n = data.size() - first_part_n;
-    size_t number_of_iterations = 1;
-    for (size_t i = 0; i < first_part_n; ++i) {
-        number_of_iterations *= 3ull;
-    }
+// 3^14 sums of 9 bytes, twice, plus the buffers of the radix sort: under 200 MB.
+constexpr size_t kMaxSortedPart = 14;
+// A join checks whether another one has found an answer this often.
+constexpr size_t kCancellationCheckPeriod = 1 << 16;
+
+// Bit 0 is set if a vector has a 1, bit 1 if it has a -1.
+enum Kind : uint8_t { kHasPlus = 1, kHasMinus = 2, kBoth = 3 };
 
-    map.reserve(number_of_iterations);
+size_t Power3(size_t exponent) {
+    size_t result = 1;
+    for (size_t i = 0; i < exponent; ++i) {
+        result *= 3;
+    }
+    return result;
+}
 
-    for (size_t iteration = 0; iteration < number_of_iterations; ++iteration) {
-        size_t mask = iteration;
+// Walks the coefficient vectors over |values| in reflected ternary Gray code order:
+// neighbours differ in one coefficient by one, so each step updates the sum in O(1)
+// amortized instead of recomputing it from the digits.
+class GrayEnumerator {
+public:
+    // Starts at the |index|-th vector of the order.
+    GrayEnumerator(std::span<const int64_t> values, size_t index)
+        : values_(values),
+          counter_(values.size()),
+          digits_(values.size()),
+          directions_(values.size()) {
+        for (size_t i = 0; i < values.size(); ++i, index /= 3) {
+            counter_[i] = index % 3;
+        }
+        // A digit runs backwards when the digits above it add up to an odd number.
+        int higher_sum = 0;
+        for (size_t i = values.size(); i-- > 0;) {
+            bool backwards = higher_sum % 2;
+            digits_[i] = backwards ? 2 - counter_[i] : counter_[i];
+            directions_[i] = backwards ? -1 : 1;
+            higher_sum += counter_[i];
+            Add(i, 1);
+        }
+    }
 
+    // Must not be called on the last vector.
+    void Next() {
         size_t i = 0;
-        int64_t cursum = 0;
-        short cur_type = 0;
-        bool has_one = false;
-        bool has_two = false;
-        while (mask) {
-            cur_type = mask % 3ull;
-            mask /= 3ull;
-            if (cur_type == 1) {
-                cursum += data[i];
-                has_one = true;
-            }
-            if (cur_type == 2) {
-                cursum -= data[i];
-                has_two = true;
-            }
+        for (; counter_[i] == 2; ++i) {
+            counter_[i] = 0;
+            directions_[i] = -directions_[i];
+        }
+        ++counter_[i];
+        Add(i, -1);
+        digits_[i] += directions_[i];
+        Add(i, 1);
+    }
+
+    int Coefficient(size_t i) const {
+        return digits_[i] - 1;
+    }
+
+    int64_t Sum() const {
+        return sum_;
+    }
+
+    uint8_t Kind() const {
+        return (plus_ ? kHasPlus : 0) | (minus_ ? kHasMinus : 0);
+    }
+
+private:
+    // Adds or, with |sign| = -1, removes the current coefficient of value i.
+    void Add(size_t i, int sign) {
+        auto coefficient = Coefficient(i);
+        sum_ += sign * coefficient * values_[i];
+        plus_ += sign * (coefficient == 1);
+        minus_ += sign * (coefficient == -1);
+    }
+
+    std::span<const int64_t> values_;
+    std::vector<int8_t> counter_;
+    std::vector<int8_t> digits_;
+    std::vector<int8_t> directions_;
+    int64_t sum_ = 0;
+    int plus_ = 0;
+    int minus_ = 0;
+};
+
+struct SortedPart {
+    std::vector<int64_t> sums;
+    std::vector<uint8_t> kinds;
+};
+
+// LSD radix sort by bytes, skipping the bytes that are the same in every key: the
+// sums are far from spanning all 64 bits.
+void RadixSort(SortedPart* part) {
+    constexpr uint64_t kSignBit = uint64_t{1} << 63;
+    auto& sums = part->sums;
+    auto& kinds = part->kinds;
+    std::array<std::array<size_t, 256>, 8> counts{};
+    for (auto sum : sums) {
+        auto key = static_cast<uint64_t>(sum) ^ kSignBit;
+        for (size_t byte = 0; byte < 8; ++byte) {
+            ++counts[byte][(key >> (8 * byte)) & 0xff];
+        }
+    }
+
+    std::vector<int64_t> sums_buffer(sums.size());
+    std::vector<uint8_t> kinds_buffer(kinds.size());
+    for (size_t byte = 0; byte < 8; ++byte) {
+        auto shift = 8 * byte;
+        auto& count = counts[byte];
+        auto first_key = static_cast<uint64_t>(sums[0]) ^ kSignBit;
+        if (count[(first_key >> shift) & 0xff] == sums.size()) {
+            continue;
+        }
+        size_t offset = 0;
+        for (auto& bucket : count) {
+            offset += std::exchange(bucket, offset);
+        }
+        for (size_t i = 0; i < sums.size(); ++i) {
+            auto key = static_cast<uint64_t>(sums[i]) ^ kSignBit;
+            auto position = count[(key >> shift) & 0xff]++;
+            sums_buffer[position] = sums[i];
+            kinds_buffer[position] = kinds[i];
+        }
+        sums.swap(sums_buffer);
+        kinds.swap(kinds_buffer);
+    }
+}
+
+// The right part is stored negated, so that the join looks for equal keys.
+void BuildSortedPart(std::span<const int64_t> values, bool negate, SortedPart* part) {
+    auto count = Power3(values.size());
+    part->sums.resize(count);
+    part->kinds.resize(count);
+    GrayEnumerator enumerator(values, 0);
+    for (size_t i = 0; i < count; ++i) {
+        if (i) {
+            enumerator.Next();
+        }
+        part->sums[i] = negate ? -enumerator.Sum() : enumerator.Sum();
+        part->kinds[i] = enumerator.Kind();
+    }
+    RadixSort(part);
+}
+
+struct Match {
+    int64_t left_sum;
+    uint8_t left_kind;
+    int64_t right_sum;
+    uint8_t right_kind;
+};
+
+// Finds left + right = -|rest_sum| where the kinds of the three parts together have both
+// signs. Gives up early once |cancelled| is set.
+std::optional<Match> Join(const SortedPart& left, const SortedPart& right, int64_t rest_sum,
+                          uint8_t rest_kind, const std::atomic<bool>& cancelled) {
+    size_t i = 0;
+    size_t j = 0;
+    for (size_t step = 1; i < left.sums.size() && j < right.sums.size(); ++step) {
+        if (step % kCancellationCheckPeriod == 0 && cancelled.load(std::memory_order_relaxed)) {
+            return std::nullopt;
+        }
+        auto left_sum = left.sums[i];
+        auto right_key = right.sums[j] - rest_sum;
+        if (left_sum < right_key) {
             ++i;
+            continue;
+        }
+        if (left_sum > right_key) {
+            ++j;
+            continue;
         }
 
-        if (has_one && has_two && cursum == 0) {
-            i = 0;
-            ans.exists = true;
-            while (iteration) {
-                cur_type = iteration % 3ull;
-                iteration /= 3ull;
-                if (cur_type == 1) {
-                    ans.first_indices.push_back(i);
-                }
-                if (cur_type == 2) {
-                    ans.second_indices.push_back(i);
+        // Kinds present among the equal sums on each side, as bit masks.
+        unsigned left_kinds = 0;
+        for (; i < left.sums.size() && left.sums[i] == left_sum; ++i) {
+            left_kinds |= 1u << left.kinds[i];
+        }
+        unsigned right_kinds = 0;
+        for (; j < right.sums.size() && right.sums[j] - rest_sum == left_sum; ++j) {
+            right_kinds |= 1u << right.kinds[j];
+        }
+        for (uint8_t left_kind = 0; left_kind <= kBoth; ++left_kind) {
+            for (uint8_t right_kind = 0; right_kind <= kBoth; ++right_kind) {
+                if ((left_kinds >> left_kind & 1) && (right_kinds >> right_kind & 1) &&
+                    (left_kind | right_kind | rest_kind) == kBoth) {
+                    return Match{left_sum, left_kind, -right.sums[j - 1], right_kind};
                 }
-                ++i;
             }
-            return ans;
-        }
-
-        map[-cursum] = iteration;
-    }
-
-    number_of_iterations = 1;
-    for (size_t i = 0; i < second_part_n; ++i) {
-        number_of_iterations *= 3ull;
-    }
-
-    std::vector<std::thread> threads_pool;
-    size_t threads_count = 1;
-    uint64_t step = number_of_iterations;
-
-    if (number_of_iterations > 10000 && std::thread::hardware_concurrency() > 2) {
-        threads_count += std::thread::hardware_concurrency();
-        step = (number_of_iterations + threads_count - 1) / threads_count;
-    }
-
-    for (uint64_t thread_num = 0; thread_num < threads_count; ++thread_num) {
-        threads_pool.emplace_back(
-            [&](size_t start, size_t end) {
-                size_t mask;
-                size_t i;
-                int64_t cursum;
-                short cur_type;
-                bool has_one;
-                bool has_two;
-                for (size_t iteration = start; iteration < end; ++iteration) {
-                    mask = iteration;
-
-                    i = 0;
-                    cursum = 0;
-                    cur_type = 0;
-                    has_one = false;
-                    has_two = false;
-                    while (mask) {
-                        cur_type = mask % 3ull;
-                        mask /= 3ull;
-                        if (cur_type == 1) {
-                            cursum += data[first_part_n + i];
-                            has_one = true;
-                        }
-                        if (cur_type == 2) {
-                            cursum -= data[first_part_n + i];
-                            has_two = true;
-                        }
-                        ++i;
-                    }
-
-                    if (has_one && has_two && cursum == 0) {
-                        i = 0;
-                        std::lock_guard<std::mutex> g(find_ans);
-                        if (ans.exists) {
-                            return;
-                        }
-                        ans.exists = true;
-                        while (iteration) {
-                            cur_type = iteration % 3ull;
-                            iteration /= 3ull;
-                            if (cur_type == 1) {
-                                ans.first_indices.push_back(first_part_n + i);
-                            }
-                            if (cur_type == 2) {
-                                ans.second_indices.push_back(first_part_n + i);
-                            }
-                            ++i;
-                        }
-                        return;
-                    }
-                    if (map.contains(cursum)) {
-                        mask = map[cursum];
-                        while (mask) {
-                            cur_type = mask % 3ull;
-                            mask /= 3ull;
-                            if (cur_type == 1) {
-                                has_one = true;
-                            }
-                            if (cur_type == 2) {
-                                has_two = true;
-                            }
-                        }
-
-                        if (has_one && has_two) {
-                            i = 0;
-                            std::lock_guard<std::mutex> g(find_ans);
-                            if (ans.exists) {
-                                return;
-                            }
-                            ans.exists = true;
-                            while (iteration) {
-                                cur_type = iteration % 3ull;
-                                iteration /= 3ull;
-                                if (cur_type == 1) {
-                                    ans.first_indices.push_back(first_part_n + i);
-                                }
-                                if (cur_type == 2) {
-                                    ans.second_indices.push_back(first_part_n + i);
-                                }
-                                ++i;
-                            }
-                            i = 0;
-                            iteration = map[cursum];
-                            while (iteration) {
-                                cur_type = iteration % 3ull;
-                                iteration /= 3ull;
-                                if (cur_type == 1) {
-                                    ans.first_indices.push_back(i);
-                                }
-                                if (cur_type == 2) {
-                                    ans.second_indices.push_back(i);
-                                }
-                                ++i;
-                            }
-                            return;
-                        }
-                    }
-                }
-            },
-            step * thread_num, std::min(number_of_iterations, step * (thread_num + 1)));
+        }
+    }
+    return std::nullopt;
+}
+
+// Appends the indices of a vector over |values| with the given sum and kind, which is
+// known to exist, to the answer.
+void Reconstruct(std::span<const int64_t> values, size_t offset, int64_t sum, uint8_t kind,
+                 Subsets* subsets) {
+    GrayEnumerator enumerator(values, 0);
+    while (enumerator.Sum() != sum || enumerator.Kind() != kind) {
+        enumerator.Next();
+    }
+    for (size_t i = 0; i < values.size(); ++i) {
+        if (enumerator.Coefficient(i) == 1) {
+            subsets->first_indices.push_back(offset + i);
+        } else if (enumerator.Coefficient(i) == -1) {
+            subsets->second_indices.push_back(offset + i);
+        }
+    }
+}
+
+// Started once and reused by every search: the workers sleep between its two phases and
+// between calls. Run() hands out indices to the workers and to the calling thread, which
+// takes its share rather than just wait.
+class ThreadPool {
+public:
+    static ThreadPool& Instance() {
+        static ThreadPool pool(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+        return pool;
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Counting the calling thread.
+    size_t Concurrency() const {
+        return workers_.size() + 1;
     }
 
-    for (auto& thread : threads_pool) {
-        thread.join();
+    // Calls task(i) for every i in [0, count) and returns once they are all done. Calls
+    // from different threads take turns; a call from inside a task runs sequentially.
+    void Run(size_t count, const std::function<void(size_t)>& task) {
+        if (count <= 1 || workers_.empty() || is_worker) {
+            for (size_t i = 0; i < count; ++i) {
+                task(i);
+            }
+            return;
+        }
+
+        std::lock_guard<std::mutex> run_lock(run_mutex_);
+        Job job{&task, count};
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            job_ = &job;
+            ++generation_;
+            ++job.users;
+        }
+        has_job_.notify_all();
+        Work(job);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        job_done_.wait(lock, [&job] { return job.finished == job.count && !job.users; });
+        job_ = nullptr;
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        has_job_.notify_all();
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+    }
+
+private:
+    struct Job {
+        const std::function<void(size_t)>* task;
+        size_t count;
+        std::atomic<size_t> next = 0;
+        // Guarded by mutex_. The job lives on the stack of Run, which waits for every
+        // thread that took it to let go.
+        size_t finished = 0;
+        size_t users = 0;
+    };
+
+    explicit ThreadPool(size_t workers) {
+        workers_.reserve(workers);
+        for (size_t i = 0; i < workers; ++i) {
+            workers_.emplace_back([this] { WorkerLoop(); });
+        }
     }
 
-    return ans;
+    void WorkerLoop() {
+        is_worker = true;
+        uint64_t seen_generation = 0;
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            has_job_.wait(lock, [&] { return stop_ || (job_ && generation_ != seen_generation); });
+            if (stop_) {
+                return;
+            }
+            seen_generation = generation_;
+            auto& job = *job_;
+            ++job.users;
+            lock.unlock();
+            Work(job);
+            lock.lock();
+        }
+    }
+
+    // Called with job.users already counting this thread, leaves it uncounted.
+    void Work(Job& job) {
+        size_t done = 0;
+        for (size_t i; (i = job.next.fetch_add(1, std::memory_order_relaxed)) < job.count;) {
+            (*job.task)(i);
+            ++done;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        job.finished += done;
+        if (--job.users == 0 && job.finished == job.count) {
+            job_done_.notify_one();
+        }
+    }
+
+    static inline thread_local bool is_worker = false;
+
+    std::vector<std::thread> workers_;
+    std::mutex run_mutex_;
+    std::mutex mutex_;
+    std::condition_variable has_job_;
+    std::condition_variable job_done_;
+    Job* job_ = nullptr;
+    uint64_t generation_ = 0;
+    bool stop_ = false;
+};
+
+}  // namespace
+
+Subsets FindEqualSumSubsets(const std::vector<int64_t>& data) {
+    std::span<const int64_t> values(data);
+    auto left_size = std::min((data.size() + 1) / 2, kMaxSortedPart);
+    auto right_size = std::min(data.size() - left_size, kMaxSortedPart);
+    auto left_values = values.subspan(0, left_size);
+    auto right_values = values.subspan(left_size, right_size);
+    auto rest_values = values.subspan(left_size + right_size);
+
+    auto& pool = ThreadPool::Instance();
+    SortedPart left;
+    SortedPart right;
+    pool.Run(2, [&](size_t part) {
+        if (part) {
+            BuildSortedPart(right_values, true, &right);
+        } else {
+            BuildSortedPart(left_values, false, &left);
+        }
+    });
+
+    std::mutex answer_mutex;
+    std::atomic<bool> found = false;
+    std::optional<std::pair<size_t, Match>> answer;
+    pool.Run(Power3(rest_values.size()), [&](size_t rest_index) {
+        if (found.load(std::memory_order_relaxed)) {
+            return;
+        }
+        GrayEnumerator rest(rest_values, rest_index);
+        // A vector and its negation are the same answer: the first nonzero coefficient
+        // of the rest can be taken to be 1.
+        for (size_t i = 0; i < rest_values.size() && rest.Coefficient(i) != 1; ++i) {
+            if (rest.Coefficient(i) == -1) {
+                return;
+            }
+        }
+        auto match = Join(left, right, rest.Sum(), rest.Kind(), found);
+        if (match) {
+            std::lock_guard<std::mutex> lock(answer_mutex);
+            if (!answer) {
+                answer.emplace(rest_index, *match);
+                found = true;
+            }
+        }
+    });
+
+    Subsets subsets{{}, {}, false};
+    if (!answer) {
+        return subsets;
+    }
+    auto& [rest_index, match] = *answer;
+    subsets.exists = true;
+    Reconstruct(left_values, 0, match.left_sum, match.left_kind, &subsets);
+    Reconstruct(right_values, left_size, match.right_sum, match.right_kind, &subsets);
+    GrayEnumerator rest(rest_values, rest_index);
+    Reconstruct(rest_values, left_size + right_size, rest.Sum(), rest.Kind(), &subsets);
+    return subsets;
 }
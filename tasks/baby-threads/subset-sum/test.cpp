@@ -86,3 +86,29 @@ TEST(Correctness, Random2) {
         CheckAnswer(data, FindEqualSumSubsets(data), true);
     }
 }
+
+TEST(Correctness, Zeros) {
+    std::vector<int64_t> zero{0};
+    CheckAnswer(zero, FindEqualSumSubsets(zero), false);
+
+    std::vector<int64_t> zeros{0, 0};
+    CheckAnswer(zeros, FindEqualSumSubsets(zeros), true);
+}
+
+TEST(Correctness, PowersOfTwo) {
+    RandomGenerator gen(9374);
+    std::vector<int64_t> data{-1};
+    for (int i = 1; i < 22; ++i) {
+        data.push_back(data.back() * 2);
+    }
+    gen.Shuffle(data.begin(), data.end());
+    CheckAnswer(data, FindEqualSumSubsets(data), false);
+}
+
+TEST(Correctness, Random3) {
+    RandomGenerator gen(183745);
+    for (int i = 0; i < 5; ++i) {
+        auto data = FillData(gen, 24, 2 * i + 3, 10);
+        CheckAnswer(data, FindEqualSumSubsets(data), true);
+    }
+}
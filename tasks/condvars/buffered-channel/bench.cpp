@@ -1,6 +1,7 @@
 #include <benchmark/benchmark.h>
 #include <buffered_channel.h>
 
+#include <memory>
 #include <thread>
 #include <atomic>
 #include <vector>
@@ -64,6 +65,51 @@ void Run(benchmark::State& state) {
     }
 }
 
+// Every sender has a channel of its own, one reader selects over all of them.
+int64_t CalcSelectSum(int senders_count, int buff_size) {
+    std::vector<std::unique_ptr<BufferedChannel<int>>> channels;
+    std::vector<BufferedChannel<int>*> open;
+    std::vector<std::thread> threads;
+    threads.reserve(senders_count);
+    for (int i = 0; i < senders_count; ++i) {
+        channels.push_back(std::make_unique<BufferedChannel<int>>(buff_size));
+        open.push_back(channels.back().get());
+        threads.emplace_back([&channel = *channels.back(), senders_count](int start) {
+            for (int i = start; i < kCount; i += senders_count) {
+                channel.Send(i);
+            }
+            channel.Close();
+        }, i);
+    }
+
+    int64_t sum = 0;
+    while (!open.empty()) {
+        auto [index, value] = Select(open);
+        if (!value) {
+            open.erase(open.begin() + index);
+            continue;
+        }
+        sum += value.value();
+    }
+
+    for (auto& cur : threads) {
+        cur.join();
+    }
+
+    return sum;
+}
+
+void RunSelect(benchmark::State& state) {
+    int64_t ok_ans = static_cast<int64_t>(kCount) * (kCount - 1) / 2;
+    while (state.KeepRunning()) {
+        int buff_size = state.range(0);
+        int senders_count = state.range(1);
+        if (ok_ans != CalcSelectSum(senders_count, buff_size)) {
+            throw std::logic_error("Wrong sum");
+        }
+    }
+}
+
 const int kThreads = std::thread::hardware_concurrency();
 const int kHalf = std::max(1, kThreads / 2);
 const int kAnotherHalf = std::max(1, kThreads - kHalf);
@@ -74,6 +120,15 @@ BENCHMARK(Run)
     ->Args({2, 2, std::max(1, kThreads - 2)})
     ->Args({10, kHalf, kAnotherHalf})
     ->Args({100000, kHalf, kAnotherHalf})
+    ->Args({10, 32, 1})
+    ->Args({10, 32, 4})
+    ->MinTime(0.1);
+
+BENCHMARK(RunSelect)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond)
+    ->Args({10, 4})
+    ->Args({10, 32})
     ->MinTime(0.1);
 
 BENCHMARK_MAIN();
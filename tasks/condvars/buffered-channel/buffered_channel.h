@@ -1,25 +1,225 @@
 #pragma once
 
-#include <utility>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
 #include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace buffered_channel_internal {
+
+// One per Select call, so that any of the channels it waits on can wake it.
+struct SelectWaiter {
+    // Returns false if somebody has woken it already.
+    bool Wake() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (ready) {
+                return false;
+            }
+            ready = true;
+        }
+        cv.notify_one();
+        return true;
+    }
+
+    void Wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this] { return ready; });
+    }
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool ready = false;
+};
 
+}  // namespace buffered_channel_internal
+
+template <class T>
+class BufferedChannel;
+
+// Receives from whichever of |channels| is ready first, like a select statement in Go
+// with receive cases only: returns the index of the channel and what Recv() on it would
+// have returned, std::nullopt if it is closed and drained. Ready channels are polled
+// from a different one each call, so none of them starves. |channels| must not be empty.
+template <class T>
+std::pair<size_t, std::optional<T>> Select(const std::vector<BufferedChannel<T>*>& channels);
+
+// A fixed ring buffer under one mutex. Senders and receivers sleep on condvars of their
+// own and are counted, so that a send only signals when a receiver sleeps and the other
+// way round, one thread per element.
 template <class T>
 class BufferedChannel {
 public:
-    explicit BufferedChannel(int size) {
-        // Your code goes here
+    explicit BufferedChannel(int size) : buffer_(size) {
     }
 
+    BufferedChannel(const BufferedChannel&) = delete;
+    BufferedChannel& operator=(const BufferedChannel&) = delete;
+
+    // Throws std::runtime_error if the channel is closed.
     void Send(const T& value) {
-        // Your code goes here
+        Push(value);
+    }
+
+    void Send(T&& value) {
+        Push(std::move(value));
     }
 
+    // Returns std::nullopt once the channel is closed and drained.
     std::optional<T> Recv() {
-        // Your code goes here
-        return std::nullopt;
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!size_ && !closed_) {
+            ++waiting_receivers_;
+            not_empty_.wait(lock);
+            --waiting_receivers_;
+        }
+        if (!size_) {
+            return std::nullopt;
+        }
+        return Pop(lock);
     }
 
     void Close() {
-        // Your code goes here
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+            for (auto* selector : selectors_) {
+                selector->Wake();
+            }
+        }
+        not_full_.notify_all();
+        not_empty_.notify_all();
     }
+
+private:
+    friend std::pair<size_t, std::optional<T>> Select<T>(
+        const std::vector<BufferedChannel<T>*>& channels);
+
+    template <class U>
+    void Push(U&& value) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (size_ == buffer_.size() && !closed_) {
+            ++waiting_senders_;
+            not_full_.wait(lock);
+            --waiting_senders_;
+        }
+        if (closed_) {
+            throw std::runtime_error("Send on a closed channel");
+        }
+        auto tail = head_ + size_;
+        buffer_[tail < buffer_.size() ? tail : tail - buffer_.size()].emplace(
+            std::forward<U>(value));
+        ++size_;
+        WakeSelector();
+        bool wake = waiting_receivers_;
+        lock.unlock();
+        if (wake) {
+            not_empty_.notify_one();
+        }
+    }
+
+    // Requires a nonempty buffer, releases the lock.
+    T Pop(std::unique_lock<std::mutex>& lock) {
+        T value = std::move(*buffer_[head_]);
+        buffer_[head_].reset();
+        if (++head_ == buffer_.size()) {
+            head_ = 0;
+        }
+        --size_;
+        bool wake = waiting_senders_;
+        lock.unlock();
+        if (wake) {
+            not_full_.notify_one();
+        }
+        return value;
+    }
+
+    // Returns false if Recv() would block, otherwise receives into |value|.
+    bool TryRecv(std::optional<T>& value) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (size_) {
+            value.emplace(Pop(lock));
+            return true;
+        }
+        return closed_;
+    }
+
+    // The waiter is woken once the channel gets an element or closes. Returns whether
+    // Recv() would not block already.
+    bool AddSelector(buffered_channel_internal::SelectWaiter* waiter) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        selectors_.push_back(waiter);
+        return size_ || closed_;
+    }
+
+    void RemoveSelector(buffered_channel_internal::SelectWaiter* waiter) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& selector : selectors_) {
+            if (selector == waiter) {
+                selector = selectors_.back();
+                selectors_.pop_back();
+                break;
+            }
+        }
+        // The waiter may have been woken for an element here and then taken one from
+        // another channel, so the wake-up passes on while elements are left.
+        if (size_) {
+            WakeSelector();
+        }
+    }
+
+    // Under mutex_, which keeps the waiters from leaving their Select calls meanwhile.
+    // Wakes one selector per element, skipping those already woken.
+    void WakeSelector() {
+        for (auto* selector : selectors_) {
+            if (selector->Wake()) {
+                return;
+            }
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+    std::vector<std::optional<T>> buffer_;
+    size_t head_ = 0;
+    size_t size_ = 0;
+    int waiting_senders_ = 0;
+    int waiting_receivers_ = 0;
+    std::vector<buffered_channel_internal::SelectWaiter*> selectors_;
+    bool closed_ = false;
 };
+
+template <class T>
+std::pair<size_t, std::optional<T>> Select(const std::vector<BufferedChannel<T>*>& channels) {
+    static thread_local size_t calls = 0;
+    auto first = calls++;
+    buffered_channel_internal::SelectWaiter waiter;
+    while (true) {
+        for (size_t i = 0; i < channels.size(); ++i) {
+            auto index = (first + i) % channels.size();
+            std::optional<T> value;
+            if (channels[index]->TryRecv(value)) {
+                return {index, std::move(value)};
+            }
+        }
+
+        // Registering checks each channel again, which catches whatever arrived after the
+        // pass above. From then on the channels wake the waiter.
+        size_t registered = 0;
+        bool ready = false;
+        while (registered < channels.size() && !ready) {
+            ready = channels[registered++]->AddSelector(&waiter);
+        }
+        if (!ready) {
+            waiter.Wait();
+        }
+        for (size_t i = 0; i < registered; ++i) {
+            channels[i]->RemoveSelector(&waiter);
+        }
+        waiter.ready = false;
+    }
+}
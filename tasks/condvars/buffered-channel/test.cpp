@@ -8,6 +8,7 @@
 #include <stdexcept>
 #include <chrono>
 #include <algorithm>
+#include <memory>
 
 std::vector<int> Unpack(const std::vector<std::vector<int>>& values) {
     std::vector<int> all;
@@ -102,3 +103,54 @@ TEST(Correctness, BigBuf) {
 TEST(Correctness, Random) {
     RunTest(8, 8, 8, 300);
 }
+
+TEST(Correctness, MoveOnly) {
+    BufferedChannel<std::unique_ptr<int>> channel(2);
+    channel.Send(std::make_unique<int>(1));
+    channel.Send(std::make_unique<int>(2));
+    channel.Close();
+    ASSERT_EQ(*channel.Recv().value(), 1);
+    ASSERT_EQ(*channel.Recv().value(), 2);
+    ASSERT_FALSE(channel.Recv());
+}
+
+TEST(Correctness, Select) {
+    const int channels_count = 4;
+    const int values_count = 10000;
+    std::vector<std::unique_ptr<BufferedChannel<int>>> channels;
+    std::vector<BufferedChannel<int>*> pointers;
+    for (int i = 0; i < channels_count; ++i) {
+        channels.push_back(std::make_unique<BufferedChannel<int>>(3));
+        pointers.push_back(channels.back().get());
+    }
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < channels_count; ++i) {
+        threads.emplace_back([&channel = *channels[i], i]() {
+            for (int j = 0; j < values_count; ++j) {
+                channel.Send(i);
+            }
+            channel.Close();
+        });
+    }
+    std::vector<std::vector<int>> counts(2, std::vector<int>(channels_count));
+    for (auto& count : counts) {
+        threads.emplace_back([open = pointers, &count]() mutable {
+            while (!open.empty()) {
+                auto [index, value] = Select(open);
+                if (!value) {
+                    open.erase(open.begin() + index);
+                    continue;
+                }
+                ++count[*value];
+            }
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (int i = 0; i < channels_count; ++i) {
+        ASSERT_EQ(counts[0][i] + counts[1][i], values_count);
+    }
+}
@@ -72,7 +72,7 @@ void Reads(benchmark::State& state) {
 const int kThreads = std::thread::hardware_concurrency();
 
 BENCHMARK(Half)->Threads(kThreads)->UseRealTime();
-BENCHMARK(ReadOnly)->Threads(kThreads)->UseRealTime();
+BENCHMARK(ReadOnly)->ThreadRange(1, std::max(16, kThreads))->UseRealTime();
 BENCHMARK(Reads)->Threads(kThreads)->UseRealTime();
 
 BENCHMARK_MAIN();
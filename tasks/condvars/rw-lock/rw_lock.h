@@ -1,42 +1,107 @@
 #pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <memory>
 #include <mutex>
+#include <thread>
 
+// Readers announce themselves in one of several counters, each on a cache line of its
+// own, so that readers on different threads don't write to a shared line. A writer
+// raises writers_, which turns new readers away, and waits for every counter to drain:
+// writers are preferred, a stream of readers can't starve them.
 class RWLock {
 public:
+    RWLock()
+        : slots_count_(std::clamp<size_t>(std::bit_ceil(std::thread::hardware_concurrency()), 1,
+                                          kMaxSlots)),
+          slots_(std::make_unique<Slot[]>(slots_count_)) {
+    }
+
     template <class Func>
     void Read(Func func) {
-        read_.lock();
-        ++blocked_readers_;
-        if (blocked_readers_ == 1) {
-            global_.lock();
-        }
-        read_.unlock();
+        auto& readers = slots_[ThreadIndex() & (slots_count_ - 1)].readers;
+        BeginRead(readers);
         try {
             func();
         } catch (...) {
-            EndRead();
+            EndRead(readers);
             throw;
         }
-        EndRead();
+        EndRead(readers);
     }
 
     template <class Func>
     void Write(Func func) {
-        std::lock_guard<std::mutex> lock(global_);
-        func();
+        writers_.fetch_add(1);
+        std::unique_lock<std::mutex> lock(write_);
+        for (size_t i = 0; i < slots_count_; ++i) {
+            auto& readers = slots_[i].readers;
+            for (int count; (count = readers.load()) != 0;) {
+                readers.wait(count);
+            }
+        }
+        try {
+            func();
+        } catch (...) {
+            EndWrite(lock);
+            throw;
+        }
+        EndWrite(lock);
     }
 
 private:
-    std::mutex read_;
-    std::mutex global_;
-    int blocked_readers_ = 0;
-
-    void EndRead() {
-        read_.lock();
-        --blocked_readers_;
-        if (!blocked_readers_) {
-            global_.unlock();
+    static constexpr size_t kCacheLineSize = 64;
+    static constexpr size_t kMaxSlots = 64;
+
+    struct alignas(kCacheLineSize) Slot {
+        std::atomic<int> readers = 0;
+    };
+
+    // Threads get consecutive indices in the order they first take any RWLock, which
+    // spreads them evenly over the slots.
+    static size_t ThreadIndex() {
+        static std::atomic<size_t> next_index = 0;
+        static thread_local size_t index = next_index.fetch_add(1, std::memory_order_relaxed);
+        return index;
+    }
+
+    // A reader registers before it checks for writers, and a writer raises writers_
+    // before it checks the registrations, all sequentially consistent: at least one of
+    // them sees the other. The reader that sees a writer backs off until it is done.
+    void BeginRead(std::atomic<int>& readers) {
+        while (true) {
+            readers.fetch_add(1);
+            auto writers = writers_.load();
+            if (!writers) {
+                return;
+            }
+            EndRead(readers);
+            do {
+                writers_.wait(writers);
+            } while ((writers = writers_.load()) != 0);
+        }
+    }
+
+    void EndRead(std::atomic<int>& readers) {
+        readers.fetch_sub(1);
+        if (writers_.load()) {
+            readers.notify_all();
         }
-        read_.unlock();
     }
+
+    void EndWrite(std::unique_lock<std::mutex>& lock) {
+        lock.unlock();
+        if (writers_.fetch_sub(1) == 1) {
+            writers_.notify_all();
+        }
+    }
+
+    const size_t slots_count_;
+    const std::unique_ptr<Slot[]> slots_;
+    // Writers that hold write_ or wait for it.
+    std::atomic<int> writers_ = 0;
+    std::mutex write_;
 };
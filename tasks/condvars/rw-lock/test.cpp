@@ -120,3 +120,33 @@ TEST(Concurrency, OnlyWritingOrReading) {
         cur.join();
     }
 }
+
+TEST(Concurrency, WriterIsNotStarved) {
+    RWLock rw_lock;
+    int readers_count = 4;
+    std::atomic<bool> done(false);
+    std::vector<std::thread> readers;
+    readers.reserve(readers_count);
+    for (int i = 0; i < readers_count; ++i) {
+        // Read sections overlap all the time, so there is never a moment without readers.
+        readers.emplace_back([&done, &rw_lock]() {
+            while (!done) {
+                rw_lock.Read([]() {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                });
+            }
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    auto start = Now();
+    int value = 0;
+    rw_lock.Write([&value]() { value = 1; });
+    auto elapsed = ElapsedTime(start);
+    done = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    ASSERT_EQ(1, value);
+    ASSERT_LT(elapsed, 0.5);
+}
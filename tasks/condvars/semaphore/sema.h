@@ -1,7 +1,11 @@
 #pragma once
 
-#include <mutex>
+#include <atomic>
+#include <concepts>
 #include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <mutex>
 
 class DefaultCallback {
 public:
@@ -10,33 +14,145 @@ public:
     }
 };
 
+// The permits are an atomic counter: Enter and Leave only touch it while nobody waits.
+// A thread that can't get its permits queues up on a node of its own stack frame and
+// is handed them in queue order by Leave, so waiting threads get in in the order they
+// came. With Order::kFifo a thread also queues up whenever others already wait, which
+// makes the whole order of Enter calls FIFO; with Order::kBarging it takes free permits
+// regardless, which is faster under contention but may starve the waiting threads.
 class Semaphore {
 public:
-    Semaphore(int count) : count_(count) {
+    enum class Order { kFifo, kBarging };
+
+    Semaphore(int count, Order order = Order::kFifo) : available_(count), order_(order) {
+    }
+
+    void Leave(int count = 1) {
+        available_.fetch_add(count);
+        // Sequentially consistent, see Wait.
+        if (waiting_.load()) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            Dispatch();
+        }
     }
 
-    void Leave() {
+    // Takes |count| permits at once.
+    void Enter(int count = 1) {
+        if (order_ == Order::kBarging || !waiting_.load(std::memory_order_relaxed)) {
+            auto available = available_.load(std::memory_order_relaxed);
+            while (available >= count) {
+                if (available_.compare_exchange_weak(available, available - count)) {
+                    return;
+                }
+            }
+        }
+        Waiter waiter(count);
         std::unique_lock<std::mutex> lock(mutex_);
-        ++count_;
-        cv_.notify_one();
+        Wait(waiter, lock);
     }
 
+    // Waits for a permit and calls |callback| with the number of free permits, under the
+    // semaphore's lock as they are granted: callbacks run one at a time, in the order of
+    // the grants. The callback takes permits by decreasing the number, what it leaves
+    // stays free. An exception escaping the callback is rethrown here.
     template <class Func>
+        requires std::invocable<Func&, int&>
     void Enter(Func callback) {
+        Waiter waiter(1);
+        waiter.callback = [](void* callback, int& permits) {
+            (*static_cast<Func*>(callback))(permits);
+        };
+        waiter.callback_state = &callback;
         std::unique_lock<std::mutex> lock(mutex_);
-        while (!count_) {
-            cv_.wait(lock);
+        if ((order_ == Order::kBarging || !head_) && Lend(waiter)) {
+            // The callback may have left more permits than it found.
+            Dispatch();
+        } else {
+            Wait(waiter, lock);
+        }
+        lock.unlock();
+        if (waiter.error) {
+            std::rethrow_exception(waiter.error);
         }
-        callback(count_);
     }
 
-    void Enter() {
-        DefaultCallback callback;
-        Enter(callback);
+private:
+    struct Waiter {
+        explicit Waiter(int count) : count(count) {
+        }
+
+        int count;
+        // Called by whoever grants the waiter its turn, instead of taking |count| permits.
+        void (*callback)(void* callback_state, int& permits) = nullptr;
+        void* callback_state = nullptr;
+        std::exception_ptr error;
+        bool granted = false;
+        std::condition_variable cv;
+        Waiter* next = nullptr;
+    };
+
+    // The waiter is counted before it looks at the permits, and Leave adds permits before
+    // it looks at the count, all sequentially consistent: either the waiter sees the
+    // permits or Leave sees the waiter and hands them over.
+    void Wait(Waiter& waiter, std::unique_lock<std::mutex>& lock) {
+        (tail_ ? tail_->next : head_) = &waiter;
+        tail_ = &waiter;
+        waiting_.fetch_add(1);
+        Dispatch();
+        waiter.cv.wait(lock, [&waiter] { return waiter.granted; });
     }
 
-private:
+    // Under mutex_. Lends all the free permits, at least one, to the waiter's callback
+    // and takes back what it leaves. Meanwhile the other threads see none.
+    bool Lend(Waiter& waiter) {
+        auto available = available_.load();
+        do {
+            if (available < 1) {
+                return false;
+            }
+        } while (!available_.compare_exchange_weak(available, 0));
+        int permits = available;
+        try {
+            waiter.callback(waiter.callback_state, permits);
+        } catch (...) {
+            waiter.error = std::current_exception();
+        }
+        available_.fetch_add(permits);
+        return true;
+    }
+
+    // Under mutex_. Serves the queue from its head while there are permits enough.
+    void Dispatch() {
+        while (head_) {
+            if (head_->callback) {
+                if (!Lend(*head_)) {
+                    return;
+                }
+            } else {
+                auto available = available_.load();
+                if (available < head_->count) {
+                    return;
+                }
+                if (!available_.compare_exchange_weak(available, available - head_->count)) {
+                    continue;
+                }
+            }
+            auto* waiter = head_;
+            head_ = waiter->next;
+            if (!head_) {
+                tail_ = nullptr;
+            }
+            waiting_.fetch_sub(1);
+            waiter->granted = true;
+            waiter->cv.notify_one();
+        }
+    }
+
+    std::atomic<int64_t> available_;
+    // Threads in the queue.
+    std::atomic<int> waiting_ = 0;
+    const Order order_;
     std::mutex mutex_;
-    std::condition_variable cv_;
-    int count_ = 0;
+    Waiter* head_ = nullptr;
+    Waiter* tail_ = nullptr;
 };
@@ -4,6 +4,7 @@
 #include <vector>
 #include <chrono>
 #include <atomic>
+#include <stdexcept>
 
 #include <gtest/gtest.h>
 
@@ -95,3 +96,74 @@ TEST(Order, Mutex) {
 TEST(Order, Semaphore) {
     RunTest(4, 3);
 }
+
+TEST(Bulk, Permits) {
+    Semaphore semaphore(5);
+    semaphore.Enter(3);
+    std::atomic<bool> entered = false;
+    std::thread big([&semaphore, &entered]() {
+        semaphore.Enter(4);
+        entered = true;
+        semaphore.Leave(4);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    semaphore.Leave(1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    ASSERT_FALSE(entered);
+    semaphore.Leave(2);
+    big.join();
+    ASSERT_TRUE(entered);
+    semaphore.Enter(5);
+}
+
+TEST(Bulk, Barging) {
+    int threads_count = 8;
+    int iterations = 10000;
+    Semaphore semaphore(2, Semaphore::Order::kBarging);
+    std::atomic<int> inside = 0;
+    std::vector<std::thread> threads;
+    threads.reserve(threads_count);
+    for (int i = 0; i < threads_count; ++i) {
+        threads.emplace_back([&semaphore, &inside, iterations, i]() {
+            int count = i % 2 + 1;
+            for (int j = 0; j < iterations; ++j) {
+                semaphore.Enter(count);
+                ASSERT_LE(inside += count, 2);
+                inside -= count;
+                semaphore.Leave(count);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    semaphore.Enter(2);
+}
+
+TEST(Callback, Permits) {
+    Semaphore semaphore(3);
+    semaphore.Enter([](int& value) {
+        ASSERT_EQ(3, value);
+        value -= 2;
+    });
+    semaphore.Enter();
+    std::atomic<bool> entered = false;
+    std::thread waiter([&semaphore, &entered]() {
+        semaphore.Enter([&entered](int& value) {
+            EXPECT_EQ(2, value);
+            --value;
+            entered = true;
+        });
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    ASSERT_FALSE(entered);
+    semaphore.Leave(2);
+    waiter.join();
+    ASSERT_TRUE(entered);
+
+    EXPECT_THROW(semaphore.Enter([](int&) { throw std::runtime_error("callback"); }),
+                 std::runtime_error);
+    semaphore.Enter();
+    semaphore.Leave(3);
+    semaphore.Enter(3);
+}
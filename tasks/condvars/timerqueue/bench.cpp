@@ -0,0 +1,44 @@
+#include <benchmark/benchmark.h>
+#include <timerqueue.h>
+
+#include <chrono>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+// Timeouts that almost never fire: each one is cancelled kPending adds later.
+void AddCancelChurn(benchmark::State& state) {
+    const size_t kPending = state.range(0);
+    TimerQueue<int> queue;
+    std::vector<TimerQueue<int>::Handle> handles(kPending);
+    auto now = TimerQueue<int>::Clock::now();
+    size_t i = 0;
+    for (auto& handle : handles) {
+        handle = queue.Add(i++, now + 30s);
+    }
+    while (state.KeepRunning()) {
+        auto& handle = handles[i % kPending];
+        queue.Cancel(handle);
+        handle = queue.Add(i, now + 30s + std::chrono::milliseconds(i % 100000));
+        ++i;
+    }
+}
+
+// Items that are due by the time they are popped, all of them in one batch.
+void BatchExpiry(benchmark::State& state) {
+    const int kBatch = state.range(0);
+    TimerQueue<int> queue;
+    while (state.KeepRunning()) {
+        auto now = TimerQueue<int>::Clock::now();
+        for (int i = 0; i < kBatch; ++i) {
+            queue.Add(i, now - std::chrono::microseconds(i));
+        }
+        benchmark::DoNotOptimize(queue.PopExpired());
+    }
+    state.SetItemsProcessed(state.iterations() * kBatch);
+}
+
+BENCHMARK(AddCancelChurn)->Arg(1 << 10)->Arg(1 << 20);
+BENCHMARK(BatchExpiry)->Arg(1 << 10);
+
+BENCHMARK_MAIN();
@@ -1,53 +1,289 @@
 #pragma once
 
-#include <mutex>
-#include <condition_variable>
+#include <array>
+#include <bit>
 #include <chrono>
-#include <map>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <optional>
 #include <queue>
-#include <thread>
 #include <utility>
+#include <vector>
 
+// A hashed hierarchical timing wheel (Varghese and Lauck) with a tick of a millisecond.
+// Level l has 64 slots of 64^l ticks each, eleven levels cover every 64-bit tick. An
+// item sits in the level of the highest bit in which its tick differs from the current
+// one, so Add and Cancel are O(1). When the clock reaches the start of a slot, its items
+// move one level down or, at the bottom, to a heap ordered by the exact time, from
+// which they are popped. Empty stretches are skipped with per-level occupancy masks.
 template <class T>
 class TimerQueue {
 public:
-    using Clock = std::chrono::system_clock;
+    using Clock = std::chrono::steady_clock;
     using TimePoint = Clock::time_point;
 
+    // Identifies an added item until it is popped or cancelled.
+    struct Handle {
+        uint32_t index;
+        uint32_t generation;
+    };
+
 public:
-    void Add(const T& item, TimePoint at) {
+    TimerQueue() : current_tick_(TickOf(Clock::now())) {
+        for (auto& level : slots_) {
+            level.fill(kNil);
+        }
+    }
+
+    Handle Add(const T& item, TimePoint at) {
         std::unique_lock<std::mutex> guard(mutex_);
-        if (queue_.empty()) {
-            condvar_empty_.notify_one();
+        auto index = Allocate(item, at);
+        Schedule(index);
+        // A sleeping Pop only needs to hear about items due before it wakes anyway.
+        bool wake = sleeping_ && at < wake_at_;
+        if (wake) {
+            wake_at_ = at;
+        }
+        guard.unlock();
+        if (wake) {
+            condvar_.notify_one();
+        }
+        return {index, nodes_[index].generation};
+    }
+
+    // Returns false if the item has already been popped or cancelled.
+    bool Cancel(Handle handle) {
+        std::lock_guard<std::mutex> guard(mutex_);
+        if (handle.index >= nodes_.size() || nodes_[handle.index].generation != handle.generation) {
+            return false;
+        }
+        auto& node = nodes_[handle.index];
+        ++node.generation;
+        if (node.level == kReady) {
+            // Somewhere in the heap, which drops it once it comes to the top.
+            node.item.reset();
         } else {
-            if (queue_.top().first > at) {
-                condvar_waiters_.notify_one();
-            }
+            Unlink(handle.index);
+            Free(handle.index);
         }
-        queue_.push({at, item});
+        return true;
     }
 
+    // Waits for the earliest item and returns it.
     T Pop() {
         std::unique_lock<std::mutex> guard(mutex_);
+        WaitUntilDue(guard);
+        return TakeDue();
+    }
+
+    // Waits for the earliest item and returns it together with every other item due by
+    // then, in the order of their times.
+    std::vector<T> PopExpired() {
+        std::unique_lock<std::mutex> guard(mutex_);
+        auto now = WaitUntilDue(guard);
+        std::vector<T> items;
+        do {
+            items.push_back(TakeDue());
+            DropCancelled();
+        } while (!ready_.empty() && ready_.top().first <= now);
+        return items;
+    }
+
+private:
+    static constexpr int kLevelBits = 6;
+    static constexpr int kLevels = 11;
+    static constexpr uint64_t kSlotMask = (uint64_t{1} << kLevelBits) - 1;
+    static constexpr uint32_t kNil = std::numeric_limits<uint32_t>::max();
+    // The level of nodes in the heap.
+    static constexpr uint8_t kReady = kLevels;
+
+    // Free nodes are chained through |next|.
+    struct Node {
+        std::optional<T> item;
+        TimePoint at;
+        uint32_t generation = 0;
+        uint32_t prev = kNil;
+        uint32_t next = kNil;
+        uint8_t level = 0;
+        uint8_t slot = 0;
+    };
 
-        condvar_empty_.wait(guard, [this]() -> bool { return !queue_.empty(); });
+    using ReadyEntry = std::pair<TimePoint, uint32_t>;
+
+    static uint64_t TickOf(TimePoint at) {
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(at.time_since_epoch());
+        return ms.count() > 0 ? ms.count() : 0;
+    }
 
-        while (queue_.top().first > Clock::now()) {
-            auto time = queue_.top().first;
-            condvar_waiters_.wait_until(guard, time);
+    static TimePoint StartOf(uint64_t tick) {
+        return TimePoint(std::chrono::milliseconds(tick));
+    }
+
+    uint32_t Allocate(const T& item, TimePoint at) {
+        uint32_t index;
+        if (free_ != kNil) {
+            index = free_;
+            free_ = nodes_[index].next;
+        } else {
+            index = nodes_.size();
+            nodes_.emplace_back();
         }
+        auto& node = nodes_[index];
+        node.item.emplace(item);
+        node.at = at;
+        return index;
+    }
 
-        T ans = queue_.top().second;
-        queue_.pop();
+    // The caller has moved the generation on, which invalidates the handles.
+    void Free(uint32_t index) {
+        auto& node = nodes_[index];
+        node.item.reset();
+        node.next = free_;
+        free_ = index;
+    }
 
-        return ans;
+    void Schedule(uint32_t index) {
+        auto& node = nodes_[index];
+        auto tick = TickOf(node.at);
+        if (tick <= current_tick_) {
+            node.level = kReady;
+            ready_.emplace(node.at, index);
+            return;
+        }
+        auto level = (63 - std::countl_zero(tick ^ current_tick_)) / kLevelBits;
+        auto slot = (tick >> (level * kLevelBits)) & kSlotMask;
+        node.level = level;
+        node.slot = slot;
+        node.prev = kNil;
+        node.next = slots_[level][slot];
+        if (node.next != kNil) {
+            nodes_[node.next].prev = index;
+        }
+        slots_[level][slot] = index;
+        occupied_[level] |= uint64_t{1} << slot;
     }
 
-private:
-    std::priority_queue<std::pair<TimePoint, T>, std::vector<std::pair<TimePoint, T>>,
-                        std::greater<std::pair<TimePoint, T>>>
-        queue_;
-    std::condition_variable condvar_empty_;
-    std::condition_variable condvar_waiters_;
+    void Unlink(uint32_t index) {
+        auto& node = nodes_[index];
+        if (node.prev != kNil) {
+            nodes_[node.prev].next = node.next;
+        } else {
+            slots_[node.level][node.slot] = node.next;
+            if (node.next == kNil) {
+                occupied_[node.level] &= ~(uint64_t{1} << node.slot);
+            }
+        }
+        if (node.next != kNil) {
+            nodes_[node.next].prev = node.prev;
+        }
+    }
+
+    // The start of the earliest occupied slot after the current tick. Lower levels hold
+    // earlier ticks, so it is the first one found going up.
+    std::optional<uint64_t> NextOccupiedTick() const {
+        for (int level = 0; level < kLevels; ++level) {
+            auto shift = level * kLevelBits;
+            auto current_slot = (current_tick_ >> shift) & kSlotMask;
+            auto later = occupied_[level] & ~((uint64_t{2} << current_slot) - 1);
+            if (later) {
+                auto period_shift = shift + kLevelBits;
+                auto period = period_shift < 64 ? current_tick_ >> period_shift << period_shift : 0;
+                return period | (static_cast<uint64_t>(std::countr_zero(later)) << shift);
+            }
+        }
+        return std::nullopt;
+    }
+
+    // Moves the clock to |tick|, passing through the occupied slots on the way.
+    void Advance(uint64_t tick) {
+        while (current_tick_ < tick) {
+            auto next = NextOccupiedTick();
+            if (!next || *next > tick) {
+                current_tick_ = tick;
+                return;
+            }
+            current_tick_ = *next;
+            // A slot starts where all the lower bits of the tick are zero. Its items are
+            // placed again relative to the new tick, which puts them in later slots of
+            // lower levels, or in the heap if their tick has come.
+            for (int level = kLevels - 1; level >= 0; --level) {
+                auto shift = level * kLevelBits;
+                if (current_tick_ & ((uint64_t{1} << shift) - 1)) {
+                    continue;
+                }
+                auto slot = (current_tick_ >> shift) & kSlotMask;
+                auto index = slots_[level][slot];
+                slots_[level][slot] = kNil;
+                occupied_[level] &= ~(uint64_t{1} << slot);
+                while (index != kNil) {
+                    auto next_index = nodes_[index].next;
+                    Schedule(index);
+                    index = next_index;
+                }
+            }
+        }
+    }
+
+    void DropCancelled() {
+        while (!ready_.empty() && !nodes_[ready_.top().second].item) {
+            auto index = ready_.top().second;
+            ready_.pop();
+            Free(index);
+        }
+    }
+
+    // Returns the time at which the earliest item was found due.
+    TimePoint WaitUntilDue(std::unique_lock<std::mutex>& guard) {
+        while (true) {
+            auto now = Clock::now();
+            Advance(TickOf(now));
+            DropCancelled();
+            if (!ready_.empty() && ready_.top().first <= now) {
+                return now;
+            }
+
+            auto wake_at = TimePoint::max();
+            if (!ready_.empty()) {
+                wake_at = ready_.top().first;
+            }
+            if (auto tick = NextOccupiedTick()) {
+                wake_at = std::min(wake_at, StartOf(*tick));
+            }
+            ++sleeping_;
+            wake_at_ = std::min(wake_at_, wake_at);
+            if (wake_at == TimePoint::max()) {
+                condvar_.wait(guard);
+            } else {
+                condvar_.wait_until(guard, wake_at);
+            }
+            // The others only tell theirs again once they wake, until then every Add
+            // wakes one of them to be safe.
+            --sleeping_;
+            wake_at_ = TimePoint::max();
+        }
+    }
+
+    T TakeDue() {
+        auto index = ready_.top().second;
+        ready_.pop();
+        T item = std::move(*nodes_[index].item);
+        ++nodes_[index].generation;
+        Free(index);
+        return item;
+    }
+
+    std::vector<Node> nodes_;
+    uint32_t free_ = kNil;
+    std::array<std::array<uint32_t, 1 << kLevelBits>, kLevels> slots_;
+    std::array<uint64_t, kLevels> occupied_ = {};
+    uint64_t current_tick_;
+    std::priority_queue<ReadyEntry, std::vector<ReadyEntry>, std::greater<ReadyEntry>> ready_;
+    // The earliest time a sleeping Pop wakes up at.
+    TimePoint wake_at_ = TimePoint::max();
+    int sleeping_ = 0;
+    std::condition_variable condvar_;
     std::mutex mutex_;
 };
@@ -5,13 +5,14 @@
 #include <chrono>
 #include <thread>
 #include <atomic>
+#include <vector>
 
 using namespace std::chrono_literals;
 
 namespace {
 
 auto Now() {
-    return std::chrono::system_clock::now();
+    return std::chrono::steady_clock::now();
 }
 
 }  // namespace
@@ -49,7 +50,7 @@ TEST(TimerQueue, Blocking) {
     queue.Add(0, now + 500ms);
     queue.Pop();
 
-    ASSERT_TRUE(std::chrono::system_clock::now() >= now + 500ms);
+    ASSERT_TRUE(std::chrono::steady_clock::now() >= now + 500ms);
 }
 
 TEST(TimerQueue, TwoThreads) {
@@ -71,7 +72,7 @@ TEST(TimerQueue, TwoThreads) {
 }
 
 TEST(TimerQueue, WakeUp) {
-    TimerQueue<std::chrono::system_clock::time_point> queue;
+    TimerQueue<std::chrono::steady_clock::time_point> queue;
 
     std::thread worker([&] {
         for (int i = 0; i < 5; ++i) {
@@ -92,7 +93,7 @@ TEST(TimerQueue, WakeUp) {
 }
 
 TEST(TimerQueue, TimerReschedule) {
-    auto now = std::chrono::system_clock::now();
+    auto now = std::chrono::steady_clock::now();
 
     TimerQueue<int> queue;
     queue.Add(0, now + 10s);
@@ -104,5 +105,57 @@ TEST(TimerQueue, TimerReschedule) {
     queue.Add(1, now);
     worker.join();
 
-    ASSERT_TRUE(std::chrono::system_clock::now() < now + 1s);
+    ASSERT_TRUE(std::chrono::steady_clock::now() < now + 1s);
+}
+
+TEST(TimerQueue, Cancel) {
+    auto now = Now();
+
+    TimerQueue<int> queue;
+    auto first = queue.Add(0, now + 5ms);
+    queue.Add(1, now + 10ms);
+    auto far = queue.Add(2, now + 1h);
+    auto due = queue.Add(3, now);
+
+    ASSERT_TRUE(queue.Cancel(first));
+    ASSERT_FALSE(queue.Cancel(first));
+    ASSERT_TRUE(queue.Cancel(far));
+    ASSERT_EQ(3, queue.Pop());
+    ASSERT_FALSE(queue.Cancel(due));
+    ASSERT_EQ(1, queue.Pop());
+    ASSERT_TRUE(Now() >= now + 10ms);
+}
+
+TEST(TimerQueue, PopExpired) {
+    auto now = Now();
+    auto delay = [](int i) { return std::chrono::microseconds(i * 97 % 1000); };
+
+    TimerQueue<int> queue;
+    for (int i = 0; i < 1000; ++i) {
+        queue.Add(i, now + delay(i));
+    }
+    queue.Add(1000, now + 1s);
+    std::this_thread::sleep_for(5ms);
+
+    auto items = queue.PopExpired();
+    ASSERT_EQ(1000u, items.size());
+    for (size_t i = 1; i < items.size(); ++i) {
+        ASSERT_LT(delay(items[i - 1]), delay(items[i]));
+    }
+}
+
+TEST(TimerQueue, Cascade) {
+    auto now = Now();
+
+    TimerQueue<int> queue;
+    // Far enough apart to start in different levels of the wheel.
+    std::vector<std::chrono::milliseconds> delays = {70ms, 1ms, 300ms, 5000ms / 4, 65ms, 2s};
+    for (size_t i = 0; i < delays.size(); ++i) {
+        queue.Add(i, now + delays[i]);
+    }
+    std::vector<int> order = {1, 4, 0, 2, 3, 5};
+    for (auto expected : order) {
+        ASSERT_EQ(expected, queue.Pop());
+        ASSERT_TRUE(Now() >= now + delays[expected]);
+    }
 }
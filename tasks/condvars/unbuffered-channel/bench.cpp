@@ -63,6 +63,26 @@ void Run(benchmark::State& state) {
     }
 }
 
+// One round trip per iteration: the echo thread sends back whatever it receives.
+void PingPong(benchmark::State& state) {
+    UnbufferedChannel<int> ping;
+    UnbufferedChannel<int> pong;
+    std::thread echo([&ping, &pong]() {
+        while (auto value = ping.Recv()) {
+            pong.Send(*value);
+        }
+    });
+    int i = 0;
+    while (state.KeepRunning()) {
+        ping.Send(i);
+        if (pong.Recv() != i++) {
+            throw std::logic_error("Wrong value");
+        }
+    }
+    ping.Close();
+    echo.join();
+}
+
 const int kThreads = std::thread::hardware_concurrency();
 const int kHalf = std::max(1, kThreads / 2);
 const int kAnotherHalf = std::max(1, kThreads - kHalf);
@@ -75,4 +95,6 @@ BENCHMARK(Run)
     ->Args({std::max(1, kThreads - 2), 2})
     ->MinTime(0.1);
 
+BENCHMARK(PingPong)->UseRealTime();
+
 BENCHMARK_MAIN();
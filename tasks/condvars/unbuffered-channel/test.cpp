@@ -7,6 +7,7 @@
 #include <stdexcept>
 #include <chrono>
 #include <algorithm>
+#include <memory>
 
 std::chrono::high_resolution_clock::time_point Now() {
     return std::chrono::high_resolution_clock::now();
@@ -149,3 +150,15 @@ TEST(Block, Sender) {
 TEST(Block, Receiver) {
     BlockRun(BlockType::kReceiver);
 }
+
+TEST(Correctness, MoveOnly) {
+    UnbufferedChannel<std::unique_ptr<int>> channel;
+    std::thread sender([&channel]() {
+        channel.Send(std::make_unique<int>(1));
+        auto value = std::make_unique<int>(2);
+        channel.Send(std::move(value));
+    });
+    ASSERT_EQ(*channel.Recv().value(), 1);
+    ASSERT_EQ(*channel.Recv().value(), 2);
+    sender.join();
+}
@@ -1,21 +1,158 @@
 #pragma once
 
-#include <utility>
+#include <atomic>
+#include <mutex>
 #include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
 
+// Threads that find no partner wait in FIFO order, each on a node of its own stack
+// frame, which the partner that comes along unlinks and wakes alone. The value goes
+// straight from the sender's argument into the receiver's result: there is no buffer
+// and nothing is allocated.
 template <class T>
 class UnbufferedChannel {
 public:
+    UnbufferedChannel() = default;
+    UnbufferedChannel(const UnbufferedChannel&) = delete;
+    UnbufferedChannel& operator=(const UnbufferedChannel&) = delete;
+
+    // Returns once a receiver has got the value. Throws std::runtime_error if the
+    // channel is closed before that.
     void Send(const T& value) {
-        // Your code goes here
+        Transfer(value);
     }
 
+    void Send(T&& value) {
+        Transfer(std::move(value));
+    }
+
+    // Returns std::nullopt once the channel is closed.
     std::optional<T> Recv() {
-        // Your code goes here
-        return std::nullopt;
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (auto* sender = senders_.Pop()) {
+            std::optional<T> value;
+            if (sender->move_from) {
+                value.emplace(std::move(*sender->move_from));
+            } else if constexpr (std::is_copy_constructible_v<T>) {
+                value.emplace(*sender->copy_from);
+            }
+            Finish(sender, State::kDone);
+            return value;
+        }
+        if (closed_) {
+            return std::nullopt;
+        }
+
+        std::optional<T> value;
+        ReceiverNode node;
+        node.value = &value;
+        receivers_.Push(&node);
+        Wait(lock, node);
+        return value;
     }
 
+    // Fails the waiting senders and wakes the waiting receivers empty-handed.
     void Close() {
-        // Your code goes here
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        while (auto* sender = senders_.Pop()) {
+            Finish(sender, State::kClosed);
+        }
+        while (auto* receiver = receivers_.Pop()) {
+            Finish(receiver, State::kClosed);
+        }
     }
+
+private:
+    enum class State { kWaiting, kDone, kClosed };
+
+    template <class Node>
+    struct NodeBase {
+        std::atomic<State> state = State::kWaiting;
+        Node* next = nullptr;
+    };
+
+    // Points at the argument of Send, which the receiver copies or moves from as the
+    // overload calls for.
+    struct SenderNode : NodeBase<SenderNode> {
+        const T* copy_from = nullptr;
+        T* move_from = nullptr;
+    };
+
+    struct ReceiverNode : NodeBase<ReceiverNode> {
+        std::optional<T>* value;
+    };
+
+    template <class Node>
+    class Queue {
+    public:
+        void Push(Node* node) {
+            (tail_ ? tail_->next : head_) = node;
+            tail_ = node;
+        }
+
+        Node* Pop() {
+            auto* node = head_;
+            if (node) {
+                head_ = node->next;
+                if (!head_) {
+                    tail_ = nullptr;
+                }
+            }
+            return node;
+        }
+
+    private:
+        Node* head_ = nullptr;
+        Node* tail_ = nullptr;
+    };
+
+    template <class U>
+    void Transfer(U&& value) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (closed_) {
+            throw std::runtime_error("Send on a closed channel");
+        }
+        if (auto* receiver = receivers_.Pop()) {
+            receiver->value->emplace(std::forward<U>(value));
+            Finish(receiver, State::kDone);
+            return;
+        }
+
+        SenderNode node;
+        if constexpr (std::is_lvalue_reference_v<U>) {
+            node.copy_from = &value;
+        } else {
+            node.move_from = &value;
+        }
+        senders_.Push(&node);
+        if (Wait(lock, node) == State::kClosed) {
+            throw std::runtime_error("Send on a closed channel");
+        }
+    }
+
+    // Under mutex_, see Wait.
+    template <class Node>
+    static void Finish(Node* node, State state) {
+        node->state.store(state, std::memory_order_release);
+        node->state.notify_one();
+    }
+
+    // Sleeps on the node's own futex rather than on a condvar, so that the thread wakes
+    // up without competing for mutex_. It only takes the mutex once more before the node
+    // goes out of scope, to let Finish return from notify_one.
+    template <class Node>
+    State Wait(std::unique_lock<std::mutex>& lock, Node& node) {
+        lock.unlock();
+        node.state.wait(State::kWaiting, std::memory_order_acquire);
+        lock.lock();
+        return node.state.load(std::memory_order_relaxed);
+    }
+
+    std::mutex mutex_;
+    Queue<SenderNode> senders_;
+    Queue<ReceiverNode> receivers_;
+    bool closed_ = false;
 };
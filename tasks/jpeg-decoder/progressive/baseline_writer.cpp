@@ -0,0 +1,445 @@
+#include "baseline_writer.h"
+
+#include "markers.h"
+
+#include <bit>
+#include <cstdlib>
+#include <stdexcept>
+
+namespace {
+
+const size_t kMaxBlocksInMcu = 10;
+const size_t kAcSlots = 2;
+const int kMaxDcCategory = 11;
+const int kMaxAcCategory = 10;
+const int kEndOfBlock = 0x00;
+const int kZeroRun = 0xF0;
+
+// Standard Huffman tables, Annex K.3.
+const std::array<uint8_t, 16> kDcLuminanceLengths = {0, 1, 5, 1, 1, 1, 1, 1,
+                                                     1, 0, 0, 0, 0, 0, 0, 0};
+const std::array<uint8_t, 16> kDcChrominanceLengths = {0, 3, 1, 1, 1, 1, 1, 1,
+                                                       1, 1, 1, 0, 0, 0, 0, 0};
+const std::array<uint8_t, 12> kDcValues = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+
+const std::array<uint8_t, 16> kAcLuminanceLengths = {0, 2, 1, 3, 3, 2, 4, 3,
+                                                     5, 5, 4, 4, 0, 0, 1, 0x7D};
+const std::array<uint8_t, 162> kAcLuminanceValues = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61,
+    0x07, 0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xA1, 0x08, 0x23, 0x42, 0xB1, 0xC1, 0x15, 0x52,
+    0xD1, 0xF0, 0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0A, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x25,
+    0x26, 0x27, 0x28, 0x29, 0x2A, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45,
+    0x46, 0x47, 0x48, 0x49, 0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64,
+    0x65, 0x66, 0x67, 0x68, 0x69, 0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x83,
+    0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99,
+    0x9A, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7, 0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6,
+    0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3, 0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3,
+    0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA, 0xE1, 0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8,
+    0xE9, 0xEA, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8, 0xF9, 0xFA};
+
+const std::array<uint8_t, 16> kAcChrominanceLengths = {0, 2, 1, 2, 4, 4, 3, 4,
+                                                       7, 5, 4, 4, 0, 1, 2, 0x77};
+const std::array<uint8_t, 162> kAcChrominanceValues = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61,
+    0x71, 0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xA1, 0xB1, 0xC1, 0x09, 0x23, 0x33,
+    0x52, 0xF0, 0x15, 0x62, 0x72, 0xD1, 0x0A, 0x16, 0x24, 0x34, 0xE1, 0x25, 0xF1, 0x17, 0x18,
+    0x19, 0x1A, 0x26, 0x27, 0x28, 0x29, 0x2A, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44,
+    0x45, 0x46, 0x47, 0x48, 0x49, 0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63,
+    0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A,
+    0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97,
+    0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7, 0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4,
+    0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3, 0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA,
+    0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA, 0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7,
+    0xE8, 0xE9, 0xEA, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8, 0xF9, 0xFA};
+
+// Huffman table slots are DC 0, DC 1, AC 0, AC 1. Luma uses tables 0 and every other
+// component shares tables 1.
+size_t HuffmanTable(size_t component) {
+    return component ? 1 : 0;
+}
+
+// Number of bits of the magnitude of |value| (F.1.2.1).
+int Category(int value) {
+    return std::bit_width(static_cast<unsigned>(std::abs(value)));
+}
+
+size_t BlocksInMcu(const FrameCoefficients& frame) {
+    size_t blocks = 0;
+    for (const auto& component : frame.components) {
+        blocks += component.h * component.v;
+    }
+    return blocks;
+}
+
+// A single component scan is never interleaved and covers only the blocks with
+// samples, an interleaved one covers whole MCUs.
+bool IsInterleaved(const FrameCoefficients& frame) {
+    return frame.components.size() > 1 && BlocksInMcu(frame) <= kMaxBlocksInMcu;
+}
+
+void CheckFrame(const FrameCoefficients& frame) {
+    if (!frame.width || !frame.height || frame.width > 0xFFFF || frame.height > 0xFFFF) {
+        throw std::invalid_argument("Image size is out of range");
+    }
+    if (frame.components.empty() || frame.components.size() > kMaxComponents) {
+        throw std::invalid_argument("Invalid number of components");
+    }
+    for (const auto& component : frame.components) {
+        if (component.h < 1 || component.h > 4 || component.v < 1 || component.v > 4) {
+            throw std::invalid_argument("Invalid sampling factors");
+        }
+        if (component.data.size() !=
+            component.stride_in_blocks * component.padded_height_in_blocks * kBlockSize) {
+            throw std::invalid_argument("Coefficients don't match the frame layout");
+        }
+        for (auto value : component.quant) {
+            if (!value) {
+                throw std::invalid_argument("Zero quantization step");
+            }
+        }
+    }
+}
+
+// Sink that gathers the symbol statistics for the optimal tables.
+class SymbolCounter {
+public:
+    explicit SymbolCounter(std::array<std::array<uint32_t, 256>, 4>* frequencies)
+        : frequencies_(frequencies) {
+    }
+
+    void Put(size_t slot, int symbol, int, int) {
+        ++(*frequencies_)[slot][symbol];
+    }
+
+private:
+    std::array<std::array<uint32_t, 256>, 4>* frequencies_;
+};
+
+// Sink that emits the codes with the appended magnitude bits, stuffing a zero byte
+// after every 0xFF.
+class SymbolWriter {
+public:
+    SymbolWriter(const std::array<HuffmanEncoder, 4>& encoders, std::vector<uint8_t>* output)
+        : encoders_(encoders), output_(output) {
+    }
+
+    void Put(size_t slot, int symbol, int value, int size) {
+        const auto& encoder = encoders_[slot];
+        int length = encoder.Length(symbol);
+        if (!length) {
+            throw std::invalid_argument("Symbol is missing from the Huffman table");
+        }
+        if (value < 0) {
+            --value;
+        }
+        Bits(static_cast<uint32_t>(encoder.Code(symbol)) << size | (value & ((1 << size) - 1)),
+             length + size);
+    }
+
+    // Pads the last byte with ones.
+    void Flush() {
+        int padding = (8 - count_ % 8) % 8;
+        accumulator_ = accumulator_ << padding | ((1 << padding) - 1);
+        count_ += padding;
+        while (count_) {
+            count_ -= 8;
+            Byte(accumulator_ >> count_);
+        }
+    }
+
+private:
+    // Bits are emitted 32 at a time, byte by byte only if one of them needs stuffing.
+    void Bits(uint32_t bits, int count) {
+        accumulator_ = accumulator_ << count | bits;
+        count_ += count;
+        if (count_ < 32) {
+            return;
+        }
+        count_ -= 32;
+        uint32_t word = accumulator_ >> count_;
+        uint32_t inverted = ~word;
+        if ((inverted - 0x01010101) & ~inverted & 0x80808080) {
+            for (int shift = 24; shift >= 0; shift -= 8) {
+                Byte(word >> shift);
+            }
+            return;
+        }
+        size_t size = output_->size();
+        output_->resize(size + 4);
+        uint8_t* data = output_->data() + size;
+        data[0] = word >> 24;
+        data[1] = word >> 16;
+        data[2] = word >> 8;
+        data[3] = word;
+    }
+
+    void Byte(uint8_t byte) {
+        output_->push_back(byte);
+        if (byte == 0xFF) {
+            output_->push_back(0);
+        }
+    }
+
+    const std::array<HuffmanEncoder, 4>& encoders_;
+    std::vector<uint8_t>* output_;
+    uint64_t accumulator_ = 0;
+    int count_ = 0;
+};
+
+template <class Sink>
+void EncodeBlock(const int16_t* block, int* predictor, size_t table, Sink& sink) {
+    int diff = block[0] - *predictor;
+    *predictor = block[0];
+    int size = Category(diff);
+    if (size > kMaxDcCategory) {
+        throw std::invalid_argument("DC difference is out of range");
+    }
+    sink.Put(table, size, diff, size);
+
+    // Jumps between the nonzero coefficients, most of a block is usually zeros.
+    uint64_t nonzero = 0;
+    for (size_t k = 1; k < kBlockSize; ++k) {
+        nonzero |= static_cast<uint64_t>(block[k] != 0) << k;
+    }
+    size_t last = 0;
+    while (nonzero) {
+        size_t k = std::countr_zero(nonzero);
+        nonzero &= nonzero - 1;
+        int run = k - last - 1;
+        last = k;
+        for (; run > 15; run -= 16) {
+            sink.Put(kAcSlots + table, kZeroRun, 0, 0);
+        }
+        int value = block[k];
+        size = Category(value);
+        if (size > kMaxAcCategory) {
+            throw std::invalid_argument("AC coefficient is out of range");
+        }
+        sink.Put(kAcSlots + table, run << 4 | size, value, size);
+    }
+    if (last != kBlockSize - 1) {
+        sink.Put(kAcSlots + table, kEndOfBlock, 0, 0);
+    }
+}
+
+// Walks the blocks of the scan of |count| components starting at |first| in the
+// order they are coded.
+template <class Sink>
+void EncodeScan(const FrameCoefficients& frame, size_t first, size_t count, Sink& sink) {
+    std::array<int, kMaxComponents> predictors{};
+    if (count == 1) {
+        const auto& component = frame.components[first];
+        size_t table = HuffmanTable(first);
+        for (size_t row = 0; row < component.height_in_blocks; ++row) {
+            for (size_t col = 0; col < component.width_in_blocks; ++col) {
+                EncodeBlock(component.Block(row, col), &predictors[0], table, sink);
+            }
+        }
+        return;
+    }
+
+    for (size_t mcu_y = 0; mcu_y < frame.mcus_y; ++mcu_y) {
+        for (size_t mcu_x = 0; mcu_x < frame.mcus_x; ++mcu_x) {
+            for (size_t i = first; i < first + count; ++i) {
+                const auto& component = frame.components[i];
+                size_t table = HuffmanTable(i);
+                for (int y = 0; y < component.v; ++y) {
+                    for (int x = 0; x < component.h; ++x) {
+                        EncodeBlock(component.Block(mcu_y * component.v + y,
+                                                    mcu_x * component.h + x),
+                                    &predictors[i], table, sink);
+                    }
+                }
+            }
+        }
+    }
+}
+
+template <class Container>
+void Assign(const Container& source, std::vector<uint8_t>* target) {
+    target->assign(source.begin(), source.end());
+}
+
+}  // namespace
+
+void BaselineWriter::Write(const FrameCoefficients& frame, const std::string& comment,
+                           bool optimize_huffman, std::ostream& output) {
+    CheckFrame(frame);
+    if (comment.size() > 0xFFFF - 2) {
+        throw std::invalid_argument("Comment is too long");
+    }
+
+    bool interleaved = IsInterleaved(frame);
+    size_t scans = interleaved ? 1 : frame.components.size();
+    size_t scan_components = interleaved ? frame.components.size() : 1;
+    size_t tables = frame.components.size() > 1 ? 2 : 1;
+
+    if (optimize_huffman) {
+        for (auto& frequencies : frequencies_) {
+            frequencies.fill(0);
+        }
+        SymbolCounter counter(&frequencies_);
+        for (size_t scan = 0; scan < scans; ++scan) {
+            EncodeScan(frame, interleaved ? 0 : scan, scan_components, counter);
+        }
+        // A grayscale frame has no tables 1, their slots stay empty.
+        for (size_t slot = 0; slot < frequencies_.size(); ++slot) {
+            code_lengths_[slot].clear();
+            values_[slot].clear();
+        }
+        for (size_t table = 0; table < tables; ++table) {
+            for (size_t slot : {table, kAcSlots + table}) {
+                BuildOptimalCode(frequencies_[slot], &code_lengths_[slot], &values_[slot]);
+            }
+        }
+    } else {
+        Assign(kDcLuminanceLengths, &code_lengths_[0]);
+        Assign(kDcValues, &values_[0]);
+        Assign(kDcChrominanceLengths, &code_lengths_[1]);
+        Assign(kDcValues, &values_[1]);
+        Assign(kAcLuminanceLengths, &code_lengths_[kAcSlots]);
+        Assign(kAcLuminanceValues, &values_[kAcSlots]);
+        Assign(kAcChrominanceLengths, &code_lengths_[kAcSlots + 1]);
+        Assign(kAcChrominanceValues, &values_[kAcSlots + 1]);
+    }
+    for (size_t slot = 0; slot < encoders_.size(); ++slot) {
+        encoders_[slot].Build(code_lengths_[slot], values_[slot]);
+    }
+
+    buffer_.clear();
+    WriteHeaders(frame, comment);
+    WriteHuffmanTables(tables);
+    for (size_t scan = 0; scan < scans; ++scan) {
+        WriteScan(frame, interleaved ? 0 : scan, scan_components);
+    }
+    Marker(kEoi);
+
+    output.write(reinterpret_cast<const char*>(buffer_.data()), buffer_.size());
+}
+
+void BaselineWriter::WriteHeaders(const FrameCoefficients& frame, const std::string& comment) {
+    Marker(kSoi);
+
+    Marker(kApp0);
+    Word(16);
+    for (char c : {'J', 'F', 'I', 'F', '\0'}) {
+        Byte(c);
+    }
+    Word(0x0101);  // Version.
+    Byte(0);       // No density units, pixel aspect ratio only.
+    Word(1);
+    Word(1);
+    Byte(0);  // No thumbnail.
+    Byte(0);
+
+    if (!comment.empty()) {
+        Marker(kCom);
+        Word(comment.size() + 2);
+        for (char c : comment) {
+            Byte(c);
+        }
+    }
+
+    // Components with equal quantization share a table.
+    const auto& components = frame.components;
+    std::array<size_t, kMaxComponents> quant_tables{};
+    size_t tables = 0;
+    bool extended = false;
+    for (size_t i = 0; i < components.size(); ++i) {
+        quant_tables[i] = tables;
+        for (size_t j = 0; j < i; ++j) {
+            if (components[j].quant == components[i].quant) {
+                quant_tables[i] = quant_tables[j];
+                break;
+            }
+        }
+        if (quant_tables[i] < tables) {
+            continue;
+        }
+        ++tables;
+
+        bool precise = false;
+        for (auto value : components[i].quant) {
+            precise |= value > 0xFF;
+        }
+        extended |= precise;
+        Marker(kDqt);
+        Word(2 + 1 + kBlockSize * (precise ? 2 : 1));
+        Byte((precise ? 0x10 : 0) | quant_tables[i]);
+        for (auto value : components[i].quant) {
+            if (precise) {
+                Word(value);
+            } else {
+                Byte(value);
+            }
+        }
+    }
+
+    // 16-bit quantization tables are outside of the baseline process.
+    Marker(extended ? kSof1 : kSof0);
+    Word(8 + 3 * components.size());
+    Byte(8);
+    Word(frame.height);
+    Word(frame.width);
+    Byte(components.size());
+    for (size_t i = 0; i < components.size(); ++i) {
+        Byte(components[i].id);
+        Byte(components[i].h << 4 | components[i].v);
+        Byte(quant_tables[i]);
+    }
+}
+
+void BaselineWriter::WriteHuffmanTables(size_t tables) {
+    size_t length = 2;
+    for (size_t table = 0; table < tables; ++table) {
+        for (size_t slot : {table, kAcSlots + table}) {
+            length += 1 + 16 + values_[slot].size();
+        }
+    }
+
+    Marker(kDht);
+    Word(length);
+    for (size_t table = 0; table < tables; ++table) {
+        for (size_t slot : {table, kAcSlots + table}) {
+            Byte((slot >= kAcSlots ? 0x10 : 0) | table);
+            for (size_t i = 0; i < 16; ++i) {
+                Byte(i < code_lengths_[slot].size() ? code_lengths_[slot][i] : 0);
+            }
+            for (auto value : values_[slot]) {
+                Byte(value);
+            }
+        }
+    }
+}
+
+void BaselineWriter::WriteScan(const FrameCoefficients& frame, size_t first, size_t count) {
+    Marker(kSos);
+    Word(6 + 2 * count);
+    Byte(count);
+    for (size_t i = first; i < first + count; ++i) {
+        size_t table = HuffmanTable(i);
+        Byte(frame.components[i].id);
+        Byte(table << 4 | table);
+    }
+    Byte(0);  // Full spectrum, no successive approximation.
+    Byte(kBlockSize - 1);
+    Byte(0);
+
+    SymbolWriter writer(encoders_, &buffer_);
+    EncodeScan(frame, first, count, writer);
+    writer.Flush();
+}
+
+void BaselineWriter::Byte(uint8_t value) {
+    buffer_.push_back(value);
+}
+
+void BaselineWriter::Word(uint16_t value) {
+    buffer_.push_back(value >> 8);
+    buffer_.push_back(value & 0xFF);
+}
+
+void BaselineWriter::Marker(uint8_t marker) {
+    buffer_.push_back(0xFF);
+    buffer_.push_back(marker);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "coefficients.h"
+#include "huffman_encoder.h"
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Entropy codes quantized coefficients into a sequential Huffman JPEG. All components
+// go into one interleaved scan when an MCU fits the 10 blocks limit, otherwise every
+// component gets a scan of its own. Buffers and tables are reused between calls.
+class BaselineWriter {
+public:
+    // Uses the standard tables of Annex K.3 unless |optimize_huffman| is set, then
+    // the tables are built from the symbol statistics in an extra pass over |frame|.
+    // Throws std::invalid_argument if |frame| can't be represented.
+    void Write(const FrameCoefficients& frame, const std::string& comment,
+               bool optimize_huffman, std::ostream& output);
+
+private:
+    void WriteHeaders(const FrameCoefficients& frame, const std::string& comment);
+    void WriteHuffmanTables(size_t slots);
+    void WriteScan(const FrameCoefficients& frame, size_t first, size_t count);
+
+    void Byte(uint8_t value);
+    void Word(uint16_t value);
+    void Marker(uint8_t marker);
+
+    std::vector<uint8_t> buffer_;
+    std::array<std::vector<uint8_t>, 4> code_lengths_;
+    std::array<std::vector<uint8_t>, 4> values_;
+    std::array<HuffmanEncoder, 4> encoders_;
+    std::array<std::array<uint32_t, 256>, 4> frequencies_;
+};
@@ -0,0 +1,162 @@
+#include <encoder.h>
+#include <jpeg_decoder.h>
+#include <transcoder.h>
+
+#include <benchmark/benchmark.h>
+#include <jpeglib.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef HSE_TASK_DIR
+#define HSE_TASK_DIR "./"
+#endif
+
+namespace {
+
+std::string ReadFile(const std::filesystem::path& path) {
+    std::ifstream fin(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>()};
+}
+
+void SetPixelCounters(benchmark::State& state, const Image& image) {
+    double pixels = static_cast<double>(image.Width() * image.Height());
+    state.counters["megapixels"] = pixels / 1e6;
+    state.counters["megapixels_per_second"] =
+        benchmark::Counter(state.iterations() * pixels / 1e6, benchmark::Counter::kIsRate);
+}
+
+// Reports throughput of the whole decoder and the average time of every phase per image.
+void BenchmarkDecode(benchmark::State& state, const std::string& data) {
+    JpegDecoder decoder;
+    Image image;
+    std::istringstream input(data);
+    while (state.KeepRunning()) {
+        input.clear();
+        input.seekg(0);
+        decoder.Decode(input, &image);
+    }
+
+    const auto& stats = decoder.Stats();
+    state.SetBytesProcessed(state.iterations() * data.size());
+    SetPixelCounters(state, image);
+    auto phase = [&state](const char* name, double seconds) {
+        state.counters[name] = benchmark::Counter(seconds * 1e3, benchmark::Counter::kAvgIterations);
+    };
+    phase("parse_ms", stats.parse_seconds);
+    phase("entropy_ms", stats.entropy_seconds);
+    phase("idct_ms", stats.idct_seconds);
+    phase("upsample_ms", stats.upsample_seconds);
+    phase("color_ms", stats.color_seconds);
+}
+
+void BenchmarkEncode(benchmark::State& state, const std::string& data) {
+    std::istringstream input(data);
+    auto image = JpegDecoder().Decode(input);
+    JpegEncoder encoder;
+    std::ostringstream output;
+    while (state.KeepRunning()) {
+        output.str({});
+        encoder.Encode(image, output);
+    }
+    state.counters["output_bytes"] = output.str().size();
+    SetPixelCounters(state, image);
+}
+
+// Lossless rotation, stays in the DCT domain.
+void BenchmarkTranscode(benchmark::State& state, const std::string& data) {
+    JpegTranscoder transcoder;
+    TranscodeOptions options;
+    options.transform = Transform::kRotate90;
+    std::istringstream input(data);
+    std::ostringstream output;
+    while (state.KeepRunning()) {
+        input.clear();
+        input.seekg(0);
+        output.str({});
+        transcoder.Transcode(input, options, output);
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+    input.clear();
+    input.seekg(0);
+    SetPixelCounters(state, JpegDecoder().Decode(input));
+}
+
+// libjpeg with the same settings: quality 75, 4:2:0, the integer AAN DCT, standard tables.
+void BenchmarkLibjpegEncode(benchmark::State& state, const std::string& data) {
+    std::istringstream input(data);
+    auto image = JpegDecoder().Decode(input);
+    std::vector<JSAMPLE> pixels(image.Width() * image.Height() * 3);
+    for (size_t y = 0; y < image.Height(); ++y) {
+        for (size_t x = 0; x < image.Width(); ++x) {
+            auto pixel = image.GetPixel(y, x);
+            auto* output = &pixels[(y * image.Width() + x) * 3];
+            output[0] = pixel.r;
+            output[1] = pixel.g;
+            output[2] = pixel.b;
+        }
+    }
+
+    unsigned long size = 0;
+    while (state.KeepRunning()) {
+        jpeg_compress_struct info;
+        jpeg_error_mgr errors;
+        info.err = jpeg_std_error(&errors);
+        jpeg_create_compress(&info);
+        unsigned char* buffer = nullptr;
+        size = 0;
+        jpeg_mem_dest(&info, &buffer, &size);
+        info.image_width = image.Width();
+        info.image_height = image.Height();
+        info.input_components = 3;
+        info.in_color_space = JCS_RGB;
+        jpeg_set_defaults(&info);
+        jpeg_set_quality(&info, 75, TRUE);
+        info.dct_method = JDCT_IFAST;
+        jpeg_start_compress(&info, TRUE);
+        while (info.next_scanline < info.image_height) {
+            JSAMPROW row = &pixels[info.next_scanline * image.Width() * 3];
+            jpeg_write_scanlines(&info, &row, 1);
+        }
+        jpeg_finish_compress(&info);
+        jpeg_destroy_compress(&info);
+        std::free(buffer);
+    }
+    state.counters["output_bytes"] = size;
+    SetPixelCounters(state, image);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::vector<std::filesystem::path> corpus;
+    for (const auto& entry : std::filesystem::directory_iterator(HSE_TASK_DIR "tests")) {
+        if (entry.is_regular_file() && entry.path().extension() == ".jpg") {
+            corpus.push_back(entry.path());
+        }
+    }
+    std::sort(corpus.begin(), corpus.end());
+
+    for (const auto& path : corpus) {
+        auto data = ReadFile(path);
+        auto name = path.filename().string();
+        benchmark::RegisterBenchmark(("Decode/" + name).c_str(), BenchmarkDecode, data)
+            ->Unit(benchmark::kMillisecond);
+        benchmark::RegisterBenchmark(("Encode/" + name).c_str(), BenchmarkEncode, data)
+            ->Unit(benchmark::kMillisecond);
+        benchmark::RegisterBenchmark(("Transcode/" + name).c_str(), BenchmarkTranscode, data)
+            ->Unit(benchmark::kMillisecond);
+        benchmark::RegisterBenchmark(("LibjpegEncode/" + name).c_str(), BenchmarkLibjpegEncode,
+                                     data)
+            ->Unit(benchmark::kMillisecond);
+    }
+
+    benchmark::Initialize(&argc, argv);
+    benchmark::RunSpecifiedBenchmarks();
+}
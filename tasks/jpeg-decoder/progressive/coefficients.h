@@ -0,0 +1,83 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+const size_t kBlockSide = 8;
+const size_t kBlockSize = kBlockSide * kBlockSide;
+const size_t kMaxComponents = 4;
+
+// kZigzag[k] is the row-major position of the k-th coefficient in zigzag order.
+constexpr std::array<uint8_t, kBlockSize> kZigzag = {
+    0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,  12, 19, 26, 33, 40, 48,
+    41, 34, 27, 20, 13, 6,  7,  14, 21, 28, 35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23,
+    30, 37, 44, 51, 58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63};
+
+using QuantTable = std::array<uint16_t, kBlockSize>;
+
+// Quantized DCT coefficients of one component, allocated once per frame.
+// Blocks go row by row and every block is 64 consecutive int16 in zigzag order
+// (the order they arrive in), so a spectral band [Ss, Se] refined by a progressive
+// scan is a contiguous range and a scan walks the storage strictly forward.
+struct ComponentCoefficients {
+    int id = 0;
+    int h = 1;
+    int v = 1;
+    int quant_table_id = 0;
+    // Latched at the first scan of the component, zigzag order.
+    QuantTable quant{};
+
+    // Blocks covering the component samples, non-interleaved scans visit only them.
+    size_t width_in_blocks = 0;
+    size_t height_in_blocks = 0;
+    // The grid padded to whole MCUs, interleaved scans fill it completely.
+    size_t stride_in_blocks = 0;
+    size_t padded_height_in_blocks = 0;
+
+    std::vector<int16_t> data;
+
+    int16_t* Block(size_t row, size_t col) {
+        return data.data() + (row * stride_in_blocks + col) * kBlockSize;
+    }
+
+    const int16_t* Block(size_t row, size_t col) const {
+        return data.data() + (row * stride_in_blocks + col) * kBlockSize;
+    }
+};
+
+struct FrameCoefficients {
+    size_t width = 0;
+    size_t height = 0;
+    bool progressive = false;
+    int max_h = 1;
+    int max_v = 1;
+    size_t mcus_x = 0;
+    size_t mcus_y = 0;
+    std::vector<ComponentCoefficients> components;
+
+    // Computes the block grids from the size and the sampling factors of the
+    // components and zeroes the coefficients, keeping their storage.
+    void Layout() {
+        auto ceil_div = [](size_t value, size_t divisor) { return (value + divisor - 1) / divisor; };
+        max_h = max_v = 1;
+        for (const auto& component : components) {
+            max_h = std::max(max_h, component.h);
+            max_v = std::max(max_v, component.v);
+        }
+        mcus_x = ceil_div(width, kBlockSide * max_h);
+        mcus_y = ceil_div(height, kBlockSide * max_v);
+        for (auto& component : components) {
+            size_t component_width = ceil_div(width * component.h, max_h);
+            size_t component_height = ceil_div(height * component.v, max_v);
+            component.width_in_blocks = ceil_div(component_width, kBlockSide);
+            component.height_in_blocks = ceil_div(component_height, kBlockSide);
+            component.stride_in_blocks = mcus_x * component.h;
+            component.padded_height_in_blocks = mcus_y * component.v;
+            component.data.assign(
+                component.stride_in_blocks * component.padded_height_in_blocks * kBlockSize, 0);
+        }
+    }
+};
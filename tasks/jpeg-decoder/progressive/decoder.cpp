@@ -1,7 +1,8 @@
 #include <decoder.h>
 
-Image Decode(std::istream& input) {
-    (void)input;
+#include "jpeg_decoder.h"
 
-    return {};
+Image Decode(std::istream& input) {
+    JpegDecoder decoder;
+    return decoder.Decode(input);
 }
@@ -0,0 +1,310 @@
+#include "encoder.h"
+
+#include "baseline_writer.h"
+#include "coefficients.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+// Example tables of Annex K.1 in row-major order.
+const QuantTable kLuminanceQuant = {
+    16, 11, 10, 16, 24,  40,  51,  61,  12, 12, 14, 19, 26,  58,  60,  55,
+    14, 13, 16, 24, 40,  57,  69,  56,  14, 17, 22, 29, 51,  87,  80,  62,
+    18, 22, 37, 56, 68,  109, 103, 77,  24, 35, 55, 64, 81,  104, 113, 92,
+    49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99};
+const QuantTable kChrominanceQuant = {
+    17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99, 24, 26, 56, 99, 99, 99,
+    99, 99, 47, 66, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99};
+
+// The AAN transform leaves every output scaled by 8 * kAanScale[u] * kAanScale[v],
+// kAanScale[k] = cos(k * pi / 16) * sqrt(2) for k > 0. The scale is folded into the
+// quantization.
+const std::array<float, kBlockSide> kAanScale = {1.0f,         1.387039845f, 1.306562965f,
+                                                 1.175875602f, 1.0f,         0.785694958f,
+                                                 0.541196100f, 0.275899379f};
+
+// Fixed-point constants of the AAN transform with 8 fractional bits.
+const int kConstBits = 8;
+const int kFix0382683433 = 98;
+const int kFix0541196100 = 139;
+const int kFix0707106781 = 181;
+const int kFix1306562965 = 334;
+
+const int kColorBits = 16;
+const int kColorHalf = 1 << (kColorBits - 1);
+const int kChromaOffset = 128 << kColorBits;
+
+// Keeps the DC differences and the AC values within the baseline categories.
+const int kMaxCoefficient = 1023;
+
+int Multiply(int value, int constant) {
+    return (value * constant) >> kConstBits;
+}
+
+// One dimensional AAN forward DCT of 8 values |kStep| apart, unnormalized.
+template <size_t kStep>
+void Dct8(int* data) {
+    const size_t step = kStep;
+    int tmp0 = data[0] + data[7 * step];
+    int tmp7 = data[0] - data[7 * step];
+    int tmp1 = data[step] + data[6 * step];
+    int tmp6 = data[step] - data[6 * step];
+    int tmp2 = data[2 * step] + data[5 * step];
+    int tmp5 = data[2 * step] - data[5 * step];
+    int tmp3 = data[3 * step] + data[4 * step];
+    int tmp4 = data[3 * step] - data[4 * step];
+
+    // Even part.
+    int tmp10 = tmp0 + tmp3;
+    int tmp13 = tmp0 - tmp3;
+    int tmp11 = tmp1 + tmp2;
+    int tmp12 = tmp1 - tmp2;
+
+    data[0] = tmp10 + tmp11;
+    data[4 * step] = tmp10 - tmp11;
+
+    int z1 = Multiply(tmp12 + tmp13, kFix0707106781);
+    data[2 * step] = tmp13 + z1;
+    data[6 * step] = tmp13 - z1;
+
+    // Odd part.
+    tmp10 = tmp4 + tmp5;
+    tmp11 = tmp5 + tmp6;
+    tmp12 = tmp6 + tmp7;
+
+    int z5 = Multiply(tmp10 - tmp12, kFix0382683433);
+    int z2 = Multiply(tmp10, kFix0541196100) + z5;
+    int z4 = Multiply(tmp12, kFix1306562965) + z5;
+    int z3 = Multiply(tmp11, kFix0707106781);
+
+    int z11 = tmp7 + z3;
+    int z13 = tmp7 - z3;
+
+    data[5 * step] = z13 + z2;
+    data[3 * step] = z13 - z2;
+    data[step] = z11 + z4;
+    data[7 * step] = z11 - z4;
+}
+
+int ClampSample(int value) {
+    return std::clamp(value, 0, 255);
+}
+
+uint8_t Luma(int r, int g, int b) {
+    return (19595 * r + 38470 * g + 7471 * b + kColorHalf) >> kColorBits;
+}
+
+// IJG scaling of a base table, clamped to 8-bit steps to stay baseline.
+QuantTable ScaleQuant(const QuantTable& base, int quality) {
+    int scale = quality < 50 ? 5000 / quality : 200 - 2 * quality;
+    QuantTable result;
+    for (size_t k = 0; k < kBlockSize; ++k) {
+        result[k] = std::clamp((base[kZigzag[k]] * scale + 50) / 100, 1, 255);
+    }
+    return result;
+}
+
+}  // namespace
+
+class JpegEncoder::Impl {
+public:
+    explicit Impl(const EncoderOptions& options) : options_(options) {
+        if (options.quality < 1 || options.quality > 100) {
+            throw std::invalid_argument("Quality must be in [1, 100]");
+        }
+        quant_[0] = ScaleQuant(kLuminanceQuant, options.quality);
+        quant_[1] = ScaleQuant(kChrominanceQuant, options.quality);
+        for (size_t table = 0; table < quant_.size(); ++table) {
+            for (size_t k = 0; k < kBlockSize; ++k) {
+                size_t position = kZigzag[k];
+                reciprocals_[table][position] =
+                    1.0f / (quant_[table][k] * kAanScale[position / kBlockSide] *
+                            kAanScale[position % kBlockSide] * 8);
+            }
+        }
+    }
+
+    void Encode(const Image& image, std::ostream& output) {
+        if (!image.Width() || !image.Height() || image.Width() > 0xFFFF ||
+            image.Height() > 0xFFFF) {
+            throw std::invalid_argument("Image size is out of range");
+        }
+        SetupFrame(image.Width(), image.Height());
+        ConvertColor(image);
+        for (size_t i = 0; i < frame_.components.size(); ++i) {
+            auto& component = frame_.components[i];
+            const auto* plane = &planes_[i];
+            if (component.h != frame_.max_h || component.v != frame_.max_v) {
+                Downsample(component, *plane, &downsampled_);
+                plane = &downsampled_;
+            }
+            TransformComponent(*plane, reciprocals_[i ? 1 : 0], &component);
+        }
+        writer_.Write(frame_, image.GetComment(), options_.optimize_huffman, output);
+    }
+
+private:
+    void SetupFrame(size_t width, size_t height) {
+        frame_.width = width;
+        frame_.height = height;
+        frame_.components.resize(options_.grayscale ? 1 : 3);
+        for (size_t i = 0; i < frame_.components.size(); ++i) {
+            auto& component = frame_.components[i];
+            component.id = i + 1;
+            component.h = component.v = 1;
+            component.quant_table_id = i ? 1 : 0;
+            component.quant = quant_[component.quant_table_id];
+        }
+        if (!options_.grayscale && options_.subsampling != Subsampling::k444) {
+            frame_.components[0].h = 2;
+            frame_.components[0].v = options_.subsampling == Subsampling::k420 ? 2 : 1;
+        }
+        frame_.Layout();
+        padded_width_ = frame_.mcus_x * kBlockSide * frame_.max_h;
+        padded_height_ = frame_.mcus_y * kBlockSide * frame_.max_v;
+    }
+
+    // Fixed-point RGB to YCbCr into planes padded to whole MCUs by replicating the
+    // last column and row.
+    void ConvertColor(const Image& image) {
+        size_t count = frame_.components.size();
+        for (size_t i = 0; i < count; ++i) {
+            planes_[i].resize(padded_width_ * padded_height_);
+        }
+        size_t width = image.Width();
+        size_t height = image.Height();
+        for (size_t y = 0; y < height; ++y) {
+            uint8_t* luma = planes_[0].data() + y * padded_width_;
+            if (count == 1) {
+                for (size_t x = 0; x < width; ++x) {
+                    auto pixel = image.GetPixel(y, x);
+                    luma[x] = Luma(ClampSample(pixel.r), ClampSample(pixel.g),
+                                   ClampSample(pixel.b));
+                }
+                continue;
+            }
+            uint8_t* cb = planes_[1].data() + y * padded_width_;
+            uint8_t* cr = planes_[2].data() + y * padded_width_;
+            for (size_t x = 0; x < width; ++x) {
+                auto pixel = image.GetPixel(y, x);
+                int r = ClampSample(pixel.r);
+                int g = ClampSample(pixel.g);
+                int b = ClampSample(pixel.b);
+                luma[x] = Luma(r, g, b);
+                cb[x] = (-11059 * r - 21709 * g + 32768 * b + kChromaOffset + kColorHalf - 1) >>
+                        kColorBits;
+                cr[x] = (32768 * r - 27439 * g - 5329 * b + kChromaOffset + kColorHalf - 1) >>
+                        kColorBits;
+            }
+        }
+        for (size_t i = 0; i < count; ++i) {
+            auto& plane = planes_[i];
+            for (size_t y = 0; y < height; ++y) {
+                auto row = plane.begin() + y * padded_width_;
+                std::fill(row + width, row + padded_width_, row[width - 1]);
+            }
+            auto last = plane.begin() + (height - 1) * padded_width_;
+            for (size_t y = height; y < padded_height_; ++y) {
+                std::copy(last, last + padded_width_, plane.begin() + y * padded_width_);
+            }
+        }
+    }
+
+    // Box filter down to the component resolution, only 2x1 and 2x2 are produced.
+    void Downsample(const ComponentCoefficients& component, const std::vector<uint8_t>& plane,
+                    std::vector<uint8_t>* output) {
+        if (frame_.max_v / component.v == 2) {
+            DownsampleBox<2>(plane, output);
+        } else {
+            DownsampleBox<1>(plane, output);
+        }
+    }
+
+    template <size_t kStepY>
+    void DownsampleBox(const std::vector<uint8_t>& plane, std::vector<uint8_t>* output) {
+        const size_t area = 2 * kStepY;
+        size_t width = padded_width_ / 2;
+        size_t height = padded_height_ / kStepY;
+        output->resize(width * height);
+        for (size_t y = 0; y < height; ++y) {
+            const uint8_t* top = plane.data() + y * kStepY * padded_width_;
+            const uint8_t* bottom = top + (kStepY - 1) * padded_width_;
+            uint8_t* row = output->data() + y * width;
+            for (size_t x = 0; x < width; ++x) {
+                int sum = top[2 * x] + top[2 * x + 1];
+                if (kStepY == 2) {
+                    sum += bottom[2 * x] + bottom[2 * x + 1];
+                }
+                row[x] = (sum + area / 2) / area;
+            }
+        }
+    }
+
+    void TransformComponent(const std::vector<uint8_t>& plane,
+                            const std::array<float, kBlockSize>& reciprocals,
+                            ComponentCoefficients* component) {
+        size_t stride = component->stride_in_blocks * kBlockSide;
+        std::array<int, kBlockSize> block;
+        for (size_t row = 0; row < component->padded_height_in_blocks; ++row) {
+            for (size_t col = 0; col < component->stride_in_blocks; ++col) {
+                const uint8_t* samples = plane.data() + row * kBlockSide * stride + col * kBlockSide;
+                for (size_t y = 0; y < kBlockSide; ++y) {
+                    for (size_t x = 0; x < kBlockSide; ++x) {
+                        block[y * kBlockSide + x] = samples[y * stride + x] - 128;
+                    }
+                }
+                for (size_t y = 0; y < kBlockSide; ++y) {
+                    Dct8<1>(block.data() + y * kBlockSide);
+                }
+                for (size_t x = 0; x < kBlockSide; ++x) {
+                    Dct8<kBlockSide>(block.data() + x);
+                }
+                Quantize(block, reciprocals, component->Block(row, col));
+            }
+        }
+    }
+
+    // Quantizes in place in row-major order, which vectorizes, and only then reorders
+    // the coefficients into zigzag.
+    static void Quantize(std::array<int, kBlockSize>& block,
+                         const std::array<float, kBlockSize>& reciprocals, int16_t* output) {
+        for (size_t i = 0; i < kBlockSize; ++i) {
+            float value = block[i] * reciprocals[i];
+            int rounded = static_cast<int>(value + std::copysign(0.5f, value));
+            block[i] = std::clamp(rounded, -kMaxCoefficient, kMaxCoefficient);
+        }
+        for (size_t k = 0; k < kBlockSize; ++k) {
+            output[k] = block[kZigzag[k]];
+        }
+    }
+
+    EncoderOptions options_;
+    std::array<QuantTable, 2> quant_;
+    std::array<std::array<float, kBlockSize>, 2> reciprocals_;
+
+    FrameCoefficients frame_;
+    size_t padded_width_ = 0;
+    size_t padded_height_ = 0;
+    std::array<std::vector<uint8_t>, 3> planes_;
+    std::vector<uint8_t> downsampled_;
+    BaselineWriter writer_;
+};
+
+JpegEncoder::JpegEncoder(const EncoderOptions& options)
+    : impl_(std::make_unique<Impl>(options)) {
+}
+
+void JpegEncoder::Encode(const Image& image, std::ostream& output) {
+    impl_->Encode(image, output);
+}
+
+JpegEncoder::JpegEncoder(JpegEncoder&&) = default;
+
+JpegEncoder& JpegEncoder::operator=(JpegEncoder&&) = default;
+
+JpegEncoder::~JpegEncoder() = default;
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <image.h>
+
+#include <memory>
+#include <ostream>
+
+enum class Subsampling { k444, k422, k420 };
+
+struct EncoderOptions {
+    // IJG quality scale of the Annex K tables, from 1 to 100.
+    int quality = 75;
+    Subsampling subsampling = Subsampling::k420;
+    bool grayscale = false;
+    // Builds Huffman tables for the image instead of the standard ones: the output
+    // is a few percent smaller, the entropy coding pass runs twice.
+    bool optimize_huffman = false;
+};
+
+// Baseline JPEG encoder with the integer AAN forward DCT. Color conversion planes,
+// coefficients and the output buffer are kept between calls.
+class JpegEncoder {
+public:
+    explicit JpegEncoder(const EncoderOptions& options = {});
+
+    JpegEncoder(const JpegEncoder&) = delete;
+    JpegEncoder& operator=(const JpegEncoder&) = delete;
+
+    JpegEncoder(JpegEncoder&&);
+    JpegEncoder& operator=(JpegEncoder&&);
+
+    // Writes |image| with its comment. Throws std::invalid_argument on an empty image
+    // or one larger than 65535 pixels in any dimension.
+    void Encode(const Image& image, std::ostream& output);
+
+    ~JpegEncoder();
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
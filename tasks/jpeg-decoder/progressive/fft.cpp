@@ -2,16 +2,69 @@
 
 #include <fftw3.h>
 
-class DctCalculator::Impl {};
+#include <cmath>
+#include <stdexcept>
 
-DctCalculator::DctCalculator(size_t width, std::vector<double> *input, std::vector<double> *output)
-    : impl_() {
-    (void)width;
-    (void)input;
-    (void)output;
+// JPEG IDCT through FFTW's DCT-III (REDFT01). REDFT01 lacks the 1/sqrt(2) weight of
+// the zero frequency and is scaled by 2 per dimension, so the input is prescaled and
+// the output is normalized by 1 / (2 * width).
+class DctCalculator::Impl {
+public:
+    Impl(size_t width, std::vector<double>* input, std::vector<double>* output)
+        : width_(width), input_(input), output_(output) {
+        if (!width || !input || !output || input->size() != width * width ||
+            output->size() != width * width) {
+            throw std::invalid_argument("DctCalculator expects width * width matrices");
+        }
+        in_.resize(width * width);
+        out_.resize(width * width);
+        plan_ = fftw_plan_r2r_2d(width, width, in_.data(), out_.data(), FFTW_REDFT01,
+                                 FFTW_REDFT01, FFTW_ESTIMATE);
+    }
+
+    Impl(const Impl&) = delete;
+    Impl& operator=(const Impl&) = delete;
+
+    void Inverse() {
+        const double sqrt2 = std::sqrt(2.0);
+        const auto& input = *input_;
+        for (size_t i = 0; i < width_ * width_; ++i) {
+            in_[i] = input[i];
+        }
+        for (size_t i = 0; i < width_; ++i) {
+            in_[i] *= sqrt2;
+            in_[i * width_] *= sqrt2;
+        }
+
+        fftw_execute(plan_);
+
+        const double norm = 1.0 / (2 * width_);
+        auto& output = *output_;
+        for (size_t i = 0; i < width_ * width_; ++i) {
+            output[i] = out_[i] * norm;
+        }
+    }
+
+    ~Impl() {
+        fftw_destroy_plan(plan_);
+    }
+
+private:
+    size_t width_;
+    std::vector<double>* input_;
+    std::vector<double>* output_;
+    std::vector<double> in_;
+    std::vector<double> out_;
+    fftw_plan plan_;
+};
+
+DctCalculator::DctCalculator(size_t width, std::vector<double>* input,
+                             std::vector<double>* output)
+    : impl_(std::make_unique<Impl>(width, input, output)) {
 }
 
 void DctCalculator::Inverse() {
+    impl_->Inverse();
 }
 
 DctCalculator::~DctCalculator() = default;
@@ -1,24 +1,101 @@
 #include <huffman.h>
 
-class HuffmanTree::Impl {};
+#include <algorithm>
+#include <array>
+#include <stdexcept>
 
-HuffmanTree::HuffmanTree() = default;
+namespace {
 
-void HuffmanTree::Build(const std::vector<uint8_t> &code_lengths,
-                        const std::vector<uint8_t> &values) {
-    (void)code_lengths;
-    (void)values;
+const size_t kMaxCodeLength = 16;
+const size_t kMaxCodesCount = kMaxCodeLength * 256;
+
+}  // namespace
+
+// Canonical Huffman code: codes of every length are consecutive integers, so the
+// tree is never materialized. A path of |length_| bits is a leaf iff it falls into
+// [first_code_[length_], first_code_[length_] + count_[length_]).
+class HuffmanTree::Impl {
+public:
+    void Build(const std::vector<uint8_t>& code_lengths, const std::vector<uint8_t>& values) {
+        if (code_lengths.size() > kMaxCodeLength) {
+            throw std::invalid_argument("Huffman code is longer than 16 bits");
+        }
+
+        size_t total = 0;
+        int available = 1;
+        int code = 0;
+        max_length_ = 0;
+        for (size_t length = 1; length <= kMaxCodeLength; ++length) {
+            int count = length <= code_lengths.size() ? code_lengths[length - 1] : 0;
+            available *= 2;
+            if (count > available) {
+                throw std::invalid_argument("Too many Huffman codes of the same length");
+            }
+            available -= count;
+
+            first_code_[length] = code;
+            count_[length] = count;
+            offset_[length] = total;
+            total += count;
+            code = (code + count) * 2;
+            if (count) {
+                max_length_ = length;
+            }
+        }
+
+        if (values.size() != total) {
+            throw std::invalid_argument("Huffman values count mismatches code lengths");
+        }
+        std::copy(values.begin(), values.end(), values_.begin());
+        Reset();
+    }
+
+    bool Move(bool bit, int& value) {
+        code_ = code_ * 2 + bit;
+        ++length_;
+        if (length_ > max_length_) {
+            Reset();
+            throw std::invalid_argument("No Huffman code matches the input");
+        }
+        unsigned index = code_ - first_code_[length_];
+        if (index < count_[length_]) {
+            value = values_[offset_[length_] + index];
+            Reset();
+            return true;
+        }
+        return false;
+    }
+
+private:
+    void Reset() {
+        code_ = 0;
+        length_ = 0;
+    }
+
+    std::array<int, kMaxCodeLength + 1> first_code_{};
+    std::array<unsigned, kMaxCodeLength + 1> count_{};
+    std::array<size_t, kMaxCodeLength + 1> offset_{};
+    std::array<uint8_t, kMaxCodesCount> values_{};
+    size_t max_length_ = 0;
+
+    int code_ = 0;
+    size_t length_ = 0;
+};
+
+HuffmanTree::HuffmanTree() : impl_(std::make_unique<Impl>()) {
 }
 
-bool HuffmanTree::Move(bool bit, int &value) {
-    (void)bit;
-    (void)value;
+void HuffmanTree::Build(const std::vector<uint8_t>& code_lengths,
+                        const std::vector<uint8_t>& values) {
+    impl_->Build(code_lengths, values);
+}
 
-    return true;
+bool HuffmanTree::Move(bool bit, int& value) {
+    return impl_->Move(bit, value);
 }
 
-HuffmanTree::HuffmanTree(HuffmanTree &&) = default;
+HuffmanTree::HuffmanTree(HuffmanTree&&) = default;
 
-HuffmanTree &HuffmanTree::operator=(HuffmanTree &&) = default;
+HuffmanTree& HuffmanTree::operator=(HuffmanTree&&) = default;
 
 HuffmanTree::~HuffmanTree() = default;
@@ -0,0 +1,124 @@
+#include "huffman_encoder.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+const size_t kMaxCodeLength = 16;
+// The optimal code before length limiting can be as long as the number of symbols.
+const size_t kMaxUnlimitedLength = 32;
+
+}  // namespace
+
+void HuffmanEncoder::Build(const std::vector<uint8_t>& code_lengths,
+                           const std::vector<uint8_t>& values) {
+    if (code_lengths.size() > kMaxCodeLength) {
+        throw std::invalid_argument("Huffman code is longer than 16 bits");
+    }
+    lengths_.fill(0);
+
+    size_t index = 0;
+    int code = 0;
+    for (size_t length = 1; length <= code_lengths.size(); ++length) {
+        for (int i = 0; i < code_lengths[length - 1]; ++i, ++index, ++code) {
+            if (index >= values.size() || code >= (1 << length)) {
+                throw std::invalid_argument("Invalid Huffman code description");
+            }
+            codes_[values[index]] = code;
+            lengths_[values[index]] = length;
+        }
+        code *= 2;
+    }
+}
+
+void BuildOptimalCode(const std::array<uint32_t, 256>& frequencies,
+                      std::vector<uint8_t>* code_lengths, std::vector<uint8_t>* values) {
+    // Symbol 256 is reserved with the least frequency, its codeword is the all-ones
+    // one and is dropped at the end.
+    const int symbols = 257;
+    std::array<uint64_t, symbols> frequency;
+    std::array<int, symbols> code_size{};
+    std::array<int, symbols> others;
+    std::copy(frequencies.begin(), frequencies.end(), frequency.begin());
+    frequency[256] = 1;
+    others.fill(-1);
+
+    // Huffman's procedure, merging the two least frequent trees; the trees are kept as
+    // chains in |others| and every merge lengthens the codes of both chains.
+    while (true) {
+        int first = -1;
+        int second = -1;
+        for (int i = 0; i < symbols; ++i) {
+            if (!frequency[i]) {
+                continue;
+            }
+            if (first < 0 || frequency[i] <= frequency[first]) {
+                second = first;
+                first = i;
+            } else if (second < 0 || frequency[i] <= frequency[second]) {
+                second = i;
+            }
+        }
+        if (second < 0) {
+            break;
+        }
+
+        frequency[first] += frequency[second];
+        frequency[second] = 0;
+        ++code_size[first];
+        while (others[first] >= 0) {
+            first = others[first];
+            ++code_size[first];
+        }
+        others[first] = second;
+        ++code_size[second];
+        while (others[second] >= 0) {
+            second = others[second];
+            ++code_size[second];
+        }
+    }
+
+    std::array<int, kMaxUnlimitedLength + 1> bits{};
+    for (int i = 0; i < symbols; ++i) {
+        if (code_size[i]) {
+            if (static_cast<size_t>(code_size[i]) > kMaxUnlimitedLength) {
+                throw std::runtime_error("Huffman code is too long");
+            }
+            ++bits[code_size[i]];
+        }
+    }
+
+    // Limits the lengths to 16 bits: a pair of the longest codes is replaced by one
+    // shorter code and a leaf from an upper level becomes a node (K.2, figure K.3).
+    for (size_t length = kMaxUnlimitedLength; length > kMaxCodeLength; --length) {
+        while (bits[length] > 0) {
+            size_t shorter = length - 2;
+            while (!bits[shorter]) {
+                --shorter;
+            }
+            bits[length] -= 2;
+            ++bits[length - 1];
+            bits[shorter + 1] += 2;
+            --bits[shorter];
+        }
+    }
+    // Drops the all-ones codeword; a code of no symbols has none, nor any other.
+    size_t longest = kMaxCodeLength;
+    while (longest > 0 && !bits[longest]) {
+        --longest;
+    }
+    if (longest > 0) {
+        --bits[longest];
+    }
+
+    code_lengths->assign(bits.begin() + 1, bits.begin() + kMaxCodeLength + 1);
+    values->clear();
+    for (size_t length = 1; length <= kMaxUnlimitedLength; ++length) {
+        for (int i = 0; i < 256; ++i) {
+            if (static_cast<size_t>(code_size[i]) == length) {
+                values->push_back(i);
+            }
+        }
+    }
+}
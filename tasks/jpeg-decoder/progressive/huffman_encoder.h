@@ -0,0 +1,30 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// Code table of a canonical Huffman code, the encoding counterpart of HuffmanTree.
+class HuffmanEncoder {
+public:
+    // Takes the code description in the same DHT format as HuffmanTree::Build.
+    void Build(const std::vector<uint8_t>& code_lengths, const std::vector<uint8_t>& values);
+
+    uint16_t Code(uint8_t symbol) const {
+        return codes_[symbol];
+    }
+
+    // Zero for symbols the code doesn't contain.
+    int Length(uint8_t symbol) const {
+        return lengths_[symbol];
+    }
+
+private:
+    std::array<uint16_t, 256> codes_{};
+    std::array<uint8_t, 256> lengths_{};
+};
+
+// Builds an optimal code for the symbol frequencies with lengths limited to 16 bits and
+// no all-ones codeword (JPEG Annex K.2). The result is in the DHT format.
+void BuildOptimalCode(const std::array<uint32_t, 256>& frequencies,
+                      std::vector<uint8_t>* code_lengths, std::vector<uint8_t>* values);
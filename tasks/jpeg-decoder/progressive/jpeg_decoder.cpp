@@ -0,0 +1,47 @@
+#include "jpeg_decoder.h"
+
+#include <stdexcept>
+
+namespace {
+
+const size_t kChunkSize = 1 << 16;
+
+}  // namespace
+
+JpegDecoder::JpegDecoder() : chunk_(kChunkSize) {
+}
+
+void JpegDecoder::Decode(std::istream& input, Image* image) {
+    Consume(input);
+    decoder_.Render(image);
+}
+
+Image JpegDecoder::Decode(std::istream& input) {
+    Image image;
+    Decode(input, &image);
+    return image;
+}
+
+const FrameCoefficients& JpegDecoder::DecodeCoefficients(std::istream& input) {
+    Consume(input);
+    return decoder_.Coefficients();
+}
+
+const std::string& JpegDecoder::Comment() const {
+    return decoder_.Comment();
+}
+
+const DecodeStats& JpegDecoder::Stats() const {
+    return decoder_.Stats();
+}
+
+void JpegDecoder::Consume(std::istream& input) {
+    decoder_.Reset();
+    while (!decoder_.IsFinished() && input) {
+        input.read(chunk_.data(), chunk_.size());
+        decoder_.Feed(reinterpret_cast<const uint8_t*>(chunk_.data()), input.gcount());
+    }
+    if (!decoder_.IsFinished()) {
+        throw std::runtime_error("Unexpected end of file");
+    }
+}
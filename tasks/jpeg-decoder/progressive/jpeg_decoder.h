@@ -0,0 +1,37 @@
+#pragma once
+
+#include "progressive_decoder.h"
+
+#include <image.h>
+
+#include <istream>
+#include <string>
+#include <vector>
+
+// Decoder for a sequence of files. The read buffer, coefficient store, component
+// planes, Huffman tables and the DCT plan survive between calls and only grow, so
+// once they fit the images (and the output image is reused) decoding doesn't allocate.
+class JpegDecoder {
+public:
+    JpegDecoder();
+
+    // Decodes the whole |input| into |image|, reusing its storage.
+    void Decode(std::istream& input, Image* image);
+
+    Image Decode(std::istream& input);
+
+    // Only entropy decodes |input|, skipping the IDCT and color conversion. The
+    // coefficients stay valid until the next call.
+    const FrameCoefficients& DecodeCoefficients(std::istream& input);
+
+    // Comment of the last decoded file.
+    const std::string& Comment() const;
+
+    const DecodeStats& Stats() const;
+
+private:
+    void Consume(std::istream& input);
+
+    ProgressiveDecoder decoder_;
+    std::vector<char> chunk_;
+};
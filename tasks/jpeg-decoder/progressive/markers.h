@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+
+// JPEG marker codes, the byte after 0xFF.
+const uint8_t kSof0 = 0xC0;
+const uint8_t kSof1 = 0xC1;
+const uint8_t kSof2 = 0xC2;
+const uint8_t kDht = 0xC4;
+const uint8_t kRst0 = 0xD0;
+const uint8_t kRst7 = 0xD7;
+const uint8_t kSoi = 0xD8;
+const uint8_t kEoi = 0xD9;
+const uint8_t kSos = 0xDA;
+const uint8_t kDqt = 0xDB;
+const uint8_t kDri = 0xDD;
+const uint8_t kApp0 = 0xE0;
+const uint8_t kApp15 = 0xEF;
+const uint8_t kCom = 0xFE;
+const uint8_t kTem = 0x01;
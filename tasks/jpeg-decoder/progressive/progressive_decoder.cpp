@@ -0,0 +1,878 @@
+#include "progressive_decoder.h"
+
+#include "coefficients.h"
+#include "markers.h"
+
+#include <fft.h>
+#include <huffman.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+const size_t kTablesCount = 4;
+const int kMaxDcCategory = 11;
+const int kMaxAcCategory = 10;
+const int kMaxSuccessiveBit = 13;
+
+bool IsRestart(uint8_t marker) {
+    return marker >= kRst0 && marker <= kRst7;
+}
+
+uint8_t Clamp(int value) {
+    return std::clamp(value, 0, 255);
+}
+
+// Maps |bits| received bits to a signed value of category |bits| (F.2.2.1).
+int Extend(int value, int bits) {
+    return value < (1 << (bits - 1)) ? value - (1 << bits) + 1 : value;
+}
+
+// Payload of a marker segment.
+class SegmentReader {
+public:
+    SegmentReader(const uint8_t* data, size_t size) : data_(data), size_(size) {
+    }
+
+    uint8_t Byte() {
+        if (pos_ >= size_) {
+            throw std::runtime_error("Marker segment is too short");
+        }
+        return data_[pos_++];
+    }
+
+    uint16_t Word() {
+        uint16_t high = Byte();
+        return high << 8 | Byte();
+    }
+
+    bool Empty() const {
+        return pos_ == size_;
+    }
+
+    const uint8_t* Data() const {
+        return data_;
+    }
+
+    size_t Size() const {
+        return size_;
+    }
+
+private:
+    const uint8_t* data_;
+    size_t size_;
+    size_t pos_ = 0;
+};
+
+// Entropy-coded data of a single scan with 0xFF00 stuffing removed.
+class BitReader {
+public:
+    BitReader(const uint8_t* data, size_t size) : data_(data), size_(size) {
+    }
+
+    bool ReadBit() {
+        if (!bits_left_) {
+            Fetch();
+        }
+        --bits_left_;
+        return (current_ >> bits_left_) & 1;
+    }
+
+    int ReadBits(int count) {
+        int result = 0;
+        while (count--) {
+            result = result * 2 + ReadBit();
+        }
+        return result;
+    }
+
+    int ReadHuffman(HuffmanTree& tree) {
+        int value = 0;
+        while (!tree.Move(ReadBit(), value)) {
+        }
+        return value;
+    }
+
+    // Drops the padding bits of the current interval and the RSTn marker after it.
+    void Restart() {
+        bits_left_ = 0;
+        if (pos_ + 2 > size_ || data_[pos_] != 0xFF || !IsRestart(data_[pos_ + 1])) {
+            throw std::runtime_error("Restart marker expected");
+        }
+        pos_ += 2;
+    }
+
+private:
+    void Fetch() {
+        if (pos_ >= size_) {
+            throw std::runtime_error("Unexpected end of entropy-coded data");
+        }
+        current_ = data_[pos_++];
+        if (current_ == 0xFF) {
+            if (pos_ >= size_ || data_[pos_] != 0) {
+                throw std::runtime_error("Unexpected marker inside entropy-coded data");
+            }
+            ++pos_;
+        }
+        bits_left_ = 8;
+    }
+
+    const uint8_t* data_;
+    size_t size_;
+    size_t pos_ = 0;
+    uint8_t current_ = 0;
+    int bits_left_ = 0;
+};
+
+// Adds the lifetime of the object to |*seconds|.
+class PhaseTimer {
+public:
+    explicit PhaseTimer(double* seconds) : seconds_(seconds), start_(Clock::now()) {
+    }
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+    ~PhaseTimer() {
+        *seconds_ += std::chrono::duration<double>(Clock::now() - start_).count();
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    double* seconds_;
+    Clock::time_point start_;
+};
+
+// A component plane at the full image resolution.
+struct PlaneView {
+    const uint8_t* data = nullptr;
+    size_t stride = 0;
+};
+
+struct ScanComponent {
+    ComponentCoefficients* component = nullptr;
+    HuffmanTree* dc_table = nullptr;
+    HuffmanTree* ac_table = nullptr;
+    int prediction = 0;
+};
+
+struct Scan {
+    std::array<ScanComponent, kMaxComponents> components;
+    size_t count = 0;
+    int ss = 0;
+    int se = 0;
+    int ah = 0;
+    int al = 0;
+};
+
+}  // namespace
+
+class ProgressiveDecoder::Impl {
+public:
+    Impl()
+        : dct_input_(kBlockSize),
+          dct_output_(kBlockSize),
+          dct_(kBlockSide, &dct_input_, &dct_output_) {
+    }
+
+    size_t Feed(const uint8_t* data, size_t size) {
+        if (finished_) {
+            return 0;
+        }
+        buffer_.insert(buffer_.end(), data, data + size);
+
+        size_t scans_before = scans_decoded_;
+        while (!finished_) {
+            bool progress = false;
+            if (in_scan_) {
+                PhaseTimer timer(&stats_.entropy_seconds);
+                progress = DecodePendingScan();
+            } else {
+                PhaseTimer timer(&stats_.parse_seconds);
+                progress = ParseSegment();
+            }
+            if (!progress) {
+                break;
+            }
+        }
+
+        if (finished_) {
+            buffer_.clear();
+        } else {
+            buffer_.erase(buffer_.begin(), buffer_.begin() + pos_);
+        }
+        pos_ = 0;
+        return scans_decoded_ - scans_before;
+    }
+
+    bool IsFinished() const {
+        return finished_;
+    }
+
+    size_t ScansDecoded() const {
+        return scans_decoded_;
+    }
+
+    const DecodeStats& Stats() const {
+        return stats_;
+    }
+
+    const FrameCoefficients& Coefficients() const {
+        if (!frame_parsed_) {
+            throw std::runtime_error("Frame header hasn't been decoded yet");
+        }
+        return frame_;
+    }
+
+    const std::string& Comment() const {
+        return comment_;
+    }
+
+    void Render(Image* image) {
+        if (!frame_parsed_) {
+            throw std::runtime_error("Frame header hasn't been decoded yet");
+        }
+
+        {
+            PhaseTimer timer(&stats_.idct_seconds);
+            for (size_t i = 0; i < frame_.components.size(); ++i) {
+                RenderComponent(frame_.components[i], &planes_[i]);
+            }
+        }
+        {
+            PhaseTimer timer(&stats_.upsample_seconds);
+            for (size_t i = 0; i < frame_.components.size(); ++i) {
+                Upsample(i);
+            }
+        }
+
+        PhaseTimer timer(&stats_.color_seconds);
+        image->SetSize(frame_.width, frame_.height);
+        image->SetComment(comment_);
+        if (frame_.components.size() == 1) {
+            ConvertGrayscale(image);
+        } else {
+            ConvertYCbCr(image);
+        }
+    }
+
+    void Reset() {
+        buffer_.clear();
+        pos_ = 0;
+        scan_searched_ = 0;
+        in_scan_ = false;
+        soi_seen_ = false;
+        frame_parsed_ = false;
+        finished_ = false;
+        scans_decoded_ = 0;
+        huffman_defined_.fill(false);
+        quant_defined_.fill(false);
+        restart_interval_ = 0;
+        comment_.clear();
+        eob_run_ = 0;
+    }
+
+private:
+    // Parses the marker segment at the beginning of the unparsed input. Returns false if
+    // it hasn't been received completely yet.
+    bool ParseSegment() {
+        const uint8_t* data = buffer_.data() + pos_;
+        size_t available = buffer_.size() - pos_;
+        if (available < 2) {
+            return false;
+        }
+        if (data[0] != 0xFF) {
+            throw std::runtime_error("Marker expected");
+        }
+
+        uint8_t marker = data[1];
+        if (marker == 0xFF) {
+            ++pos_;
+            return true;
+        }
+        if (!soi_seen_) {
+            if (marker != kSoi) {
+                throw std::runtime_error("File doesn't start with SOI");
+            }
+            soi_seen_ = true;
+            pos_ += 2;
+            return true;
+        }
+        if (marker == kSoi) {
+            throw std::runtime_error("Unexpected SOI");
+        }
+        if (marker == kEoi) {
+            if (!scans_decoded_) {
+                throw std::runtime_error("No scans before EOI");
+            }
+            finished_ = true;
+            pos_ += 2;
+            return true;
+        }
+        if (IsRestart(marker) || marker == kTem) {
+            pos_ += 2;
+            return true;
+        }
+
+        if (available < 4) {
+            return false;
+        }
+        size_t length = data[2] << 8 | data[3];
+        if (length < 2) {
+            throw std::runtime_error("Invalid marker segment length");
+        }
+        if (available < length + 2) {
+            return false;
+        }
+        pos_ += length + 2;
+
+        SegmentReader segment(data + 4, length - 2);
+        if (marker == kSof0 || marker == kSof1 || marker == kSof2) {
+            ParseFrame(segment, marker == kSof2);
+        } else if (marker == kDht) {
+            ParseHuffmanTables(segment);
+        } else if (marker == kDqt) {
+            ParseQuantTables(segment);
+        } else if (marker == kDri) {
+            restart_interval_ = segment.Word();
+        } else if (marker == kSos) {
+            ParseScanHeader(segment);
+            in_scan_ = true;
+            scan_searched_ = 0;
+        } else if (marker == kCom) {
+            comment_.assign(segment.Data(), segment.Data() + segment.Size());
+        } else if (marker < kApp0 || marker > kApp15) {
+            throw std::runtime_error("Unsupported marker");
+        }
+        return true;
+    }
+
+    // Decodes the pending scan once the marker after its entropy-coded data has arrived.
+    bool DecodePendingScan() {
+        const uint8_t* data = buffer_.data() + pos_;
+        size_t available = buffer_.size() - pos_;
+        size_t end = scan_searched_;
+        while (true) {
+            auto next = static_cast<const uint8_t*>(std::memchr(data + end, 0xFF, available - end));
+            if (!next) {
+                scan_searched_ = available;
+                return false;
+            }
+            end = next - data;
+            if (end + 1 == available) {
+                scan_searched_ = end;
+                return false;
+            }
+            if (data[end + 1] && !IsRestart(data[end + 1])) {
+                break;
+            }
+            end += 2;
+        }
+
+        DecodeScan(data, end);
+        pos_ += end;
+        in_scan_ = false;
+        ++scans_decoded_;
+        return true;
+    }
+
+    void ParseFrame(SegmentReader& segment, bool progressive) {
+        if (frame_parsed_) {
+            throw std::runtime_error("Multiple frames");
+        }
+        if (segment.Byte() != 8) {
+            throw std::runtime_error("Only 8-bit precision is supported");
+        }
+        frame_.progressive = progressive;
+        frame_.height = segment.Word();
+        frame_.width = segment.Word();
+        if (!frame_.width || !frame_.height) {
+            throw std::runtime_error("Empty image");
+        }
+
+        size_t count = segment.Byte();
+        if (count != 1 && count != 3) {
+            throw std::runtime_error("Only grayscale and YCbCr images are supported");
+        }
+        frame_.components.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            auto& component = frame_.components[i];
+            component.id = segment.Byte();
+            uint8_t sampling = segment.Byte();
+            component.h = sampling >> 4;
+            component.v = sampling & 15;
+            component.quant_table_id = segment.Byte();
+            if (component.h < 1 || component.h > 4 || component.v < 1 || component.v > 4) {
+                throw std::runtime_error("Invalid sampling factors");
+            }
+            if (static_cast<size_t>(component.quant_table_id) >= kTablesCount) {
+                throw std::runtime_error("Invalid quantization table id");
+            }
+            for (size_t j = 0; j < i; ++j) {
+                if (frame_.components[j].id == component.id) {
+                    throw std::runtime_error("Duplicate component id");
+                }
+            }
+        }
+        if (!segment.Empty()) {
+            throw std::runtime_error("Frame header is too long");
+        }
+
+        frame_.Layout();
+        frame_parsed_ = true;
+    }
+
+    void ParseHuffmanTables(SegmentReader& segment) {
+        while (!segment.Empty()) {
+            uint8_t id = segment.Byte();
+            size_t table_class = id >> 4;
+            size_t index = id & 15;
+            if (table_class > 1 || index >= kTablesCount) {
+                throw std::runtime_error("Invalid Huffman table id");
+            }
+
+            code_lengths_.resize(16);
+            size_t total = 0;
+            for (auto& count : code_lengths_) {
+                count = segment.Byte();
+                total += count;
+            }
+            values_.resize(total);
+            for (auto& value : values_) {
+                value = segment.Byte();
+            }
+
+            size_t slot = table_class * kTablesCount + index;
+            huffman_[slot].Build(code_lengths_, values_);
+            huffman_defined_[slot] = true;
+        }
+    }
+
+    void ParseQuantTables(SegmentReader& segment) {
+        while (!segment.Empty()) {
+            uint8_t id = segment.Byte();
+            size_t precision = id >> 4;
+            size_t index = id & 15;
+            if (precision > 1 || index >= kTablesCount) {
+                throw std::runtime_error("Invalid quantization table id");
+            }
+            for (auto& value : quant_tables_[index]) {
+                value = precision ? segment.Word() : segment.Byte();
+                if (!value) {
+                    throw std::runtime_error("Zero quantization step");
+                }
+            }
+            quant_defined_[index] = true;
+        }
+    }
+
+    void ParseScanHeader(SegmentReader& segment) {
+        if (!frame_parsed_) {
+            throw std::runtime_error("Scan before frame header");
+        }
+
+        scan_.count = segment.Byte();
+        if (!scan_.count || scan_.count > frame_.components.size()) {
+            throw std::runtime_error("Invalid scan components count");
+        }
+        for (size_t i = 0; i < scan_.count; ++i) {
+            int id = segment.Byte();
+            uint8_t tables = segment.Byte();
+            auto component = std::find_if(frame_.components.begin(), frame_.components.end(),
+                                          [id](const auto& c) { return c.id == id; });
+            if (component == frame_.components.end()) {
+                throw std::runtime_error("Unknown scan component");
+            }
+            for (size_t j = 0; j < i; ++j) {
+                if (scan_.components[j].component == &*component) {
+                    throw std::runtime_error("Duplicate scan component");
+                }
+            }
+            size_t dc = tables >> 4;
+            size_t ac = tables & 15;
+            if (dc >= kTablesCount || ac >= kTablesCount) {
+                throw std::runtime_error("Invalid Huffman table id");
+            }
+            scan_.components[i] = {&*component, &huffman_[dc], &huffman_[kTablesCount + ac], 0};
+            scan_dc_ids_[i] = dc;
+            scan_ac_ids_[i] = ac;
+        }
+        scan_.ss = segment.Byte();
+        scan_.se = segment.Byte();
+        uint8_t approximation = segment.Byte();
+        scan_.ah = approximation >> 4;
+        scan_.al = approximation & 15;
+        if (!segment.Empty()) {
+            throw std::runtime_error("Scan header is too long");
+        }
+
+        ValidateScan();
+    }
+
+    void ValidateScan() {
+        bool uses_dc = scan_.ss == 0 && scan_.ah == 0;
+        bool uses_ac = scan_.se > 0;
+        if (!frame_.progressive) {
+            if (scan_.ss != 0 || scan_.se != 63 || scan_.ah != 0 || scan_.al != 0) {
+                throw std::runtime_error("Invalid spectral selection for a sequential scan");
+            }
+        } else {
+            if (scan_.ss > scan_.se || scan_.se > 63 || (scan_.ss == 0 && scan_.se != 0) ||
+                scan_.ah > kMaxSuccessiveBit || scan_.al > kMaxSuccessiveBit) {
+                throw std::runtime_error("Invalid progressive scan parameters");
+            }
+            if (scan_.ss > 0 && scan_.count != 1) {
+                throw std::runtime_error("AC scans must be non-interleaved");
+            }
+        }
+
+        for (size_t i = 0; i < scan_.count; ++i) {
+            auto& component = *scan_.components[i].component;
+            if (!quant_defined_[component.quant_table_id]) {
+                throw std::runtime_error("Undefined quantization table");
+            }
+            component.quant = quant_tables_[component.quant_table_id];
+            if (uses_dc && !huffman_defined_[scan_dc_ids_[i]]) {
+                throw std::runtime_error("Undefined DC Huffman table");
+            }
+            if (uses_ac && !huffman_defined_[kTablesCount + scan_ac_ids_[i]]) {
+                throw std::runtime_error("Undefined AC Huffman table");
+            }
+        }
+    }
+
+    void DecodeScan(const uint8_t* data, size_t size) {
+        BitReader reader(data, size);
+        eob_run_ = 0;
+        size_t mcu = 0;
+        auto restart = [&] {
+            if (restart_interval_ && mcu && mcu % restart_interval_ == 0) {
+                reader.Restart();
+                eob_run_ = 0;
+                for (size_t i = 0; i < scan_.count; ++i) {
+                    scan_.components[i].prediction = 0;
+                }
+            }
+            ++mcu;
+        };
+
+        if (scan_.count == 1) {
+            auto& scan_component = scan_.components[0];
+            auto& component = *scan_component.component;
+            for (size_t row = 0; row < component.height_in_blocks; ++row) {
+                for (size_t col = 0; col < component.width_in_blocks; ++col) {
+                    restart();
+                    DecodeBlock(reader, scan_component, component.Block(row, col));
+                }
+            }
+            return;
+        }
+
+        for (size_t mcu_y = 0; mcu_y < frame_.mcus_y; ++mcu_y) {
+            for (size_t mcu_x = 0; mcu_x < frame_.mcus_x; ++mcu_x) {
+                restart();
+                for (size_t i = 0; i < scan_.count; ++i) {
+                    auto& component = *scan_.components[i].component;
+                    for (int v = 0; v < component.v; ++v) {
+                        for (int h = 0; h < component.h; ++h) {
+                            DecodeBlock(reader, scan_.components[i],
+                                        component.Block(mcu_y * component.v + v,
+                                                        mcu_x * component.h + h));
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    void DecodeBlock(BitReader& reader, ScanComponent& component, int16_t* block) {
+        if (!frame_.progressive) {
+            DecodeDcFirst(reader, component, block);
+            DecodeAcFirst(reader, component, block);
+        } else if (scan_.ss == 0) {
+            if (scan_.ah == 0) {
+                DecodeDcFirst(reader, component, block);
+            } else if (reader.ReadBit()) {
+                block[0] |= 1 << scan_.al;
+            }
+        } else if (scan_.ah == 0) {
+            DecodeAcFirst(reader, component, block);
+        } else {
+            DecodeAcRefine(reader, component, block);
+        }
+    }
+
+    void DecodeDcFirst(BitReader& reader, ScanComponent& component, int16_t* block) {
+        int category = reader.ReadHuffman(*component.dc_table);
+        if (category > kMaxDcCategory) {
+            throw std::runtime_error("Invalid DC difference category");
+        }
+        if (category) {
+            component.prediction += Extend(reader.ReadBits(category), category);
+        }
+        block[0] = component.prediction * (1 << scan_.al);
+    }
+
+    // Also decodes sequential blocks, where only EOB (r = 0) ends the block early.
+    void DecodeAcFirst(BitReader& reader, ScanComponent& component, int16_t* block) {
+        if (eob_run_) {
+            --eob_run_;
+            return;
+        }
+        int first = frame_.progressive ? scan_.ss : 1;
+        int last = frame_.progressive ? scan_.se : 63;
+        for (int k = first; k <= last; ++k) {
+            int symbol = reader.ReadHuffman(*component.ac_table);
+            int run = symbol >> 4;
+            int category = symbol & 15;
+            if (category) {
+                k += run;
+                if (k > last || category > kMaxAcCategory) {
+                    throw std::runtime_error("Invalid AC coefficient");
+                }
+                block[k] = Extend(reader.ReadBits(category), category) * (1 << scan_.al);
+            } else if (run == 15) {
+                k += 15;
+            } else {
+                if (run && !frame_.progressive) {
+                    throw std::runtime_error("EOB run in a sequential scan");
+                }
+                eob_run_ = (1 << run) + reader.ReadBits(run) - 1;
+                break;
+            }
+        }
+    }
+
+    // Successive approximation refinement of an AC band (G.1.2.3): every already
+    // nonzero coefficient receives a correction bit, newly nonzero ones are coded
+    // as runs of still-zero coefficients.
+    void DecodeAcRefine(BitReader& reader, ScanComponent& component, int16_t* block) {
+        const int positive = 1 << scan_.al;
+        const int negative = -positive;
+        auto refine = [&](int16_t& coefficient) {
+            if (reader.ReadBit() && !(coefficient & positive)) {
+                coefficient += coefficient >= 0 ? positive : negative;
+            }
+        };
+
+        int k = scan_.ss;
+        if (!eob_run_) {
+            for (; k <= scan_.se; ++k) {
+                int symbol = reader.ReadHuffman(*component.ac_table);
+                int run = symbol >> 4;
+                int category = symbol & 15;
+                int value = 0;
+                if (category) {
+                    if (category != 1) {
+                        throw std::runtime_error("Invalid AC refinement");
+                    }
+                    value = reader.ReadBit() ? positive : negative;
+                } else if (run != 15) {
+                    eob_run_ = (1 << run) + reader.ReadBits(run);
+                    break;
+                }
+
+                for (; k <= scan_.se; ++k) {
+                    if (block[k]) {
+                        refine(block[k]);
+                    } else if (--run < 0) {
+                        break;
+                    }
+                }
+                if (value) {
+                    if (k > scan_.se) {
+                        throw std::runtime_error("Invalid AC refinement");
+                    }
+                    block[k] = value;
+                }
+            }
+        }
+
+        if (eob_run_) {
+            for (; k <= scan_.se; ++k) {
+                if (block[k]) {
+                    refine(block[k]);
+                }
+            }
+            --eob_run_;
+        }
+    }
+
+    void RenderComponent(const ComponentCoefficients& component, std::vector<uint8_t>* plane) {
+        size_t stride = component.width_in_blocks * kBlockSide;
+        plane->resize(stride * component.height_in_blocks * kBlockSide);
+        for (size_t row = 0; row < component.height_in_blocks; ++row) {
+            for (size_t col = 0; col < component.width_in_blocks; ++col) {
+                InverseBlock(component.Block(row, col), component.quant,
+                             plane->data() + row * kBlockSide * stride + col * kBlockSide,
+                             stride);
+            }
+        }
+    }
+
+    void InverseBlock(const int16_t* block, const QuantTable& quant, uint8_t* out,
+                      size_t stride) {
+        bool has_ac = std::any_of(block + 1, block + kBlockSize, [](int16_t c) { return c; });
+        if (!has_ac) {
+            // IDCT of a DC-only block is flat.
+            uint8_t value = Clamp(std::lround(block[0] * quant[0] / 8.0) + 128);
+            for (size_t y = 0; y < kBlockSide; ++y) {
+                std::fill(out + y * stride, out + y * stride + kBlockSide, value);
+            }
+            return;
+        }
+
+        for (size_t k = 0; k < kBlockSize; ++k) {
+            dct_input_[kZigzag[k]] = block[k] * quant[k];
+        }
+        dct_.Inverse();
+        for (size_t y = 0; y < kBlockSide; ++y) {
+            for (size_t x = 0; x < kBlockSide; ++x) {
+                out[y * stride + x] = Clamp(std::lround(dct_output_[y * kBlockSide + x]) + 128);
+            }
+        }
+    }
+
+    // Nearest-neighbour upsampling of subsampled planes to the image resolution.
+    void Upsample(size_t index) {
+        const auto& component = frame_.components[index];
+        size_t stride = component.width_in_blocks * kBlockSide;
+        if (component.h == frame_.max_h && component.v == frame_.max_v) {
+            views_[index] = {planes_[index].data(), stride};
+            return;
+        }
+
+        columns_.resize(frame_.width);
+        for (size_t x = 0; x < frame_.width; ++x) {
+            columns_[x] = x * component.h / frame_.max_h;
+        }
+        auto& upsampled = upsampled_[index];
+        upsampled.resize(frame_.width * frame_.height);
+        for (size_t y = 0; y < frame_.height; ++y) {
+            const uint8_t* row = planes_[index].data() + y * component.v / frame_.max_v * stride;
+            uint8_t* out = upsampled.data() + y * frame_.width;
+            for (size_t x = 0; x < frame_.width; ++x) {
+                out[x] = row[columns_[x]];
+            }
+        }
+        views_[index] = {upsampled.data(), frame_.width};
+    }
+
+    void ConvertGrayscale(Image* image) const {
+        for (size_t y = 0; y < frame_.height; ++y) {
+            const uint8_t* row = views_[0].data + y * views_[0].stride;
+            for (size_t x = 0; x < frame_.width; ++x) {
+                int value = row[x];
+                image->SetPixel(y, x, {value, value, value});
+            }
+        }
+    }
+
+    void ConvertYCbCr(Image* image) const {
+        for (size_t y = 0; y < frame_.height; ++y) {
+            const uint8_t* luma_row = views_[0].data + y * views_[0].stride;
+            const uint8_t* cb_row = views_[1].data + y * views_[1].stride;
+            const uint8_t* cr_row = views_[2].data + y * views_[2].stride;
+            for (size_t x = 0; x < frame_.width; ++x) {
+                double luma = luma_row[x];
+                double cb = cb_row[x] - 128.0;
+                double cr = cr_row[x] - 128.0;
+                image->SetPixel(y, x,
+                                {Clamp(std::lround(luma + 1.402 * cr)),
+                                 Clamp(std::lround(luma - 0.344136 * cb - 0.714136 * cr)),
+                                 Clamp(std::lround(luma + 1.772 * cb))});
+            }
+        }
+    }
+
+    std::vector<uint8_t> buffer_;
+    // First unparsed byte of buffer_.
+    size_t pos_ = 0;
+    // Bytes of the pending entropy-coded data already searched for its end.
+    size_t scan_searched_ = 0;
+    bool in_scan_ = false;
+    bool soi_seen_ = false;
+    bool frame_parsed_ = false;
+    bool finished_ = false;
+    size_t scans_decoded_ = 0;
+
+    std::array<HuffmanTree, 2 * kTablesCount> huffman_;
+    std::array<bool, 2 * kTablesCount> huffman_defined_{};
+    std::vector<uint8_t> code_lengths_;
+    std::vector<uint8_t> values_;
+    std::array<QuantTable, kTablesCount> quant_tables_{};
+    std::array<bool, kTablesCount> quant_defined_{};
+    size_t restart_interval_ = 0;
+    std::string comment_;
+
+    FrameCoefficients frame_;
+    Scan scan_;
+    std::array<size_t, kMaxComponents> scan_dc_ids_{};
+    std::array<size_t, kMaxComponents> scan_ac_ids_{};
+    int eob_run_ = 0;
+
+    std::vector<double> dct_input_;
+    std::vector<double> dct_output_;
+    DctCalculator dct_;
+    std::array<std::vector<uint8_t>, kMaxComponents> planes_;
+    std::array<std::vector<uint8_t>, kMaxComponents> upsampled_;
+    std::array<PlaneView, kMaxComponents> views_;
+    std::vector<size_t> columns_;
+
+    DecodeStats stats_;
+};
+
+ProgressiveDecoder::ProgressiveDecoder() : impl_(std::make_unique<Impl>()) {
+}
+
+ProgressiveDecoder::ProgressiveDecoder(ProgressiveDecoder&&) = default;
+
+ProgressiveDecoder& ProgressiveDecoder::operator=(ProgressiveDecoder&&) = default;
+
+size_t ProgressiveDecoder::Feed(const uint8_t* data, size_t size) {
+    return impl_->Feed(data, size);
+}
+
+bool ProgressiveDecoder::IsFinished() const {
+    return impl_->IsFinished();
+}
+
+size_t ProgressiveDecoder::ScansDecoded() const {
+    return impl_->ScansDecoded();
+}
+
+const FrameCoefficients& ProgressiveDecoder::Coefficients() const {
+    return impl_->Coefficients();
+}
+
+const std::string& ProgressiveDecoder::Comment() const {
+    return impl_->Comment();
+}
+
+Image ProgressiveDecoder::Render() {
+    Image image;
+    impl_->Render(&image);
+    return image;
+}
+
+void ProgressiveDecoder::Render(Image* image) {
+    impl_->Render(image);
+}
+
+const DecodeStats& ProgressiveDecoder::Stats() const {
+    return impl_->Stats();
+}
+
+void ProgressiveDecoder::Reset() {
+    impl_->Reset();
+}
+
+ProgressiveDecoder::~ProgressiveDecoder() = default;
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "coefficients.h"
+
+#include <image.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Wall time spent in every decoding phase since the decoder was created.
+struct DecodeStats {
+    double parse_seconds = 0;
+    double entropy_seconds = 0;
+    double idct_seconds = 0;
+    double upsample_seconds = 0;
+    double color_seconds = 0;
+};
+
+// Incremental decoder for baseline and progressive JPEG. The file may be fed in
+// chunks of any size as they arrive: every scan is entropy decoded into the
+// coefficient store as soon as its last byte is available, and only the unparsed
+// tail of the input is kept. A preview can be rendered after any completed scan.
+class ProgressiveDecoder {
+public:
+    ProgressiveDecoder();
+
+    ProgressiveDecoder(const ProgressiveDecoder&) = delete;
+    ProgressiveDecoder& operator=(const ProgressiveDecoder&) = delete;
+
+    ProgressiveDecoder(ProgressiveDecoder&&);
+    ProgressiveDecoder& operator=(ProgressiveDecoder&&);
+
+    // Consumes the next chunk of the file, returns the number of scans it completed.
+    // Throws std::runtime_error on malformed input, the decoder is unusable afterwards.
+    size_t Feed(const uint8_t* data, size_t size);
+
+    // EOI has been reached, the rest of the input is ignored.
+    bool IsFinished() const;
+
+    size_t ScansDecoded() const;
+
+    const DecodeStats& Stats() const;
+
+    // Quantized coefficients decoded so far, for work that doesn't need pixels.
+    // Throws std::runtime_error before the frame header.
+    const FrameCoefficients& Coefficients() const;
+
+    const std::string& Comment() const;
+
+    // Converts the coefficients decoded so far into pixels. Bands that haven't
+    // arrived yet are treated as zeros.
+    Image Render();
+
+    // Same as above, reuses the storage of |image|.
+    void Render(Image* image);
+
+    // Prepares the decoder for the next file. Buffers, tables and the DCT plan are
+    // kept, so decoding images of the same geometry again doesn't allocate.
+    void Reset();
+
+    ~ProgressiveDecoder();
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
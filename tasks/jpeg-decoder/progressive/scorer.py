@@ -0,0 +1,69 @@
+#!/usr/bin/python3
+import json
+import sys
+
+PHASES = ['parse_ms', 'entropy_ms', 'idct_ms', 'upsample_ms', 'color_ms']
+MIN_MEGAPIXELS_PER_SECOND = 2
+# Smaller images are dominated by per-file overhead.
+MIN_CHECKED_MEGAPIXELS = 0.1
+MAX_REGRESSION = 1.1
+# Encoding may be slower than libjpeg with its SIMD kernels, but not by much.
+MAX_LIBJPEG_RATIO = 8
+
+
+def get_benchmarks(filename):
+    results = {}
+    for result in json.load(open(filename))['benchmarks']:
+        if result['run_type'] == 'aggregate' and result['aggregate_name'] != 'median':
+            continue
+        results[result['run_name'] if 'run_name' in result else result['name']] = result
+    return results
+
+
+def check_decode(name, result, baseline):
+    ok = True
+    phases = ' '.join('{}={:.2f}'.format(phase, result[phase]) for phase in PHASES)
+    print('{}: {:.1f} MB/s, {:.1f} MP/s, {}'.format(
+        name, result['bytes_per_second'] / 2**20, result['megapixels_per_second'], phases))
+    if (result['megapixels'] >= MIN_CHECKED_MEGAPIXELS and
+            result['megapixels_per_second'] < MIN_MEGAPIXELS_PER_SECOND):
+        print('  throughput is too low ¯\\_(ツ)_/¯')
+        ok = False
+    if name in baseline:
+        for phase in PHASES:
+            before, after = baseline[name][phase], result[phase]
+            if after > before * MAX_REGRESSION and after - before > 0.05:
+                print('  {} regressed: {:.2f} -> {:.2f} ms'.format(phase, before, after))
+                ok = False
+    return ok
+
+
+def check_encode(name, result, results):
+    libjpeg = results.get('Libjpeg' + name)
+    if libjpeg is None:
+        return True
+    ratio = libjpeg['megapixels_per_second'] / result['megapixels_per_second']
+    print('{}: {:.1f} MP/s, {:.1f}x slower than libjpeg'.format(
+        name, result['megapixels_per_second'], ratio))
+    if result['megapixels'] >= MIN_CHECKED_MEGAPIXELS and ratio > MAX_LIBJPEG_RATIO:
+        print('  encoder is too slow ¯\\_(ツ)_/¯')
+        return False
+    return True
+
+
+def get_score(results, baseline):
+    ok = True
+    for name, result in sorted(results.items()):
+        if name.startswith('Decode/'):
+            ok &= check_decode(name, result, baseline)
+        elif name.startswith('Encode/'):
+            ok &= check_encode(name, result, results)
+    if not ok:
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    print('Checking decoder benchmark results...')
+    baseline = get_benchmarks(sys.argv[2]) if len(sys.argv) > 2 else {}
+    get_score(get_benchmarks(sys.argv[1]), baseline)
+    print('Passed benchmark validation 🎉🎉🎉')
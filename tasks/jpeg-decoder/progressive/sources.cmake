@@ -1,6 +1,12 @@
 add_library(decoder_progressive
 
         # maybe your files here
+        progressive_decoder.cpp
+        jpeg_decoder.cpp
+        huffman_encoder.cpp
+        baseline_writer.cpp
+        encoder.cpp
+        transcoder.cpp
 
         huffman.cpp
         fft.cpp
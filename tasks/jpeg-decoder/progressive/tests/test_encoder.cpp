@@ -0,0 +1,159 @@
+#include <decoder.h>
+#include <encoder.h>
+#include <huffman_encoder.h>
+
+#include <catch.hpp>
+#include <libjpg_reader.hpp>
+#include <test_commons.hpp>
+
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+Image DecodeTestFile(const std::string& filename) {
+    auto data = ReadTestFile(filename);
+    std::istringstream input({data.begin(), data.end()});
+    return Decode(input);
+}
+
+std::string Encode(const Image& image, const EncoderOptions& options) {
+    JpegEncoder encoder(options);
+    std::ostringstream output;
+    encoder.Encode(image, output);
+    return output.str();
+}
+
+Image DecodeString(const std::string& data) {
+    std::istringstream input(data);
+    return Decode(input);
+}
+
+// Decodes with libjpeg, which only reads files.
+Image DecodeWithLibjpeg(const std::string& data) {
+    auto path = std::filesystem::temp_directory_path() / "test_encoder.jpg";
+    {
+        std::ofstream output(path, std::ios::binary);
+        output.write(data.data(), data.size());
+    }
+    auto image = ReadJpg(path);
+    std::filesystem::remove(path);
+    return image;
+}
+
+}  // namespace
+
+TEST_CASE("Encoder round trip", "[jpg]") {
+    for (auto filename :
+         {"colors.jpg", "small.jpg", "progressive.jpg", "chroma_halfed.jpg", "grayscale.jpg"}) {
+        auto image = DecodeTestFile(filename);
+        for (auto subsampling : {Subsampling::k444, Subsampling::k422, Subsampling::k420}) {
+            EncoderOptions options;
+            options.quality = 90;
+            options.subsampling = subsampling;
+            auto data = Encode(image, options);
+
+            auto decoded = DecodeString(data);
+            Compare(decoded, image);
+            Compare(DecodeWithLibjpeg(data), decoded);
+        }
+    }
+}
+
+TEST_CASE("Encoder grayscale", "[jpg]") {
+    auto image = DecodeTestFile("grayscale.jpg");
+    EncoderOptions options;
+    options.grayscale = true;
+    auto decoded = DecodeString(Encode(image, options));
+    Compare(decoded, image);
+    for (size_t y = 0; y < decoded.Height(); ++y) {
+        for (size_t x = 0; x < decoded.Width(); ++x) {
+            auto pixel = decoded.GetPixel(y, x);
+            REQUIRE(pixel.r == pixel.g);
+            REQUIRE(pixel.g == pixel.b);
+        }
+    }
+}
+
+TEST_CASE("Encoder optimized Huffman tables", "[jpg]") {
+    for (auto filename : {"lenna.jpg", "grayscale.jpg", "tiny.jpg"}) {
+        auto image = DecodeTestFile(filename);
+        EncoderOptions options;
+        auto standard = Encode(image, options);
+        options.optimize_huffman = true;
+        auto optimized = Encode(image, options);
+
+        REQUIRE(optimized.size() <= standard.size());
+        // Only the entropy coding differs.
+        REQUIRE(ImagesEqual(DecodeString(optimized), DecodeString(standard)));
+        Compare(DecodeWithLibjpeg(optimized), DecodeString(optimized));
+    }
+}
+
+TEST_CASE("Encoder optimized Huffman tables for grayscale", "[jpg]") {
+    auto image = DecodeTestFile("grayscale.jpg");
+    EncoderOptions options;
+    options.grayscale = true;
+    auto standard = Encode(image, options);
+    options.optimize_huffman = true;
+    auto optimized = Encode(image, options);
+
+    REQUIRE(optimized.size() <= standard.size());
+    REQUIRE(ImagesEqual(DecodeString(optimized), DecodeString(standard)));
+    Compare(DecodeWithLibjpeg(optimized), DecodeString(optimized));
+}
+
+TEST_CASE("Optimal Huffman code of no symbols", "[jpg]") {
+    std::array<uint32_t, 256> frequencies{};
+    std::vector<uint8_t> code_lengths;
+    std::vector<uint8_t> values;
+    BuildOptimalCode(frequencies, &code_lengths, &values);
+    REQUIRE(std::count(code_lengths.begin(), code_lengths.end(), 0) == 16);
+    REQUIRE(values.empty());
+}
+
+TEST_CASE("Encoder quality", "[jpg]") {
+    auto image = DecodeTestFile("lenna.jpg");
+    size_t previous = 0;
+    for (int quality : {10, 50, 75, 95, 100}) {
+        EncoderOptions options;
+        options.quality = quality;
+        auto data = Encode(image, options);
+        REQUIRE(data.size() > previous);
+        previous = data.size();
+        DecodeString(data);
+    }
+}
+
+TEST_CASE("Encoder comment and reuse", "[jpg]") {
+    EncoderOptions options;
+    options.quality = 95;
+    options.subsampling = Subsampling::k444;
+    JpegEncoder encoder(options);
+    for (auto filename : {"colors.jpg", "tiny.jpg", "colors.jpg"}) {
+        auto image = DecodeTestFile(filename);
+        image.SetComment(std::string("Re-encoded ") + filename);
+        std::ostringstream output;
+        encoder.Encode(image, output);
+        auto decoded = DecodeString(output.str());
+        REQUIRE(decoded.GetComment() == image.GetComment());
+        Compare(decoded, image);
+    }
+}
+
+TEST_CASE("Encoder errors", "[jpg]") {
+    EncoderOptions options;
+    options.quality = 0;
+    REQUIRE_THROWS_AS(JpegEncoder(options), std::invalid_argument);
+    options.quality = 101;
+    REQUIRE_THROWS_AS(JpegEncoder(options), std::invalid_argument);
+
+    JpegEncoder encoder;
+    std::ostringstream output;
+    REQUIRE_THROWS_AS(encoder.Encode(Image(), output), std::invalid_argument);
+}
@@ -0,0 +1,43 @@
+#include <decoder.h>
+#include <jpeg_decoder.h>
+
+#include <allocations_checker.h>
+#include <catch.hpp>
+#include <test_commons.hpp>
+
+#include <sstream>
+#include <string>
+
+TEST_CASE("Decoder reuse", "[jpg]") {
+    JpegDecoder decoder;
+    Image image;
+    for (auto filename : {"lenna.jpg", "progressive-2.jpg", "grayscale.jpg", "small.jpg"}) {
+        auto data = ReadTestFile(filename);
+        std::istringstream input({data.begin(), data.end()});
+        auto expected = Decode(input);
+
+        for (int i = 0; i < 3; ++i) {
+            input.clear();
+            input.seekg(0);
+            if (i == 0) {
+                decoder.Decode(input, &image);
+            } else {
+                EXPECT_ZERO_ALLOCATIONS(decoder.Decode(input, &image));
+            }
+            REQUIRE(ImagesEqual(image, expected));
+        }
+    }
+}
+
+TEST_CASE("Decoder reuse after error", "[jpg]") {
+    JpegDecoder decoder;
+    auto bad = ReadTestFile("bad/bad14.jpg");
+    std::istringstream bad_input({bad.begin(), bad.end()});
+    REQUIRE_THROWS(decoder.Decode(bad_input));
+
+    auto data = ReadTestFile("tiny.jpg");
+    std::istringstream input({data.begin(), data.end()});
+    auto image = decoder.Decode(input);
+    REQUIRE(image.Width() == 1);
+    REQUIRE(image.Height() == 2);
+}
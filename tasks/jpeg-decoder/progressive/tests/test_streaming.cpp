@@ -0,0 +1,70 @@
+#include <decoder.h>
+#include <progressive_decoder.h>
+
+#include <catch.hpp>
+#include <test_commons.hpp>
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+Image FeedInChunks(const std::string& filename, size_t chunk_size, size_t expected_scans) {
+    auto data = ReadTestFile(filename);
+    ProgressiveDecoder decoder;
+    size_t previews = 0;
+    for (size_t pos = 0; pos < data.size(); pos += chunk_size) {
+        REQUIRE_FALSE(decoder.IsFinished());
+        size_t size = std::min(chunk_size, data.size() - pos);
+        if (decoder.Feed(data.data() + pos, size)) {
+            auto preview = decoder.Render();
+            REQUIRE(preview.Width() > 0);
+            ++previews;
+        }
+    }
+    REQUIRE(decoder.IsFinished());
+    REQUIRE(decoder.ScansDecoded() == expected_scans);
+    REQUIRE(previews > 0);
+    REQUIRE(previews <= expected_scans);
+    return decoder.Render();
+}
+
+}  // namespace
+
+TEST_CASE("Streaming matches Decode", "[jpg]") {
+    for (size_t chunk_size : {1, 97, 4096}) {
+        auto data = ReadTestFile("progressive.jpg");
+        std::istringstream input({data.begin(), data.end()});
+        auto expected = Decode(input);
+        REQUIRE(ImagesEqual(FeedInChunks("progressive.jpg", chunk_size, 6), expected));
+    }
+    auto baseline = FeedInChunks("small.jpg", 13, 1);
+    REQUIRE(baseline.GetComment() == ":)");
+}
+
+TEST_CASE("Streaming previews", "[jpg]") {
+    auto data = ReadTestFile("progressive-2.jpg");
+    ProgressiveDecoder decoder;
+    size_t scans = 0;
+    for (auto byte : data) {
+        scans += decoder.Feed(&byte, 1);
+        if (scans == 1) {
+            break;
+        }
+    }
+    REQUIRE(decoder.ScansDecoded() == 1);
+    auto preview = decoder.Render();
+    REQUIRE(preview.Width() == 910);
+    REQUIRE(preview.Height() == 608);
+    REQUIRE(preview.GetComment() == "such decoder");
+}
+
+TEST_CASE("Streaming truncated", "[jpg]") {
+    auto data = ReadTestFile("progressive_small.jpg");
+    ProgressiveDecoder decoder;
+    decoder.Feed(data.data(), data.size() / 2);
+    REQUIRE_FALSE(decoder.IsFinished());
+    REQUIRE(decoder.ScansDecoded() < 10);
+}
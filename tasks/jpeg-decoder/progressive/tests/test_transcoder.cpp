@@ -0,0 +1,188 @@
+#include <decoder.h>
+#include <transcoder.h>
+
+#include <catch.hpp>
+#include <test_commons.hpp>
+
+#include <cstdlib>
+#include <functional>
+#include <sstream>
+#include <string>
+
+namespace {
+
+std::string ReadTestString(const std::string& filename) {
+    auto data = ReadTestFile(filename);
+    return {data.begin(), data.end()};
+}
+
+Image DecodeString(const std::string& data) {
+    std::istringstream input(data);
+    return Decode(input);
+}
+
+std::string Transcode(const std::string& data, const TranscodeOptions& options) {
+    JpegTranscoder transcoder;
+    std::istringstream input(data);
+    std::ostringstream output;
+    transcoder.Transcode(input, options, output);
+    return output.str();
+}
+
+std::string Transcode(const std::string& data, Transform transform) {
+    TranscodeOptions options;
+    options.transform = transform;
+    return Transcode(data, options);
+}
+
+// The pixel of |original| that lands at (y, x) of the transformed image.
+using PixelMap = std::function<RGB(const Image& original, size_t y, size_t x)>;
+
+// The IDCT of a transformed block matches the transformed IDCT up to rounding, which
+// the color conversion may double.
+void CheckTransformed(const Image& actual, const Image& original, const PixelMap& map) {
+    int max_diff = 0;
+    for (size_t y = 0; y < actual.Height(); ++y) {
+        for (size_t x = 0; x < actual.Width(); ++x) {
+            auto lhs = actual.GetPixel(y, x);
+            auto rhs = map(original, y, x);
+            max_diff = std::max({max_diff, std::abs(lhs.r - rhs.r), std::abs(lhs.g - rhs.g),
+                                 std::abs(lhs.b - rhs.b)});
+        }
+    }
+    REQUIRE(max_diff <= 2);
+}
+
+}  // namespace
+
+TEST_CASE("Transcoding keeps pixels", "[jpg]") {
+    for (auto filename : {"lenna.jpg", "grayscale.jpg", "progressive.jpg", "progressive-2.jpg",
+                          "chroma_halfed.jpg", "test.jpg", "tiny.jpg"}) {
+        auto data = ReadTestString(filename);
+        auto original = DecodeString(data);
+
+        auto transcoded = Transcode(data, Transform::kNone);
+        REQUIRE(ImagesEqual(DecodeString(transcoded), original));
+
+        TranscodeOptions options;
+        options.keep_comment = false;
+        options.optimize_huffman = false;
+        auto stripped = DecodeString(Transcode(data, options));
+        original.SetComment("");
+        REQUIRE(ImagesEqual(stripped, original));
+    }
+}
+
+// Grayscale frames have no chroma tables to optimize.
+TEST_CASE("Transcoding optimized Huffman tables", "[jpg]") {
+    for (auto filename : {"lenna.jpg", "grayscale.jpg", "tiny.jpg"}) {
+        auto data = ReadTestString(filename);
+        TranscodeOptions options;
+        options.optimize_huffman = false;
+        auto standard = Transcode(data, options);
+        options.optimize_huffman = true;
+        auto optimized = Transcode(data, options);
+
+        REQUIRE(optimized.size() <= standard.size());
+        REQUIRE(ImagesEqual(DecodeString(optimized), DecodeString(standard)));
+    }
+}
+
+TEST_CASE("Transcoding rotations", "[jpg]") {
+    // Sizes are whole MCUs, nothing is trimmed.
+    for (auto filename : {"lenna.jpg", "small.jpg", "grayscale.jpg"}) {
+        auto data = ReadTestString(filename);
+        auto original = DecodeString(data);
+        size_t width = original.Width();
+        size_t height = original.Height();
+
+        auto rotated = DecodeString(Transcode(data, Transform::kRotate90));
+        REQUIRE(rotated.Width() == height);
+        REQUIRE(rotated.Height() == width);
+        CheckTransformed(rotated, original, [height](const Image& image, size_t y, size_t x) {
+            return image.GetPixel(height - 1 - x, y);
+        });
+
+        auto upside_down = DecodeString(Transcode(data, Transform::kRotate180));
+        CheckTransformed(upside_down, original,
+                         [width, height](const Image& image, size_t y, size_t x) {
+                             return image.GetPixel(height - 1 - y, width - 1 - x);
+                         });
+
+        auto counterclockwise = DecodeString(Transcode(data, Transform::kRotate270));
+        CheckTransformed(counterclockwise, original,
+                         [width](const Image& image, size_t y, size_t x) {
+                             return image.GetPixel(x, width - 1 - y);
+                         });
+
+        auto transposed = DecodeString(Transcode(data, Transform::kTranspose));
+        CheckTransformed(transposed, original, [](const Image& image, size_t y, size_t x) {
+            return image.GetPixel(x, y);
+        });
+
+        // Four quarter turns give back the same coefficients.
+        auto turned = data;
+        for (int i = 0; i < 4; ++i) {
+            turned = Transcode(turned, Transform::kRotate90);
+        }
+        REQUIRE(ImagesEqual(DecodeString(turned), original));
+    }
+}
+
+TEST_CASE("Transcoding flips trim partial MCUs", "[jpg]") {
+    // 1400x685 with 16x8 MCUs.
+    auto data = ReadTestString("chroma_halfed.jpg");
+    auto original = DecodeString(data);
+
+    auto mirrored = DecodeString(Transcode(data, Transform::kFlipHorizontal));
+    REQUIRE(mirrored.Width() == 1392);
+    REQUIRE(mirrored.Height() == 685);
+    CheckTransformed(mirrored, original, [](const Image& image, size_t y, size_t x) {
+        return image.GetPixel(y, 1391 - x);
+    });
+
+    auto flipped = DecodeString(Transcode(data, Transform::kFlipVertical));
+    REQUIRE(flipped.Width() == 1400);
+    REQUIRE(flipped.Height() == 680);
+    CheckTransformed(flipped, original, [](const Image& image, size_t y, size_t x) {
+        return image.GetPixel(679 - y, x);
+    });
+
+    REQUIRE_THROWS_AS(Transcode(ReadTestString("tiny.jpg"), Transform::kFlipVertical),
+                      std::invalid_argument);
+}
+
+TEST_CASE("Transcoding crop", "[jpg]") {
+    // 2x2 sampling, 16x16 MCUs.
+    auto data = ReadTestString("witch.jpg");
+    auto original = DecodeString(data);
+
+    TranscodeOptions options;
+    options.crop = CropRegion{160, 320, 300, 1000};
+    auto cropped = DecodeString(Transcode(data, options));
+    REQUIRE(cropped.Width() == 300);
+    REQUIRE(cropped.Height() == 686);
+    for (size_t y = 0; y < cropped.Height(); ++y) {
+        for (size_t x = 0; x < cropped.Width(); ++x) {
+            auto lhs = cropped.GetPixel(y, x);
+            auto rhs = original.GetPixel(y + 320, x + 160);
+            REQUIRE((lhs.r == rhs.r && lhs.g == rhs.g && lhs.b == rhs.b));
+        }
+    }
+
+    options.transform = Transform::kRotate180;
+    options.crop = CropRegion{16, 16, 64, 32};
+    auto rotated = DecodeString(Transcode(data, options));
+    REQUIRE(rotated.Width() == 64);
+    REQUIRE(rotated.Height() == 32);
+    // 1006 is trimmed to 992 before rotating.
+    CheckTransformed(rotated, original, [](const Image& image, size_t y, size_t x) {
+        return image.GetPixel(991 - 16 - y, 991 - 16 - x);
+    });
+
+    options.transform = Transform::kNone;
+    options.crop = CropRegion{8, 0, 16, 16};
+    REQUIRE_THROWS_AS(Transcode(data, options), std::invalid_argument);
+    options.crop = CropRegion{1008, 0, 16, 16};
+    REQUIRE_THROWS_AS(Transcode(data, options), std::invalid_argument);
+}
@@ -0,0 +1,164 @@
+#include "transcoder.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+// Every transform is an optional transposition followed by optional mirroring.
+struct Geometry {
+    bool transpose = false;
+    bool flip_horizontal = false;
+    bool flip_vertical = false;
+};
+
+Geometry Decompose(Transform transform) {
+    switch (transform) {
+        case Transform::kNone:
+            return {};
+        case Transform::kFlipHorizontal:
+            return {false, true, false};
+        case Transform::kFlipVertical:
+            return {false, false, true};
+        case Transform::kTranspose:
+            return {true, false, false};
+        case Transform::kRotate90:
+            return {true, true, false};
+        case Transform::kRotate180:
+            return {false, true, true};
+        case Transform::kRotate270:
+            return {true, false, true};
+    }
+    throw std::invalid_argument("Unknown transform");
+}
+
+// Where every zigzag coefficient of an output block comes from. Mirroring a block
+// negates its odd frequencies along that axis.
+struct BlockMapping {
+    std::array<uint8_t, kBlockSize> source;
+    std::array<int16_t, kBlockSize> sign;
+};
+
+BlockMapping MakeBlockMapping(const Geometry& geometry) {
+    std::array<uint8_t, kBlockSize> zigzag_index;
+    for (size_t k = 0; k < kBlockSize; ++k) {
+        zigzag_index[kZigzag[k]] = k;
+    }
+
+    BlockMapping mapping;
+    for (size_t k = 0; k < kBlockSize; ++k) {
+        size_t v = kZigzag[k] / kBlockSide;
+        size_t u = kZigzag[k] % kBlockSide;
+        bool negate = (geometry.flip_horizontal && u % 2) != (geometry.flip_vertical && v % 2);
+        mapping.sign[k] = negate ? -1 : 1;
+        mapping.source[k] = zigzag_index[geometry.transpose ? u * kBlockSide + v : kZigzag[k]];
+    }
+    return mapping;
+}
+
+}  // namespace
+
+void TransformCoefficients(const FrameCoefficients& input, Transform transform,
+                           const std::optional<CropRegion>& crop, FrameCoefficients* output) {
+    auto geometry = Decompose(transform);
+    auto mapping = MakeBlockMapping(geometry);
+    auto& frame = *output;
+    frame.width = geometry.transpose ? input.height : input.width;
+    frame.height = geometry.transpose ? input.width : input.height;
+    frame.progressive = false;
+    frame.components.resize(input.components.size());
+    for (size_t i = 0; i < input.components.size(); ++i) {
+        const auto& source = input.components[i];
+        auto& target = frame.components[i];
+        target.id = source.id;
+        target.h = geometry.transpose ? source.v : source.h;
+        target.v = geometry.transpose ? source.h : source.v;
+        target.quant_table_id = source.quant_table_id;
+        for (size_t k = 0; k < kBlockSize; ++k) {
+            target.quant[k] = source.quant[mapping.source[k]];
+        }
+    }
+
+    size_t mcu_width = kBlockSide * (geometry.transpose ? input.max_v : input.max_h);
+    size_t mcu_height = kBlockSide * (geometry.transpose ? input.max_h : input.max_v);
+    if (geometry.flip_horizontal) {
+        frame.width -= frame.width % mcu_width;
+    }
+    if (geometry.flip_vertical) {
+        frame.height -= frame.height % mcu_height;
+    }
+    if (!frame.width || !frame.height) {
+        throw std::invalid_argument("Image is smaller than an MCU");
+    }
+    // Only meaningful in the mirrored dimensions, which are whole MCUs now.
+    size_t mcus_x = frame.width / mcu_width;
+    size_t mcus_y = frame.height / mcu_height;
+
+    size_t crop_mcus_x = 0;
+    size_t crop_mcus_y = 0;
+    if (crop) {
+        if (crop->x % mcu_width || crop->y % mcu_height) {
+            throw std::invalid_argument("Crop region isn't aligned to MCUs");
+        }
+        if (!crop->width || !crop->height || crop->x >= frame.width ||
+            crop->y >= frame.height) {
+            throw std::invalid_argument("Crop region is empty");
+        }
+        crop_mcus_x = crop->x / mcu_width;
+        crop_mcus_y = crop->y / mcu_height;
+        frame.width = std::min(crop->width, frame.width - crop->x);
+        frame.height = std::min(crop->height, frame.height - crop->y);
+    }
+    frame.Layout();
+
+    for (size_t i = 0; i < frame.components.size(); ++i) {
+        const auto& source = input.components[i];
+        auto& target = frame.components[i];
+        size_t columns = mcus_x * target.h;
+        size_t rows = mcus_y * target.v;
+        for (size_t row = 0; row < target.padded_height_in_blocks; ++row) {
+            for (size_t col = 0; col < target.stride_in_blocks; ++col) {
+                size_t y = row + crop_mcus_y * target.v;
+                size_t x = col + crop_mcus_x * target.h;
+                if (geometry.flip_vertical) {
+                    if (y >= rows) {
+                        continue;
+                    }
+                    y = rows - 1 - y;
+                }
+                if (geometry.flip_horizontal) {
+                    if (x >= columns) {
+                        continue;
+                    }
+                    x = columns - 1 - x;
+                }
+                if (geometry.transpose) {
+                    std::swap(x, y);
+                }
+                // Padding blocks past the source grid stay zero.
+                if (y >= source.padded_height_in_blocks || x >= source.stride_in_blocks) {
+                    continue;
+                }
+
+                const int16_t* from = source.Block(y, x);
+                int16_t* to = target.Block(row, col);
+                for (size_t k = 0; k < kBlockSize; ++k) {
+                    to[k] = from[mapping.source[k]] * mapping.sign[k];
+                }
+            }
+        }
+    }
+}
+
+void JpegTranscoder::Transcode(std::istream& input, const TranscodeOptions& options,
+                               std::ostream& output) {
+    const auto& coefficients = decoder_.DecodeCoefficients(input);
+    TransformCoefficients(coefficients, options.transform, options.crop, &frame_);
+    if (options.keep_comment) {
+        writer_.Write(frame_, decoder_.Comment(), options.optimize_huffman, output);
+    } else {
+        writer_.Write(frame_, {}, options.optimize_huffman, output);
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "baseline_writer.h"
+#include "coefficients.h"
+#include "jpeg_decoder.h"
+
+#include <cstddef>
+#include <istream>
+#include <optional>
+#include <ostream>
+
+enum class Transform {
+    kNone,
+    kFlipHorizontal,
+    kFlipVertical,
+    kTranspose,
+    kRotate90,  // Clockwise.
+    kRotate180,
+    kRotate270,
+};
+
+// Pixel rectangle of the transformed image. The corner must lie on an MCU boundary,
+// the size is clipped by the image.
+struct CropRegion {
+    size_t x = 0;
+    size_t y = 0;
+    size_t width = 0;
+    size_t height = 0;
+};
+
+struct TranscodeOptions {
+    Transform transform = Transform::kNone;
+    std::optional<CropRegion> crop;
+    // Everything else besides the pixels (APPn segments) is always dropped.
+    bool keep_comment = true;
+    bool optimize_huffman = true;
+};
+
+// Applies |transform| and then |crop| to quantized coefficients, which is exact:
+// blocks are moved, transposed and have the signs of their odd frequencies flipped.
+// A mirrored dimension is trimmed to whole MCUs first, otherwise the padding of the
+// last MCU would become visible. Throws std::invalid_argument for a misaligned or
+// empty crop and for an image smaller than an MCU in a mirrored dimension.
+void TransformCoefficients(const FrameCoefficients& input, Transform transform,
+                           const std::optional<CropRegion>& crop, FrameCoefficients* output);
+
+// Lossless rotation, flipping and cropping of JPEG files without leaving the DCT
+// domain: the input is only entropy decoded and the result is entropy coded again
+// as a sequential JPEG with the original quantization. Buffers are reused.
+class JpegTranscoder {
+public:
+    void Transcode(std::istream& input, const TranscodeOptions& options, std::ostream& output);
+
+private:
+    JpegDecoder decoder_;
+    FrameCoefficients frame_;
+    BaselineWriter writer_;
+};
@@ -16,8 +16,12 @@ public:
         SetSize(width, height);
     }
 
+    // Keeps the rows' storage, so resizing to the same size doesn't allocate.
     void SetSize(size_t width, size_t height) {
-        data_.assign(height, std::vector<RGB>(width));
+        data_.resize(height);
+        for (auto& row : data_) {
+            row.assign(width, RGB{});
+        }
     }
 
     size_t Width() const {
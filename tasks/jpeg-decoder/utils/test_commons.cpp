@@ -10,6 +10,7 @@
 #include <cmath>
 #include <string>
 #include <iostream>
+#include <iterator>
 #include <fstream>
 #include <optional>
 
@@ -86,3 +87,27 @@ void ExpectFail(const std::string& filename) {
     }
     CHECK_THROWS(Decode(fin));
 }
+
+std::vector<uint8_t> ReadTestFile(const std::string& filename) {
+    std::ifstream fin(kBasePath + "tests/" + filename, std::ios::binary);
+    if (!fin.is_open()) {
+        throw std::invalid_argument("Cannot open a file");
+    }
+    return {std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>()};
+}
+
+bool ImagesEqual(const Image& lhs, const Image& rhs) {
+    if (lhs.Width() != rhs.Width() || lhs.Height() != rhs.Height()) {
+        return false;
+    }
+    for (size_t y = 0; y < lhs.Height(); ++y) {
+        for (size_t x = 0; x < lhs.Width(); ++x) {
+            auto a = lhs.GetPixel(y, x);
+            auto b = rhs.GetPixel(y, x);
+            if (a.r != b.r || a.g != b.g || a.b != b.b) {
+                return false;
+            }
+        }
+    }
+    return lhs.GetComment() == rhs.GetComment();
+}
@@ -1,9 +1,21 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <optional>
+#include <vector>
+
+#include "image.h"
 
 void CheckImage(const std::string& filename, const std::string& expected_comment = "",
                 std::optional<std::string> output_filename = std::nullopt);
 
+// Requires the same size and a mean per-pixel RGB distance of at most 5.
+void Compare(const Image& actual, const Image& expected);
+
 void ExpectFail(const std::string& filename);
+
+// Reads a file from the tests directory.
+std::vector<uint8_t> ReadTestFile(const std::string& filename);
+
+bool ImagesEqual(const Image& lhs, const Image& rhs);
@@ -1,40 +1,271 @@
 #include "lru_cache.h"
+
+#include <algorithm>
+#include <bit>
+#include <functional>
 #include <utility>
 
-LruCache::LruCache(size_t max_size) : max_size_(max_size) {
+namespace {
+
+// The window takes 1% of the budget, the protected segment 80% of the rest.
+constexpr size_t kWindowPercent = 1;
+constexpr size_t kProtectedPercent = 80;
+// Sizes the frequency sketch when the cache only has a byte budget.
+constexpr size_t kTypicalEntryBytes = 64;
+constexpr size_t kMaxSketchEntries = 1 << 24;
+constexpr size_t kSketchResetMultiplier = 10;
+
+uint64_t Mix(uint64_t hash) {
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+    return hash;
+}
+
+uint64_t HashOf(const std::string& key) {
+    return Mix(std::hash<std::string_view>{}(key));
+}
+
+size_t Charge(const std::string& key, const std::string& value) {
+    return key.size() + value.size();
+}
+
+// At least one unit of a nonzero limit, so that a tiny cache still has a window.
+size_t Percent(size_t limit, size_t percent) {
+    if (limit == LruCacheOptions::kUnlimited) {
+        return limit;
+    }
+    auto part = limit / 100 * percent + limit % 100 * percent / 100;
+    return std::min(limit, std::max<size_t>(part, 1));
+}
+
+size_t Remainder(size_t limit, size_t part) {
+    return limit == LruCacheOptions::kUnlimited ? limit : limit - part;
+}
+
+// The first |limit % shards| shards get a unit more, so that the shares add up to |limit|.
+size_t Share(size_t limit, size_t shards, size_t index) {
+    if (limit == LruCacheOptions::kUnlimited) {
+        return limit;
+    }
+    return limit / shards + (index < limit % shards);
+}
+
+}  // namespace
+
+FrequencySketch::FrequencySketch(size_t expected_entries) {
+    expected_entries = std::clamp<size_t>(expected_entries, 16, kMaxSketchEntries);
+    // Sixteen 4-bit counters per word, a quarter word (four counters) per expected entry.
+    table_.resize(std::bit_ceil(expected_entries) / 4);
+    sample_limit_ = kSketchResetMultiplier * expected_entries;
+}
+
+std::array<size_t, FrequencySketch::kDepth> FrequencySketch::Counters(uint64_t hash) const {
+    std::array<size_t, kDepth> counters;
+    for (int i = 0; i < kDepth; ++i) {
+        auto row_hash = Mix(hash + (i + 1) * 0x9e3779b97f4a7c15ULL);
+        counters[i] = (row_hash & (table_.size() - 1)) * 16 + (row_hash >> 60);
+    }
+    return counters;
+}
+
+void FrequencySketch::Increment(uint64_t hash) {
+    for (auto counter : Counters(hash)) {
+        auto& word = table_[counter / 16];
+        auto shift = counter % 16 * 4;
+        if (((word >> shift) & 0xf) != 0xf) {
+            word += uint64_t{1} << shift;
+        }
+    }
+    if (++samples_ == sample_limit_) {
+        for (auto& word : table_) {
+            word = (word >> 1) & 0x7777777777777777ULL;
+        }
+        samples_ /= 2;
+    }
+}
+
+int FrequencySketch::Estimate(uint64_t hash) const {
+    int estimate = 0xf;
+    for (auto counter : Counters(hash)) {
+        estimate = std::min<int>(estimate, (table_[counter / 16] >> (counter % 16 * 4)) & 0xf);
+    }
+    return estimate;
+}
+
+LruCache::LruCache(size_t max_size)
+    : LruCache(LruCacheOptions{.max_entries = max_size, .shards = 1}) {
+}
+
+LruCache::LruCache(const LruCacheOptions& options) {
+    // A shard with no entries to hold would only drop the keys hashed to it.
+    auto shards = std::clamp<size_t>(options.shards, 1, std::max<size_t>(options.max_entries, 1));
+    shards_.reserve(shards);
+    for (size_t i = 0; i < shards; ++i) {
+        Usage limit{Share(options.max_entries, shards, i), Share(options.max_bytes, shards, i)};
+        shards_.push_back(std::make_unique<Shard>(limit, options.admission_filter));
+    }
 }
 
 void LruCache::Set(const std::string& key, const std::string& value) {
-    auto map_iter = map_.find(key);
+    auto hash = HashOf(key);
+    ShardOf(hash).Set(key, hash, value);
+}
 
+bool LruCache::Get(const std::string& key, std::string* value) {
+    auto hash = HashOf(key);
+    return ShardOf(hash).Get(key, hash, value);
+}
+
+LruCache::Shard& LruCache::ShardOf(uint64_t hash) {
+    return *shards_[(hash >> 32) % shards_.size()];
+}
+
+LruCache::Shard::Shard(const Usage& limit, bool admission_filter) : limit_(limit) {
+    if (!admission_filter) {
+        window_limit_ = limit;
+        return;
+    }
+
+    window_limit_ = {Percent(limit.entries, kWindowPercent),
+                     Percent(limit.bytes, kWindowPercent)};
+    main_limit_ = {Remainder(limit.entries, window_limit_.entries),
+                   Remainder(limit.bytes, window_limit_.bytes)};
+    protected_limit_ = {Percent(main_limit_.entries, kProtectedPercent),
+                        Percent(main_limit_.bytes, kProtectedPercent)};
+    auto expected_entries = limit.entries;
+    if (expected_entries == LruCacheOptions::kUnlimited) {
+        expected_entries = limit.bytes / kTypicalEntryBytes;
+    }
+    sketch_.emplace(expected_entries);
+}
+
+void LruCache::Shard::Set(const std::string& key, uint64_t hash, const std::string& value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (sketch_) {
+        sketch_->Increment(hash);
+    }
+
+    auto map_iter = map_.find(key);
+    // Storing it would flush the whole shard to no avail.
+    if (Charge(key, value) > limit_.bytes || !limit_.entries) {
+        if (map_iter != map_.end()) {
+            Erase(map_iter->second);
+        }
+        return;
+    }
     if (map_iter != map_.end()) {
-        MoveIterToTheEnd(map_iter);
-        lru_list_.back() = std::tie(key, value);
+        auto entry = map_iter->second;
+        auto& usage = usage_[entry->segment];
+        usage.bytes = usage.bytes - entry->value.size() + value.size();
+        entry->value = value;
+        Touch(entry);
     } else {
-        lru_list_.emplace_back(key, value);
-        map_.insert({key, std::prev(lru_list_.end())});
+        auto& window = lists_[kWindow];
+        window.push_back(Entry{key, value, hash, kWindow});
+        auto entry = std::prev(window.end());
+        map_.emplace(entry->key, entry);
+        ++usage_[kWindow].entries;
+        usage_[kWindow].bytes += Charge(key, value);
     }
+    Evict();
+}
 
-    if (lru_list_.size() > max_size_) {
-        map_.erase(std::get<0>(lru_list_.front()));
-        lru_list_.pop_front();
+bool LruCache::Shard::Get(const std::string& key, uint64_t hash, std::string* value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (sketch_) {
+        sketch_->Increment(hash);
     }
-}
 
-bool LruCache::Get(const std::string& key, std::string* value) {
     auto map_iter = map_.find(key);
+    if (map_iter == map_.end()) {
+        return false;
+    }
+    *value = map_iter->second->value;
+    Touch(map_iter->second);
+    Evict();
+    return true;
+}
 
-    if (map_iter != map_.end()) {
-        MoveIterToTheEnd(map_iter);
-        *value = std::get<1>(*map_iter->second);
-        return true;
+void LruCache::Shard::Touch(TEntryList::iterator entry) {
+    if (entry->segment == kProbation) {
+        MoveTo(entry, kProtected);
+    } else {
+        auto& list = lists_[entry->segment];
+        list.splice(list.end(), list, entry);
+    }
+}
+
+void LruCache::Shard::MoveTo(TEntryList::iterator entry, Segment segment) {
+    auto charge = Charge(entry->key, entry->value);
+    auto& from = usage_[entry->segment];
+    --from.entries;
+    from.bytes -= charge;
+    lists_[segment].splice(lists_[segment].end(), lists_[entry->segment], entry);
+    entry->segment = segment;
+    ++usage_[segment].entries;
+    usage_[segment].bytes += charge;
+}
+
+void LruCache::Shard::Erase(TEntryList::iterator entry) {
+    auto& usage = usage_[entry->segment];
+    --usage.entries;
+    usage.bytes -= Charge(entry->key, entry->value);
+    map_.erase(entry->key);
+    lists_[entry->segment].erase(entry);
+}
+
+// Competes with the least recently used entry of the main cache for every slot it
+// needs there, the more frequently used one stays.
+void LruCache::Shard::Admit(TEntryList::iterator candidate) {
+    Usage needed = MainUsage();
+    ++needed.entries;
+    needed.bytes += Charge(candidate->key, candidate->value);
+    while (needed.Exceeds(main_limit_)) {
+        if (!MainUsage().entries) {
+            Erase(candidate);
+            return;
+        }
+        auto victim = MainVictim();
+        if (sketch_->Estimate(candidate->hash) <= sketch_->Estimate(victim->hash)) {
+            Erase(candidate);
+            return;
+        }
+        --needed.entries;
+        needed.bytes -= Charge(victim->key, victim->value);
+        Erase(victim);
+    }
+    MoveTo(candidate, kProbation);
+}
+
+LruCache::TEntryList::iterator LruCache::Shard::MainVictim() {
+    if (!lists_[kProbation].empty()) {
+        return lists_[kProbation].begin();
+    }
+    return lists_[kProtected].begin();
+}
+
+void LruCache::Shard::Evict() {
+    while (usage_[kWindow].Exceeds(window_limit_)) {
+        auto candidate = lists_[kWindow].begin();
+        if (sketch_) {
+            Admit(candidate);
+        } else {
+            Erase(candidate);
+        }
+    }
+    while (usage_[kProtected].Exceeds(protected_limit_)) {
+        MoveTo(lists_[kProtected].begin(), kProbation);
+    }
+    // Only after a value grew in place.
+    while (MainUsage().Exceeds(main_limit_)) {
+        Erase(MainVictim());
     }
-    return false;
 }
 
-void LruCache::MoveIterToTheEnd(const TLruMap::iterator& map_iter) {
-    auto list_iter = map_iter->second;
-    lru_list_.push_back(*list_iter);
-    map_iter->second = std::prev(lru_list_.end());
-    lru_list_.erase(list_iter);
+LruCache::Usage LruCache::Shard::MainUsage() const {
+    return {usage_[kProbation].entries + usage_[kProtected].entries,
+            usage_[kProbation].bytes + usage_[kProtected].bytes};
 }
@@ -1,25 +1,118 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
 #include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
 
-class LruCache {
+struct LruCacheOptions {
+    static constexpr size_t kUnlimited = std::numeric_limits<size_t>::max();
+
+    // An entry is charged the sizes of its key and value against |max_bytes|.
+    size_t max_entries = kUnlimited;
+    size_t max_bytes = kUnlimited;
+    // Keys are spread by hash over independently locked shards, every shard gets an
+    // equal part of the budgets, give or take one. There are no more shards than
+    // |max_entries|. Eviction is LRU within a shard only.
+    size_t shards = 16;
+    // W-TinyLFU: new entries go to a small LRU window, and one pushed out of it only
+    // replaces an entry of the main cache if it has been used more often recently.
+    // Keeps the hot entries through scans at the cost of a frequency sketch.
+    bool admission_filter = false;
+};
+
+// Count-min sketch of 4-bit counters. All of them are halved every few multiples of
+// the expected entry count, so the estimates favour recent popularity.
+class FrequencySketch {
 public:
-    using TKeyValueList = std::list<std::tuple<std::string, std::string>>;
-    using TLruMap = std::unordered_map<std::string, TKeyValueList::iterator>;
+    explicit FrequencySketch(size_t expected_entries);
+
+    void Increment(uint64_t hash);
+    int Estimate(uint64_t hash) const;
+
+private:
+    static constexpr int kDepth = 4;
+
+    std::array<size_t, kDepth> Counters(uint64_t hash) const;
+
+    std::vector<uint64_t> table_;
+    size_t samples_ = 0;
+    size_t sample_limit_;
+};
 
+class LruCache {
+public:
     LruCache() = delete;
+    // A single shard: exact LRU over |max_size| entries.
     LruCache(size_t max_size);
+    explicit LruCache(const LruCacheOptions& options);
 
+    // Thread-safe.
     void Set(const std::string& key, const std::string& value);
     bool Get(const std::string& key, std::string* value);
 
 private:
-    TLruMap map_;
-    TKeyValueList lru_list_;
+    enum Segment { kWindow, kProbation, kProtected, kSegmentCount };
+
+    struct Entry {
+        std::string key;
+        std::string value;
+        uint64_t hash;
+        Segment segment;
+    };
+    using TEntryList = std::list<Entry>;
+
+    struct Usage {
+        bool Exceeds(const Usage& limit) const {
+            return entries > limit.entries || bytes > limit.bytes;
+        }
+
+        size_t entries = 0;
+        size_t bytes = 0;
+    };
+
+    // Without the admission filter only the window is used and it takes the whole budget.
+    // With it, the main cache is segmented LRU: entries hit while in probation move to
+    // the protected segment, the ones it pushes out go back to probation.
+    class Shard {
+    public:
+        Shard(const Usage& limit, bool admission_filter);
+
+        void Set(const std::string& key, uint64_t hash, const std::string& value);
+        bool Get(const std::string& key, uint64_t hash, std::string* value);
+
+    private:
+        using TEntryMap = std::unordered_map<std::string_view, TEntryList::iterator>;
+
+        void Touch(TEntryList::iterator entry);
+        void MoveTo(TEntryList::iterator entry, Segment segment);
+        void Erase(TEntryList::iterator entry);
+        void Admit(TEntryList::iterator candidate);
+        TEntryList::iterator MainVictim();
+        void Evict();
+        Usage MainUsage() const;
+
+        std::mutex mutex_;
+        // Keys point into the entries, which list splicing never moves.
+        TEntryMap map_;
+        std::array<TEntryList, kSegmentCount> lists_;
+        std::array<Usage, kSegmentCount> usage_;
+        Usage limit_;
+        Usage window_limit_;
+        Usage main_limit_;
+        Usage protected_limit_;
+        std::optional<FrequencySketch> sketch_;
+    };
 
-    void MoveIterToTheEnd(const TLruMap::iterator& list_iter);
+    Shard& ShardOf(uint64_t hash);
 
-    const size_t max_size_;
+    std::vector<std::unique_ptr<Shard>> shards_;
 };
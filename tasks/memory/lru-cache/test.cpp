@@ -2,6 +2,11 @@
 #include <util.h>
 #include <lru_cache.h>
 
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
 TEST_CASE("Set and get", "[LruCache]") {
     LruCache cache(10);
 
@@ -66,3 +71,116 @@ TEST_CASE("Stress", "[LruCache]") {
         }
     }
 }
+
+TEST_CASE("Byte budget", "[LruCache]") {
+    LruCache cache(LruCacheOptions{.max_bytes = 10, .shards = 1});
+    std::string value;
+
+    cache.Set("a", "1234");
+    cache.Set("b", "1234");
+    REQUIRE(cache.Get("a", &value));
+    cache.Set("c", "1");
+    REQUIRE(!cache.Get("b", &value));
+    REQUIRE(cache.Get("a", &value));
+    REQUIRE(cache.Get("c", &value));
+
+    cache.Set("a", "12345678");
+    REQUIRE(!cache.Get("c", &value));
+    REQUIRE(cache.Get("a", &value));
+    REQUIRE("12345678" == value);
+
+    cache.Set("a", std::string(10, 'x'));
+    REQUIRE(!cache.Get("a", &value));
+}
+
+TEST_CASE("Admission filter keeps hot keys through scans", "[LruCache]") {
+    const size_t kHotKeys = 50;
+    auto hit_rate = [&](bool admission_filter) {
+        LruCache cache(LruCacheOptions{
+            .max_entries = 2 * kHotKeys, .shards = 1, .admission_filter = admission_filter});
+        RandomGenerator random;
+        std::string value;
+        int hits = 0;
+        int scan_key = 0;
+        for (size_t i = 0; i < 100000; ++i) {
+            auto key = "hot" + std::to_string(random.GenInt<uint32_t>() % kHotKeys);
+            if (cache.Get(key, &value)) {
+                ++hits;
+            } else {
+                cache.Set(key, "foo");
+            }
+            for (int j = 0; j < 3; ++j) {
+                cache.Set("scan" + std::to_string(scan_key++), "bar");
+            }
+        }
+        return hits / 100000.;
+    };
+
+    auto lru = hit_rate(false);
+    auto tiny_lfu = hit_rate(true);
+    REQUIRE(tiny_lfu > 0.9);
+    REQUIRE(tiny_lfu > lru + 0.2);
+}
+
+TEST_CASE("Concurrent shards", "[LruCache]") {
+    const size_t kThreads = 8;
+    const size_t kKeys = 2000;
+    for (bool admission_filter : {false, true}) {
+        LruCache cache(LruCacheOptions{
+            .max_entries = kKeys / 2, .shards = 8, .admission_filter = admission_filter});
+        std::atomic<int> mismatches = 0;
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < kThreads; ++i) {
+            threads.emplace_back([&cache, &mismatches, i] {
+                RandomGenerator random(i);
+                std::string value;
+                for (size_t j = 0; j < 20000; ++j) {
+                    auto key = std::to_string(random.GenInt<uint32_t>() % kKeys);
+                    if (!cache.Get(key, &value)) {
+                        cache.Set(key, key + "!");
+                    } else if (value != key + "!") {
+                        ++mismatches;
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        REQUIRE(mismatches == 0);
+
+        size_t found = 0;
+        std::string value;
+        for (size_t i = 0; i < kKeys; ++i) {
+            auto key = std::to_string(i);
+            if (cache.Get(key, &value)) {
+                REQUIRE(value == key + "!");
+                ++found;
+            }
+        }
+        REQUIRE(found > 0);
+        REQUIRE(found <= kKeys / 2);
+    }
+}
+
+TEST_CASE("Shards stay within the budgets", "[LruCache]") {
+    LruCache by_entries(LruCacheOptions{.max_entries = 10, .shards = 16});
+    LruCache by_bytes(LruCacheOptions{.max_bytes = 20, .shards = 16});
+    // Every key charges two bytes.
+    for (int i = 10; i < 100; ++i) {
+        by_entries.Set(std::to_string(i), "");
+        by_bytes.Set(std::to_string(i), "");
+    }
+
+    size_t entries = 0;
+    size_t bytes = 0;
+    std::string value;
+    for (int i = 10; i < 100; ++i) {
+        entries += by_entries.Get(std::to_string(i), &value);
+        bytes += 2 * by_bytes.Get(std::to_string(i), &value);
+    }
+    REQUIRE(entries > 0);
+    REQUIRE(entries <= 10);
+    REQUIRE(bytes > 0);
+    REQUIRE(bytes <= 20);
+}
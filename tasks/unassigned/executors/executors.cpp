@@ -1 +1,856 @@
 #include <executors.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <queue>
+#include <thread>
+
+struct Task::Subscriber {
+    static void* operator new(size_t size) {
+        return executors_internal::AllocateBlock(size);
+    }
+
+    static void operator delete(void* block, size_t size) {
+        executors_internal::DeallocateBlock(block, size);
+    }
+
+    std::shared_ptr<Task> task;
+    bool trigger;
+    Subscriber* next = nullptr;
+};
+
+namespace executors_internal {
+
+namespace {
+
+constexpr size_t kCacheLineSize = 64;
+constexpr size_t kSizeClasses = kMaxPooledSize / kBlockGranularity;
+// The blocks a thread trades with the shared list at a time, and gets from malloc at once.
+constexpr size_t kBlockBatch = 64;
+
+// Blocks of a batch are chained through |next|, the batches of a list through the
+// |next_batch| of their first block.
+struct FreeBlock {
+    FreeBlock* next;
+    FreeBlock* next_batch;
+    size_t count;
+};
+
+static_assert(sizeof(FreeBlock) <= kBlockGranularity);
+
+class SharedFreeList {
+public:
+    void PushBatch(FreeBlock* batch) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        batch->next_batch = batches_;
+        batches_ = batch;
+    }
+
+    FreeBlock* PopBatch() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto* batch = batches_;
+        if (batch) {
+            batches_ = batch->next_batch;
+        }
+        return batch;
+    }
+
+private:
+    std::mutex mutex_;
+    FreeBlock* batches_ = nullptr;
+};
+
+// Never destroyed, blocks may still be freed while the statics go away.
+SharedFreeList* SharedFreeLists() {
+    static auto* lists = new SharedFreeList[kSizeClasses];
+    return lists;
+}
+
+class ThreadCache {
+public:
+    ~ThreadCache() {
+        for (size_t size_class = 0; size_class < kSizeClasses; ++size_class) {
+            if (auto* head = heads_[size_class]) {
+                head->count = counts_[size_class];
+                SharedFreeLists()[size_class].PushBatch(head);
+                heads_[size_class] = nullptr;
+                counts_[size_class] = 0;
+            }
+        }
+    }
+
+    void* Allocate(size_t size_class) {
+        auto*& head = heads_[size_class];
+        if (!head) {
+            head = SharedFreeLists()[size_class].PopBatch();
+            counts_[size_class] = head ? head->count : 0;
+        }
+        if (!head) {
+            head = Carve(size_class);
+            counts_[size_class] = kBlockBatch;
+        }
+        auto* block = head;
+        head = block->next;
+        --counts_[size_class];
+        return block;
+    }
+
+    // Keeps up to two batches, so that a thread which allocates and frees by turns doesn't
+    // trade a batch back and forth on every call.
+    void Deallocate(void* block, size_t size_class) {
+        auto* free_block = static_cast<FreeBlock*>(block);
+        auto*& head = heads_[size_class];
+        free_block->next = head;
+        head = free_block;
+        if (++counts_[size_class] < 2 * kBlockBatch) {
+            return;
+        }
+        auto* last = head;
+        for (size_t i = 1; i < kBlockBatch; ++i) {
+            last = last->next;
+        }
+        auto* batch = head;
+        head = last->next;
+        last->next = nullptr;
+        batch->count = kBlockBatch;
+        counts_[size_class] -= kBlockBatch;
+        SharedFreeLists()[size_class].PushBatch(batch);
+    }
+
+private:
+    static FreeBlock* Carve(size_t size_class) {
+        auto block_size = (size_class + 1) * kBlockGranularity;
+        auto* chunk = static_cast<char*>(::operator new(block_size * kBlockBatch));
+        FreeBlock* head = nullptr;
+        for (size_t i = kBlockBatch; i-- > 0;) {
+            auto* block = reinterpret_cast<FreeBlock*>(chunk + i * block_size);
+            block->next = head;
+            head = block;
+        }
+        return head;
+    }
+
+    FreeBlock* heads_[kSizeClasses] = {};
+    size_t counts_[kSizeClasses] = {};
+};
+
+thread_local ThreadCache thread_cache;
+
+// A queue of pointers on a ring which doubles when full and never shrinks, unlike
+// std::deque, which allocates and frees its chunks as it moves along.
+class RingQueue {
+public:
+    bool IsEmpty() const {
+        return size_ == 0;
+    }
+
+    size_t Size() const {
+        return size_;
+    }
+
+    void Push(Task* task) {
+        if (size_ == slots_.size()) {
+            Grow();
+        }
+        slots_[(head_ + size_) & (slots_.size() - 1)] = task;
+        ++size_;
+    }
+
+    Task* Pop() {
+        auto* task = slots_[head_];
+        head_ = (head_ + 1) & (slots_.size() - 1);
+        --size_;
+        return task;
+    }
+
+private:
+    void Grow() {
+        std::vector<Task*> grown(slots_.empty() ? kInitialCapacity : 2 * slots_.size());
+        for (size_t i = 0; i < size_; ++i) {
+            grown[i] = slots_[(head_ + i) & (slots_.size() - 1)];
+        }
+        slots_.swap(grown);
+        head_ = 0;
+    }
+
+    static constexpr size_t kInitialCapacity = 256;
+
+    std::vector<Task*> slots_;
+    size_t head_ = 0;
+    size_t size_ = 0;
+};
+
+// The deque of Chase and Lev with the memory orders of Lê et al., "Correct and Efficient
+// Work-Stealing for Weak Memory Models". The owner pushes and pops at the bottom, thieves
+// steal from the top, only the last element is contended. Outgrown buffers are kept until
+// the deque dies, since a thief may still be reading one.
+class WorkStealingDeque {
+public:
+    WorkStealingDeque() {
+        buffers_.push_back(std::make_unique<Buffer>(kInitialCapacity));
+        buffer_.store(buffers_.back().get(), std::memory_order_relaxed);
+    }
+
+    // Owner only.
+    void Push(Task* task) {
+        auto bottom = bottom_.load(std::memory_order_relaxed);
+        auto top = top_.load(std::memory_order_acquire);
+        auto* buffer = buffer_.load(std::memory_order_relaxed);
+        if (bottom - top > buffer->mask) {
+            buffer = Grow(buffer, top, bottom);
+        }
+        buffer->Put(bottom, task);
+        bottom_.store(bottom + 1, std::memory_order_release);
+    }
+
+    // Owner only.
+    Task* Pop() {
+        auto bottom = bottom_.load(std::memory_order_relaxed) - 1;
+        auto* buffer = buffer_.load(std::memory_order_relaxed);
+        bottom_.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto top = top_.load(std::memory_order_relaxed);
+        if (top > bottom) {
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        auto* task = buffer->Get(bottom);
+        if (top == bottom) {
+            // The last one, a thief may be taking it as well.
+            if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                              std::memory_order_relaxed)) {
+                task = nullptr;
+            }
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return task;
+    }
+
+    // Also returns nullptr if another thief got there first.
+    Task* Steal() {
+        auto top = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto bottom = bottom_.load(std::memory_order_acquire);
+        if (top >= bottom) {
+            return nullptr;
+        }
+        auto* task = buffer_.load(std::memory_order_acquire)->Get(top);
+        if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                          std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return task;
+    }
+
+    bool IsEmpty() const {
+        return top_.load(std::memory_order_acquire) >= bottom_.load(std::memory_order_acquire);
+    }
+
+private:
+    static constexpr int64_t kInitialCapacity = 256;
+
+    struct Buffer {
+        explicit Buffer(int64_t capacity)
+            : mask(capacity - 1), slots(std::make_unique<std::atomic<Task*>[]>(capacity)) {
+        }
+
+        Task* Get(int64_t index) const {
+            return slots[index & mask].load(std::memory_order_relaxed);
+        }
+
+        void Put(int64_t index, Task* task) {
+            slots[index & mask].store(task, std::memory_order_relaxed);
+        }
+
+        const int64_t mask;
+        const std::unique_ptr<std::atomic<Task*>[]> slots;
+    };
+
+    Buffer* Grow(Buffer* buffer, int64_t top, int64_t bottom) {
+        buffers_.push_back(std::make_unique<Buffer>(2 * (buffer->mask + 1)));
+        auto* grown = buffers_.back().get();
+        for (auto i = top; i < bottom; ++i) {
+            grown->Put(i, buffer->Get(i));
+        }
+        buffer_.store(grown, std::memory_order_release);
+        return grown;
+    }
+
+    alignas(kCacheLineSize) std::atomic<int64_t> top_ = 0;
+    alignas(kCacheLineSize) std::atomic<int64_t> bottom_ = 0;
+    std::atomic<Buffer*> buffer_;
+    std::vector<std::unique_ptr<Buffer>> buffers_;
+};
+
+}  // namespace
+
+class ThreadPool : public Executor {
+public:
+    explicit ThreadPool(int num_threads) {
+        workers_.reserve(num_threads);
+        idle_.reserve(num_threads);
+        for (int i = 0; i < num_threads; ++i) {
+            workers_.push_back(std::make_unique<Worker>(this, i));
+        }
+        for (auto& worker : workers_) {
+            worker->thread = std::thread([this, worker = worker.get()] { WorkerLoop(*worker); });
+        }
+        timer_thread_ = std::thread([this] { TimerLoop(); });
+    }
+
+    ~ThreadPool() override {
+        StartShutdown();
+        WaitShutdown();
+    }
+
+    void Submit(std::shared_ptr<Task> task) override {
+        if (shutdown_.load(std::memory_order_acquire)) {
+            task->Cancel();
+            return;
+        }
+        // Any event may be the one to schedule the task, even if it is ready already.
+        if (task->has_dependencies_ || task->has_triggers_ || task->time_trigger_) {
+            task->executor_ = this;
+            task->weak_executor_ = weak_from_this();
+        }
+        int expected = Task::kIdle;
+        if (!task->state_.compare_exchange_strong(expected, Task::kSubmitted)) {
+            // Canceled already.
+            return;
+        }
+        // Sequentially consistent with Task::Satisfy: either the task sees the last event
+        // here or the event sees it submitted.
+        if (task->IsReady()) {
+            if (task->Claim()) {
+                Schedule(std::move(task));
+            }
+        } else if (task->time_trigger_) {
+            AddTimer(std::move(task));
+        }
+    }
+
+    void StartShutdown() override {
+        shutdown_.store(true);
+        {
+            std::lock_guard<std::mutex> lock(timer_mutex_);
+        }
+        timer_condvar_.notify_all();
+        std::vector<Worker*> idle;
+        {
+            std::lock_guard<std::mutex> lock(idle_mutex_);
+            idle.swap(idle_);
+            idle_count_.store(0, std::memory_order_relaxed);
+            for (auto* worker : idle) {
+                worker->sleeping.store(false, std::memory_order_release);
+            }
+        }
+        for (auto* worker : idle) {
+            worker->sleeping.notify_one();
+        }
+    }
+
+    // Whatever is still queued once the threads are gone gets canceled.
+    void WaitShutdown() override {
+        std::lock_guard<std::mutex> lock(join_mutex_);
+        if (joined_) {
+            return;
+        }
+        for (auto& worker : workers_) {
+            worker->thread.join();
+        }
+        timer_thread_.join();
+        joined_ = true;
+
+        RingQueue injected;
+        {
+            std::lock_guard<std::mutex> inject_lock(inject_mutex_);
+            inject_closed_ = true;
+            std::swap(injected, injected_);
+        }
+        while (!injected.IsEmpty()) {
+            CancelQueued(injected.Pop());
+        }
+        for (auto& worker : workers_) {
+            while (auto* task = worker->deque.Pop()) {
+                CancelQueued(task);
+            }
+        }
+        while (!timers_.empty()) {
+            timers_.top().task->Cancel();
+            timers_.pop();
+        }
+    }
+
+    // Schedules a task that an event made ready, unless its executor is gone.
+    static void ScheduleReady(std::shared_ptr<Task> task) {
+        if (current_worker && current_worker->pool == task->executor_) {
+            current_worker->pool->Schedule(std::move(task));
+        } else if (auto executor = task->weak_executor_.lock()) {
+            static_cast<ThreadPool*>(executor.get())->Schedule(std::move(task));
+        } else {
+            task->Cancel();
+        }
+    }
+
+    // Runs tasks of the pool until |task| finishes, so that a worker waiting for a task it
+    // has forked doesn't leave the pool a thread short or, with every worker waiting, stuck.
+    // The worker's own deque comes first, and a forked task nobody has stolen is at its
+    // bottom: usually the worker just runs that one. Sleeps only once no task is left to
+    // take, then the awaited one is running elsewhere. Returns false unless called on a
+    // worker.
+    static bool HelpUntilFinished(Task& task) {
+        auto* worker = current_worker;
+        if (!worker) {
+            return false;
+        }
+        int rounds = 0;
+        for (auto state = task.state_.load(std::memory_order_acquire); state < Task::kCompleted;
+             state = task.state_.load(std::memory_order_acquire)) {
+            if (auto* other = worker->pool->FindTask(*worker)) {
+                worker->pool->Run(other);
+                rounds = 0;
+            } else if (++rounds < kSpinRounds) {
+                std::this_thread::yield();
+            } else {
+                task.state_.wait(state, std::memory_order_acquire);
+            }
+        }
+        return true;
+    }
+
+private:
+    static constexpr int kSpinRounds = 16;
+    static constexpr size_t kInjectBatch = 32;
+
+    struct alignas(kCacheLineSize) Worker {
+        Worker(ThreadPool* pool, uint64_t index) : pool(pool), random(index * 2 + 1) {
+        }
+
+        // xorshift64
+        uint64_t NextRandom() {
+            random ^= random << 13;
+            random ^= random >> 7;
+            random ^= random << 17;
+            return random;
+        }
+
+        ThreadPool* const pool;
+        WorkStealingDeque deque;
+        // Set while the worker is in idle_.
+        std::atomic<bool> sleeping = false;
+        uint64_t random;
+        std::thread thread;
+    };
+
+    struct Timer {
+        std::chrono::system_clock::time_point at;
+        std::shared_ptr<Task> task;
+
+        bool operator>(const Timer& other) const {
+            return at > other.at;
+        }
+    };
+
+    static inline thread_local Worker* current_worker = nullptr;
+
+    // Takes a claimed task. Workers of the pool push it onto their own deque, others go
+    // through the shared queue.
+    void Schedule(std::shared_ptr<Task> task) {
+        auto* raw = task.get();
+        raw->self_ = std::move(task);
+        if (current_worker && current_worker->pool == this) {
+            current_worker->deque.Push(raw);
+        } else {
+            std::unique_lock<std::mutex> lock(inject_mutex_);
+            if (inject_closed_) {
+                lock.unlock();
+                CancelQueued(raw);
+                return;
+            }
+            injected_.Push(raw);
+            injected_count_.store(injected_.Size(), std::memory_order_relaxed);
+        }
+        WakeOne();
+    }
+
+    static void CancelQueued(Task* raw) {
+        auto task = std::move(raw->self_);
+        task->Cancel();
+    }
+
+    void WorkerLoop(Worker& worker) {
+        current_worker = &worker;
+        while (!shutdown_.load(std::memory_order_acquire)) {
+            if (auto* task = FindTask(worker)) {
+                Run(task);
+            } else {
+                Idle(worker);
+            }
+        }
+    }
+
+    Task* FindTask(Worker& worker) {
+        if (auto* task = worker.deque.Pop()) {
+            return task;
+        }
+        if (auto* task = TakeInjected(worker)) {
+            return task;
+        }
+        auto count = workers_.size();
+        auto start = worker.NextRandom() % count;
+        for (size_t i = 0; i < count; ++i) {
+            auto& victim = *workers_[(start + i) % count];
+            if (&victim == &worker) {
+                continue;
+            }
+            if (auto* task = victim.deque.Steal()) {
+                return task;
+            }
+        }
+        return nullptr;
+    }
+
+    // Moves a batch of the shared queue over to the worker's deque, where the others can
+    // steal it, rather than having every worker take the lock for every task.
+    Task* TakeInjected(Worker& worker) {
+        if (!injected_count_.load(std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        std::unique_lock<std::mutex> lock(inject_mutex_);
+        if (injected_.IsEmpty()) {
+            return nullptr;
+        }
+        auto batch = std::min(injected_.Size(), kInjectBatch);
+        auto* task = injected_.Pop();
+        for (size_t i = 1; i < batch; ++i) {
+            worker.deque.Push(injected_.Pop());
+        }
+        injected_count_.store(injected_.Size(), std::memory_order_relaxed);
+        lock.unlock();
+        if (batch > 1) {
+            WakeOne();
+        }
+        return task;
+    }
+
+    bool HasWork() const {
+        if (injected_count_.load(std::memory_order_acquire)) {
+            return true;
+        }
+        for (auto& worker : workers_) {
+            if (!worker->deque.IsEmpty()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Run(Task* raw) {
+        auto task = std::move(raw->self_);
+        int expected = Task::kScheduled;
+        if (!task->state_.compare_exchange_strong(expected, Task::kRunning,
+                                                  std::memory_order_acquire)) {
+            // Canceled while in the queue.
+            return;
+        }
+        int state = Task::kCompleted;
+        try {
+            task->Run();
+        } catch (...) {
+            task->error_ = std::current_exception();
+            state = Task::kFailed;
+        }
+        task->state_.store(state, std::memory_order_release);
+        task->Finish();
+    }
+
+    // Spins for a while, then puts the worker into idle_ and sleeps until WakeOne takes it
+    // out. The worker registers before it looks for work, and WakeOne looks for registered
+    // workers after the work is published, both sequentially consistent: either the worker
+    // sees the work or WakeOne sees the worker.
+    void Idle(Worker& worker) {
+        for (int i = 0; i < kSpinRounds; ++i) {
+            std::this_thread::yield();
+            if (HasWork() || shutdown_.load(std::memory_order_relaxed)) {
+                return;
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(idle_mutex_);
+            worker.sleeping.store(true, std::memory_order_relaxed);
+            idle_.push_back(&worker);
+            idle_count_.fetch_add(1);
+        }
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (HasWork() || shutdown_.load()) {
+            std::lock_guard<std::mutex> lock(idle_mutex_);
+            if (worker.sleeping.load(std::memory_order_relaxed)) {
+                idle_.erase(std::find(idle_.begin(), idle_.end(), &worker));
+                idle_count_.fetch_sub(1, std::memory_order_relaxed);
+                worker.sleeping.store(false, std::memory_order_relaxed);
+            }
+            return;
+        }
+        worker.sleeping.wait(true, std::memory_order_acquire);
+    }
+
+    // Wakes one sleeping worker, if any, after new work is published.
+    void WakeOne() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!idle_count_.load(std::memory_order_relaxed)) {
+            return;
+        }
+        Worker* worker;
+        {
+            std::lock_guard<std::mutex> lock(idle_mutex_);
+            if (idle_.empty()) {
+                return;
+            }
+            worker = idle_.back();
+            idle_.pop_back();
+            idle_count_.fetch_sub(1, std::memory_order_relaxed);
+            worker->sleeping.store(false, std::memory_order_release);
+        }
+        worker->sleeping.notify_one();
+    }
+
+    void AddTimer(std::shared_ptr<Task> task) {
+        auto at = *task->time_trigger_;
+        bool earliest;
+        {
+            std::lock_guard<std::mutex> lock(timer_mutex_);
+            earliest = timers_.empty() || at < timers_.top().at;
+            timers_.push({at, std::move(task)});
+        }
+        if (earliest) {
+            timer_condvar_.notify_one();
+        }
+    }
+
+    // Hands the due tasks over to the shared queue in one go.
+    void TimerLoop() {
+        std::unique_lock<std::mutex> lock(timer_mutex_);
+        std::vector<std::shared_ptr<Task>> due;
+        while (!shutdown_.load()) {
+            if (timers_.empty()) {
+                timer_condvar_.wait(lock);
+                continue;
+            }
+            auto now = std::chrono::system_clock::now();
+            if (timers_.top().at > now) {
+                timer_condvar_.wait_until(lock, timers_.top().at);
+                continue;
+            }
+            while (!timers_.empty() && timers_.top().at <= now) {
+                // The top is const, the entry is dropped right after.
+                due.push_back(std::move(const_cast<Timer&>(timers_.top()).task));
+                timers_.pop();
+            }
+            lock.unlock();
+            InjectDue(due);
+            due.clear();
+            lock.lock();
+        }
+    }
+
+    void InjectDue(std::vector<std::shared_ptr<Task>>& due) {
+        size_t count = 0;
+        {
+            std::unique_lock<std::mutex> lock(inject_mutex_);
+            for (auto& task : due) {
+                if (!task->Claim()) {
+                    continue;
+                }
+                auto* raw = task.get();
+                raw->self_ = std::move(task);
+                if (inject_closed_) {
+                    lock.unlock();
+                    CancelQueued(raw);
+                    lock.lock();
+                    continue;
+                }
+                injected_.Push(raw);
+                ++count;
+            }
+            injected_count_.store(injected_.Size(), std::memory_order_relaxed);
+        }
+        for (size_t i = 0; i < std::min(count, workers_.size()); ++i) {
+            WakeOne();
+        }
+    }
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<bool> shutdown_ = false;
+
+    std::mutex inject_mutex_;
+    RingQueue injected_;
+    // The size of injected_, read without the lock.
+    std::atomic<size_t> injected_count_ = 0;
+    bool inject_closed_ = false;
+
+    std::mutex idle_mutex_;
+    std::vector<Worker*> idle_;
+    std::atomic<size_t> idle_count_ = 0;
+
+    std::mutex timer_mutex_;
+    std::condition_variable timer_condvar_;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers_;
+    std::thread timer_thread_;
+
+    std::mutex join_mutex_;
+    bool joined_ = false;
+};
+
+}  // namespace executors_internal
+
+Task::~Task() {
+    auto* subscriber = subscribers_.load(std::memory_order_relaxed);
+    while (subscriber && subscriber != Closed()) {
+        auto* next = subscriber->next;
+        delete subscriber;
+        subscriber = next;
+    }
+}
+
+void Task::AddDependency(std::shared_ptr<Task> dep) {
+    has_dependencies_ = true;
+    pending_dependencies_.fetch_add(1, std::memory_order_relaxed);
+    if (!dep->Subscribe(shared_from_this(), false)) {
+        pending_dependencies_.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+void Task::AddTrigger(std::shared_ptr<Task> dep) {
+    has_triggers_ = true;
+    if (!dep->Subscribe(shared_from_this(), true)) {
+        triggered_.store(true, std::memory_order_relaxed);
+    }
+}
+
+void Task::SetTimeTrigger(std::chrono::system_clock::time_point at) {
+    time_trigger_ = at;
+}
+
+bool Task::IsCompleted() {
+    return state_.load(std::memory_order_acquire) == kCompleted;
+}
+
+bool Task::IsFailed() {
+    return state_.load(std::memory_order_acquire) == kFailed;
+}
+
+bool Task::IsCanceled() {
+    return state_.load(std::memory_order_acquire) == kCanceled;
+}
+
+bool Task::IsFinished() {
+    return state_.load(std::memory_order_acquire) >= kCompleted;
+}
+
+std::exception_ptr Task::GetError() {
+    return IsFailed() ? error_ : nullptr;
+}
+
+void Task::Cancel() {
+    auto state = state_.load(std::memory_order_relaxed);
+    do {
+        if (state >= kRunning) {
+            return;
+        }
+    } while (!state_.compare_exchange_weak(state, kCanceled, std::memory_order_acq_rel));
+    Finish();
+}
+
+void Task::Wait() {
+    for (auto state = state_.load(std::memory_order_acquire); state < kCompleted;
+         state = state_.load(std::memory_order_acquire)) {
+        state_.wait(state, std::memory_order_acquire);
+    }
+}
+
+Task::Subscriber* Task::Closed() {
+    static Subscriber closed{nullptr, false};
+    return &closed;
+}
+
+bool Task::Subscribe(std::shared_ptr<Task> task, bool trigger) {
+    auto* subscriber = new Subscriber{std::move(task), trigger};
+    auto* head = subscribers_.load(std::memory_order_relaxed);
+    do {
+        if (head == Closed()) {
+            delete subscriber;
+            return false;
+        }
+        subscriber->next = head;
+    } while (!subscribers_.compare_exchange_weak(head, subscriber, std::memory_order_release,
+                                                 std::memory_order_relaxed));
+    return true;
+}
+
+bool Task::IsReady() const {
+    if (triggered_.load()) {
+        return true;
+    }
+    if (has_dependencies_) {
+        return pending_dependencies_.load() == 0;
+    }
+    return !has_triggers_ && !time_trigger_;
+}
+
+bool Task::Satisfy(bool trigger) {
+    if (trigger) {
+        triggered_.store(true);
+    } else if (pending_dependencies_.fetch_sub(1) != 1) {
+        return false;
+    }
+    return Claim();
+}
+
+bool Task::Claim() {
+    int expected = kSubmitted;
+    return state_.compare_exchange_strong(expected, kScheduled);
+}
+
+void Task::Finish() {
+    state_.notify_all();
+    auto* subscriber = subscribers_.exchange(Closed(), std::memory_order_acquire);
+    while (subscriber) {
+        auto* next = subscriber->next;
+        if (subscriber->task->Satisfy(subscriber->trigger)) {
+            executors_internal::ThreadPool::ScheduleReady(std::move(subscriber->task));
+        }
+        delete subscriber;
+        subscriber = next;
+    }
+}
+
+namespace executors_internal {
+
+void* AllocateBlock(size_t size) {
+    if (size > kMaxPooledSize) {
+        return ::operator new(size);
+    }
+    return thread_cache.Allocate((size - 1) / kBlockGranularity);
+}
+
+void DeallocateBlock(void* block, size_t size) {
+    if (size > kMaxPooledSize) {
+        ::operator delete(block);
+        return;
+    }
+    thread_cache.Deallocate(block, (size - 1) / kBlockGranularity);
+}
+
+void HelpWait(Task& task) {
+    if (!ThreadPool::HelpUntilFinished(task)) {
+        task.Wait();
+    }
+}
+
+}  // namespace executors_internal
+
+std::shared_ptr<Executor> MakeThreadPoolExecutor(int num_threads) {
+    return std::make_shared<executors_internal::ThreadPool>(num_threads);
+}
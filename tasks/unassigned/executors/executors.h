@@ -1,12 +1,29 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
 #include <memory>
 #include <chrono>
+#include <exception>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <utility>
 #include <vector>
 #include <functional>
 
+class Executor;
+
+namespace executors_internal {
+class ThreadPool;
+}  // namespace executors_internal
+
+// A task waits for its dependencies, triggers and time trigger through counters of its own:
+// whichever thread finishes the last dependency or the first trigger moves it to a queue, no
+// lock shared by the tasks is involved. Dependencies and triggers are added before Submit.
 class Task : public std::enable_shared_from_this<Task> {
 public:
-    virtual ~Task() {
-    }
+    virtual ~Task();
 
     virtual void Run() = 0;
 
@@ -33,6 +50,45 @@ public:
     void Wait();
 
 private:
+    friend class executors_internal::ThreadPool;
+
+    enum State : int { kIdle, kSubmitted, kScheduled, kRunning, kCompleted, kFailed, kCanceled };
+
+    // The tasks to tell once this one finishes. Pushed onto a lock-free stack, which Finish
+    // closes for good.
+    struct Subscriber;
+
+    static Subscriber* Closed();
+
+    // Returns false if the task has already finished.
+    bool Subscribe(std::shared_ptr<Task> task, bool trigger);
+
+    // Whether the task may start as soon as it is submitted.
+    bool IsReady() const;
+
+    // Counts a dependency or trigger of the task as finished. Returns true if the call made
+    // the task ready, the caller is then the one to schedule it.
+    bool Satisfy(bool trigger);
+
+    // Takes a submitted task over for scheduling, exactly one of the racing callers succeeds.
+    bool Claim();
+
+    // Wakes the waiting threads and lets the subscribers know, the state is final by now.
+    void Finish();
+
+    std::atomic<int> state_ = kIdle;
+    std::atomic<int> pending_dependencies_ = 0;
+    std::atomic<bool> triggered_ = false;
+    bool has_dependencies_ = false;
+    bool has_triggers_ = false;
+    std::optional<std::chrono::system_clock::time_point> time_trigger_;
+    std::atomic<Subscriber*> subscribers_ = nullptr;
+    std::exception_ptr error_;
+    // The executor of a submitted task that any event may make ready.
+    Executor* executor_ = nullptr;
+    std::weak_ptr<Executor> weak_executor_;
+    // Keeps the task alive while a queue holds a plain pointer to it.
+    std::shared_ptr<Task> self_;
 };
 
 template <class T>
@@ -44,18 +100,23 @@ using FuturePtr = std::shared_ptr<Future<T>>;
 // Used instead of void in generic code
 struct Unit {};
 
-class Executor {
+// Must be owned by a std::shared_ptr, tasks that wait for something hold on to it weakly.
+class Executor : public std::enable_shared_from_this<Executor> {
 public:
-    void Submit(std::shared_ptr<Task> task);
+    virtual ~Executor() {
+    }
 
-    void StartShutdown();
-    void WaitShutdown();
+    virtual void Submit(std::shared_ptr<Task> task) = 0;
 
-    template <class T>
-    FuturePtr<T> Invoke(std::function<T()> fn);
+    virtual void StartShutdown() = 0;
+    virtual void WaitShutdown() = 0;
 
-    template <class Y, class T>
-    FuturePtr<Y> Then(FuturePtr<T> input, std::function<Y()> fn);
+    // The callable is kept inline in the future rather than in a std::function.
+    template <class T, class Func>
+    FuturePtr<T> Invoke(Func fn);
+
+    template <class Y, class T, class Func>
+    FuturePtr<Y> Then(FuturePtr<T> input, Func fn);
 
     template <class T>
     FuturePtr<std::vector<T>> WhenAll(std::vector<FuturePtr<T>> all);
@@ -68,12 +129,201 @@ public:
                                                     std::chrono::system_clock::time_point deadline);
 };
 
+// Every worker runs the tasks of its own Chase-Lev deque and steals from a random other one
+// once it runs dry. Tasks submitted from outside the pool and those whose time has come go
+// through a shared queue, time triggers wait in a heap served by a thread of its own.
 std::shared_ptr<Executor> MakeThreadPoolExecutor(int num_threads);
 
 template <class T>
 class Future : public Task {
 public:
-    T Get();
+    // Rethrows the error of a failed future, throws std::runtime_error for a canceled one.
+    T Get() {
+        Wait();
+        if (IsFailed()) {
+            std::rethrow_exception(GetError());
+        }
+        if (IsCanceled()) {
+            throw std::runtime_error("Future is canceled");
+        }
+        return *value_;
+    }
+
+protected:
+    void SetValue(T value) {
+        value_.emplace(std::move(value));
+    }
 
 private:
+    std::optional<T> value_;
 };
+
+namespace executors_internal {
+
+// Blocks of up to kMaxPooledSize bytes come in size classes of kBlockGranularity bytes and
+// are recycled through per-thread caches, which trade batches of them with a list shared
+// by the threads: blocks freed on the workers find their way back to the thread that
+// submits. Memory is never given back to the system.
+inline constexpr size_t kBlockGranularity = 32;
+inline constexpr size_t kMaxPooledSize = 512;
+
+void* AllocateBlock(size_t size);
+void DeallocateBlock(void* block, size_t size);
+
+// Waits for |task| like Task::Wait, but on a worker of a pool runs the pool's tasks
+// meanwhile, for fork-join code which waits for the tasks it has forked.
+void HelpWait(Task& task);
+
+template <class T>
+class PoolAllocator {
+public:
+    using value_type = T;
+
+    PoolAllocator() = default;
+
+    template <class U>
+    PoolAllocator(const PoolAllocator<U>&) {
+    }
+
+    T* allocate(size_t n) {
+        if constexpr (alignof(T) > alignof(std::max_align_t)) {
+            return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(alignof(T))));
+        } else {
+            return static_cast<T*>(AllocateBlock(n * sizeof(T)));
+        }
+    }
+
+    void deallocate(T* p, size_t n) {
+        if constexpr (alignof(T) > alignof(std::max_align_t)) {
+            ::operator delete(p, std::align_val_t(alignof(T)));
+        } else {
+            DeallocateBlock(p, n * sizeof(T));
+        }
+    }
+
+    template <class U>
+    bool operator==(const PoolAllocator<U>&) const {
+        return true;
+    }
+};
+
+template <class T, class Func>
+class FunctionFuture : public Future<T> {
+public:
+    explicit FunctionFuture(Func fn) : fn_(std::move(fn)) {
+    }
+
+    void Run() override {
+        this->SetValue(fn_());
+    }
+
+private:
+    Func fn_;
+};
+
+template <class T>
+class AllFuture : public Future<std::vector<T>> {
+public:
+    explicit AllFuture(std::vector<FuturePtr<T>> all) : all_(std::move(all)) {
+    }
+
+    // Either all of the futures have finished or the deadline has come, then only the
+    // completed ones are collected.
+    void Run() override {
+        std::vector<T> values;
+        values.reserve(all_.size());
+        for (auto& future : all_) {
+            if (!only_completed_ || future->IsCompleted()) {
+                values.push_back(future->Get());
+            }
+        }
+        this->SetValue(std::move(values));
+    }
+
+    void CollectOnlyCompleted() {
+        only_completed_ = true;
+    }
+
+private:
+    std::vector<FuturePtr<T>> all_;
+    bool only_completed_ = false;
+};
+
+template <class T>
+class FirstFuture : public Future<T> {
+public:
+    explicit FirstFuture(std::vector<FuturePtr<T>> all) : all_(std::move(all)) {
+    }
+
+    void Run() override {
+        for (auto& future : all_) {
+            if (future->IsFinished()) {
+                this->SetValue(future->Get());
+                return;
+            }
+        }
+        throw std::logic_error("WhenFirst of no futures");
+    }
+
+private:
+    std::vector<FuturePtr<T>> all_;
+};
+
+}  // namespace executors_internal
+
+// Puts the task together with its reference counts into one block of the pool, which the
+// combinators use for their futures.
+template <class T, class... Args>
+std::shared_ptr<T> MakeTask(Args&&... args) {
+    return std::allocate_shared<T>(executors_internal::PoolAllocator<T>(),
+                                   std::forward<Args>(args)...);
+}
+
+template <class T, class Func>
+FuturePtr<T> Executor::Invoke(Func fn) {
+    auto future = MakeTask<executors_internal::FunctionFuture<T, Func>>(std::move(fn));
+    Submit(future);
+    return future;
+}
+
+template <class Y, class T, class Func>
+FuturePtr<Y> Executor::Then(FuturePtr<T> input, Func fn) {
+    auto future = MakeTask<executors_internal::FunctionFuture<Y, Func>>(std::move(fn));
+    future->AddDependency(std::move(input));
+    Submit(future);
+    return future;
+}
+
+template <class T>
+FuturePtr<std::vector<T>> Executor::WhenAll(std::vector<FuturePtr<T>> all) {
+    auto future = MakeTask<executors_internal::AllFuture<T>>(all);
+    for (auto& input : all) {
+        future->AddDependency(input);
+    }
+    Submit(future);
+    return future;
+}
+
+template <class T>
+FuturePtr<T> Executor::WhenFirst(std::vector<FuturePtr<T>> all) {
+    auto future = MakeTask<executors_internal::FirstFuture<T>>(all);
+    for (auto& input : all) {
+        future->AddTrigger(input);
+    }
+    Submit(future);
+    return future;
+}
+
+// Finishes early if all of the futures do.
+template <class T>
+FuturePtr<std::vector<T>> Executor::WhenAllBeforeDeadline(
+    std::vector<FuturePtr<T>> all, std::chrono::system_clock::time_point deadline) {
+    auto future = MakeTask<executors_internal::AllFuture<T>>(all);
+    future->CollectOnlyCompleted();
+    for (auto& input : all) {
+        future->AddDependency(input);
+    }
+    future->SetTimeTrigger(deadline);
+    Submit(future);
+    return future;
+}
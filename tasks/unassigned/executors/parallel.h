@@ -0,0 +1,208 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <executors.h>
+
+namespace parallel_internal {
+
+// Below this many elements a range is sorted or merged on one thread.
+inline constexpr size_t kSortGrainSize = 4096;
+
+// Calls a callable which outlives the task: the forking thread waits for the task.
+template <class Func>
+class CallTask : public Task {
+public:
+    explicit CallTask(Func& func) : func_(func) {
+    }
+
+    void Run() override {
+        func_();
+    }
+
+private:
+    Func& func_;
+};
+
+// Waits for a task that calls |func|, running the pool's tasks meanwhile, or calls it here
+// if the executor has canceled the task, being shut down.
+template <class Func>
+void Join(const std::shared_ptr<CallTask<Func>>& task, Func& func) {
+    executors_internal::HelpWait(*task);
+    if (task->IsFailed()) {
+        std::rethrow_exception(task->GetError());
+    }
+    if (task->IsCanceled()) {
+        func();
+    }
+}
+
+// Runs |func| in the pool and waits for it. Called from outside the pool, the calling
+// thread just waits rather than take a share of the work it can't pass on.
+template <class Func>
+void RunInPool(Executor& executor, Func func) {
+    auto task = MakeTask<CallTask<Func>>(func);
+    executor.Submit(task);
+    Join(task, func);
+}
+
+// Runs |left| here and |right| as a task pushed onto the worker's deque, where an idle
+// worker may steal it, and returns once both are done. If nobody has stolen the task by
+// the time |left| returns, the waiting worker pops it and runs it itself.
+template <class Left, class Right>
+void ForkJoin(Executor& executor, Left left, Right right) {
+    auto task = MakeTask<CallTask<Right>>(right);
+    executor.Submit(task);
+    try {
+        left();
+    } catch (...) {
+        // The task refers to |right| on this frame.
+        executors_internal::HelpWait(*task);
+        throw;
+    }
+    Join(task, right);
+}
+
+template <class Func>
+void For(Executor& executor, size_t first, size_t last, size_t grain, Func& fn) {
+    if (last - first <= grain) {
+        for (auto i = first; i < last; ++i) {
+            fn(i);
+        }
+        return;
+    }
+    auto middle = first + (last - first) / 2;
+    ForkJoin(
+        executor, [&] { For(executor, first, middle, grain, fn); },
+        [&] { For(executor, middle, last, grain, fn); });
+}
+
+template <class RandomAccessIterator, class T, class BinaryOp>
+T Reduce(Executor& executor, RandomAccessIterator first, RandomAccessIterator last, size_t grain,
+         const T& identity, BinaryOp& reduce) {
+    if (static_cast<size_t>(last - first) <= grain) {
+        T value(identity);
+        for (; first != last; ++first) {
+            value = reduce(std::move(value), *first);
+        }
+        return value;
+    }
+    auto middle = first + (last - first) / 2;
+    std::optional<T> left;
+    std::optional<T> right;
+    ForkJoin(
+        executor, [&] { left.emplace(Reduce(executor, first, middle, grain, identity, reduce)); },
+        [&] { right.emplace(Reduce(executor, middle, last, grain, identity, reduce)); });
+    return reduce(std::move(*left), std::move(*right));
+}
+
+// Merges the sorted [first1, last1) and [first2, last2) into |out|. Large merges are cut
+// in two: the middle element of the longer range splits the other one by binary search,
+// and the two pairs of parts are merged in parallel.
+template <class InputIterator, class OutputIterator, class Compare>
+void Merge(Executor& executor, InputIterator first1, InputIterator last1, InputIterator first2,
+           InputIterator last2, OutputIterator out, Compare& comp) {
+    auto size1 = last1 - first1;
+    auto size2 = last2 - first2;
+    if (static_cast<size_t>(size1 + size2) <= kSortGrainSize) {
+        std::merge(std::make_move_iterator(first1), std::make_move_iterator(last1),
+                   std::make_move_iterator(first2), std::make_move_iterator(last2), out, comp);
+        return;
+    }
+    InputIterator middle1;
+    InputIterator middle2;
+    if (size1 >= size2) {
+        middle1 = first1 + size1 / 2;
+        middle2 = std::lower_bound(first2, last2, *middle1, comp);
+    } else {
+        middle2 = first2 + size2 / 2;
+        middle1 = std::upper_bound(first1, last1, *middle2, comp);
+    }
+    auto middle_out = out + (middle1 - first1) + (middle2 - first2);
+    ForkJoin(
+        executor, [&] { Merge(executor, first1, middle1, first2, middle2, out, comp); },
+        [&] { Merge(executor, middle1, last1, middle2, last2, middle_out, comp); });
+}
+
+// Sorts [first, last) and leaves the result there or, if |to_buffer|, in the same place
+// of the buffer. The halves are sorted the other way round, so every level merges from
+// one side into the other and nothing is moved back.
+template <class RandomAccessIterator, class BufferIterator, class Compare>
+void Sort(Executor& executor, RandomAccessIterator first, RandomAccessIterator last,
+          BufferIterator buffer, bool to_buffer, Compare& comp) {
+    auto size = last - first;
+    if (static_cast<size_t>(size) <= kSortGrainSize) {
+        std::sort(first, last, comp);
+        if (to_buffer) {
+            std::move(first, last, buffer);
+        }
+        return;
+    }
+    auto middle = first + size / 2;
+    auto buffer_middle = buffer + size / 2;
+    ForkJoin(
+        executor, [&] { Sort(executor, first, middle, buffer, !to_buffer, comp); },
+        [&] { Sort(executor, middle, last, buffer_middle, !to_buffer, comp); });
+    if (to_buffer) {
+        Merge(executor, first, middle, middle, last, buffer, comp);
+    } else {
+        Merge(executor, buffer, buffer_middle, buffer_middle, buffer + size, first, comp);
+    }
+}
+
+}  // namespace parallel_internal
+
+// The algorithms below cut their range in halves recursively, down to |grain| elements,
+// and run the halves as tasks of |executor|, which its idle workers steal. They may be
+// called from inside a task of the same executor as well: the waiting worker keeps
+// running the pool's tasks meanwhile.
+
+// Calls fn(i) for every i in [first, last).
+template <class Func>
+void ParallelFor(Executor& executor, size_t first, size_t last, size_t grain, Func fn) {
+    grain = std::max<size_t>(grain, 1);
+    if (last <= first) {
+        return;
+    }
+    parallel_internal::RunInPool(executor, [&] {
+        parallel_internal::For(executor, first, last, grain, fn);
+    });
+}
+
+// Folds [first, last) with an associative |reduce|, every piece of |grain| elements
+// starting from |identity|. The pieces and the order they are combined in depend on the
+// size of the range only, so the result doesn't depend on scheduling.
+template <class RandomAccessIterator, class T, class BinaryOp>
+T ParallelReduce(Executor& executor, RandomAccessIterator first, RandomAccessIterator last,
+                 size_t grain, T identity, BinaryOp reduce) {
+    grain = std::max<size_t>(grain, 1);
+    std::optional<T> result;
+    parallel_internal::RunInPool(executor, [&] {
+        result.emplace(parallel_internal::Reduce(executor, first, last, grain, identity, reduce));
+    });
+    return std::move(*result);
+}
+
+// A merge sort with parallel merges, which uses a buffer of the range's size, default
+// constructed. Like std::sort, it is not stable.
+template <class RandomAccessIterator, class Compare = std::less<>>
+void ParallelSort(Executor& executor, RandomAccessIterator first, RandomAccessIterator last,
+                  Compare comp = Compare()) {
+    if (static_cast<size_t>(last - first) <= parallel_internal::kSortGrainSize) {
+        std::sort(first, last, comp);
+        return;
+    }
+    using Value = typename std::iterator_traits<RandomAccessIterator>::value_type;
+    std::vector<Value> buffer(last - first);
+    parallel_internal::RunInPool(executor, [&] {
+        parallel_internal::Sort(executor, first, last, buffer.begin(), false, comp);
+    });
+}
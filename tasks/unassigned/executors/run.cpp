@@ -1,6 +1,15 @@
 #include <benchmark/benchmark.h>
 
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include <allocations_checker.h>
 #include <executors.h>
+#include <parallel.h>
 
 class EmptyTask : public Task {
 public:
@@ -51,6 +60,85 @@ BENCHMARK(BenchmarkFanoutFanin)
     ->Args({10, 10})
     ->Args({10, 100});
 
+// Reports the allocations per stage once a first chain has filled the pools.
+static void BenchmarkThenChain(benchmark::State& state) {
+    auto executor = MakeThreadPoolExecutor(state.range(0));
+    auto run_chain = [&executor, length = state.range(1)] {
+        auto future = executor->Invoke<int>([] { return 0; });
+        for (int64_t i = 0; i < length; ++i) {
+            future = executor->Then<int>(future, [i] { return static_cast<int>(i); });
+        }
+        future->Get();
+    };
+    run_chain();
+    auto allocations = alloc_checker::AllocCount();
+    for (auto _ : state) {
+        run_chain();
+    }
+    auto stages = state.iterations() * state.range(1);
+    state.counters["allocs_per_then"] =
+        static_cast<double>(alloc_checker::AllocCount() - allocations) / stages;
+    state.SetItemsProcessed(stages);
+}
+
+BENCHMARK(BenchmarkThenChain)
+    ->Args({1, 1000000})
+    ->Args({4, 1000000})
+    ->Unit(benchmark::kMillisecond);
+
+static std::vector<int> RandomValues(size_t size) {
+    std::mt19937 gen(42);
+    std::vector<int> values(size);
+    for (auto& value : values) {
+        value = gen();
+    }
+    return values;
+}
+
+static void BenchmarkStdSort(benchmark::State& state) {
+    auto unsorted = RandomValues(state.range(0));
+    std::vector<int> values;
+    for (auto _ : state) {
+        state.PauseTiming();
+        values = unsorted;
+        state.ResumeTiming();
+        std::sort(values.begin(), values.end());
+    }
+}
+
+BENCHMARK(BenchmarkStdSort)->Arg(1 << 20)->Unit(benchmark::kMillisecond);
+
+static void BenchmarkParallelSort(benchmark::State& state) {
+    auto executor = MakeThreadPoolExecutor(state.range(0));
+    auto unsorted = RandomValues(state.range(1));
+    std::vector<int> values;
+    for (auto _ : state) {
+        state.PauseTiming();
+        values = unsorted;
+        state.ResumeTiming();
+        ParallelSort(*executor, values.begin(), values.end());
+    }
+}
+
+BENCHMARK(BenchmarkParallelSort)
+    ->Args({1, 1 << 20})
+    ->Args({4, 1 << 20})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+static void BenchmarkParallelReduce(benchmark::State& state) {
+    auto executor = MakeThreadPoolExecutor(state.range(0));
+    std::vector<int64_t> values(state.range(1));
+    std::iota(values.begin(), values.end(), 0);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ParallelReduce(*executor, values.begin(), values.end(), 1 << 14,
+                                                int64_t{0}, std::plus<int64_t>()));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+
+BENCHMARK(BenchmarkParallelReduce)->Args({1, 1 << 22})->Args({4, 1 << 22})->UseRealTime();
+
 class Latch {
 public:
     Latch(size_t count) : counter_(count) {
@@ -262,6 +262,45 @@ TEST_P(ExecutorsTest, MultipleDependencies) {
     EXPECT_TRUE(task->IsFinished());
 }
 
+class CountingTask : public Task {
+public:
+    CountingTask(std::atomic<int>* counter) : counter_(counter) {
+    }
+
+    void Run() override {
+        seen = counter_->fetch_add(1);
+    }
+
+    int seen = -1;
+
+private:
+    std::atomic<int>* counter_;
+};
+
+TEST_P(ExecutorsTest, FanoutFanin) {
+    const int n = 1000;
+    std::atomic<int> counter{0};
+    auto first = std::make_shared<CountingTask>(&counter);
+    auto last = std::make_shared<CountingTask>(&counter);
+
+    for (int i = 0; i < n; ++i) {
+        auto middle = std::make_shared<CountingTask>(&counter);
+        middle->AddDependency(first);
+        last->AddDependency(middle);
+        pool->Submit(middle);
+    }
+    pool->Submit(last);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    EXPECT_EQ(0, counter.load());
+
+    pool->Submit(first);
+    last->Wait();
+
+    EXPECT_EQ(0, first->seen);
+    EXPECT_EQ(n + 1, last->seen);
+}
+
 TEST_P(ExecutorsTest, TaskWithSingleTimeTrigger) {
     auto task = std::make_shared<TestTask>();
 
@@ -38,6 +38,12 @@ TEST_F(FutureTest, InvokeException) {
     ASSERT_THROW(future->Get(), std::logic_error);
 }
 
+TEST_F(FutureTest, InvokeMoveOnly) {
+    auto future = pool->Invoke<int>([value = std::make_unique<int>(42)] { return *value; });
+
+    ASSERT_EQ(future->Get(), 42);
+}
+
 TEST_F(FutureTest, Then) {
     auto future_a = pool->Invoke<std::string>([]() { return std::string("Foo Bar"); });
 
@@ -52,6 +58,16 @@ TEST_F(FutureTest, Then) {
     EXPECT_TRUE(future_b->IsFinished());
 }
 
+TEST_F(FutureTest, ThenChain) {
+    const int n = 1000;
+    auto future = pool->Invoke<int>([] { return 0; });
+    for (int i = 0; i < n; ++i) {
+        future = pool->Then<int>(future, [future] { return future->Get() + 1; });
+    }
+
+    ASSERT_EQ(future->Get(), n);
+}
+
 TEST_F(FutureTest, ThenIsNonBlocking) {
     auto start = std::chrono::system_clock::now();
 
@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <executors.h>
+#include <parallel.h>
+
+struct ParallelTest : public testing::TestWithParam<int> {
+    std::shared_ptr<Executor> pool;
+
+    ParallelTest() {
+        pool = MakeThreadPoolExecutor(GetParam());
+    }
+};
+
+TEST_P(ParallelTest, For) {
+    const size_t n = 100000;
+    std::vector<size_t> values(n);
+    ParallelFor(*pool, 0, n, 100, [&](size_t i) { values[i] = i * i; });
+
+    for (size_t i = 0; i < n; ++i) {
+        ASSERT_EQ(values[i], i * i);
+    }
+}
+
+TEST_P(ParallelTest, NestedFor) {
+    const size_t n = 300;
+    std::vector<std::atomic<int>> counts(n * n);
+    ParallelFor(*pool, 0, n, 1, [&](size_t i) {
+        ParallelFor(*pool, 0, n, 10, [&](size_t j) { ++counts[i * n + j]; });
+    });
+
+    for (auto& count : counts) {
+        ASSERT_EQ(count.load(), 1);
+    }
+}
+
+TEST_P(ParallelTest, ForException) {
+    EXPECT_THROW(ParallelFor(*pool, 0, 10000, 10,
+                             [](size_t i) {
+                                 if (i == 5000) {
+                                     throw std::logic_error("Failed");
+                                 }
+                             }),
+                 std::logic_error);
+}
+
+TEST_P(ParallelTest, Reduce) {
+    std::vector<int64_t> values(1000000);
+    std::iota(values.begin(), values.end(), 0);
+    auto sum = ParallelReduce(*pool, values.begin(), values.end(), 1000, int64_t{0},
+                              std::plus<int64_t>());
+
+    ASSERT_EQ(sum, int64_t{999999} * 1000000 / 2);
+}
+
+TEST_P(ParallelTest, ReduceKeepsOrder) {
+    std::vector<std::string> words;
+    std::string expected;
+    for (int i = 0; i < 10000; ++i) {
+        words.push_back(std::to_string(i));
+        expected += words.back();
+    }
+    auto result = ParallelReduce(*pool, words.begin(), words.end(), 10, std::string(),
+                                 std::plus<std::string>());
+
+    ASSERT_EQ(result, expected);
+}
+
+TEST_P(ParallelTest, Sort) {
+    std::mt19937 gen(42);
+    for (size_t n : {0, 1, 1000, 100000, 1000000}) {
+        std::vector<int> values(n);
+        for (auto& value : values) {
+            value = gen() % 1000;
+        }
+        auto expected = values;
+        std::sort(expected.begin(), expected.end(), std::greater<>());
+
+        ParallelSort(*pool, values.begin(), values.end(), std::greater<>());
+        ASSERT_EQ(values, expected);
+    }
+}
+
+INSTANTIATE_TEST_CASE_P(ThreadPool, ParallelTest, ::testing::Values(1, 2, 10));
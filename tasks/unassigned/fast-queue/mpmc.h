@@ -1,36 +1,178 @@
 #pragma once
 
-#include <mutex>
-#include <queue>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <thread>
+#include <utility>
 
+// Dmitry Vyukov's bounded queue. Every slot carries a sequence number that tells whose
+// turn it is: a producer at position pos may fill the slot once its sequence equals pos,
+// a consumer may empty it once it equals pos + 1. Producers and consumers only contend
+// among themselves, each on its own cursor.
 template <class T>
 class MPMCBoundedQueue {
 public:
-    explicit MPMCBoundedQueue(int size) {
-        max_size_ = size;
+    // |size| should be a power of two, anything else is rounded up to one.
+    explicit MPMCBoundedQueue(int size)
+        : mask_(std::bit_ceil(static_cast<size_t>(size)) - 1),
+          slots_(std::make_unique<Slot[]>(mask_ + 1)) {
+        for (size_t i = 0; i <= mask_; ++i) {
+            slots_[i].sequence.store(i, std::memory_order_relaxed);
+        }
     }
 
     bool Enqueue(const T& value) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        if (queue_.size() == max_size_) {
-            return false;
-        }
-        queue_.push(value);
-        return true;
+        return EnqueueBulk(std::span<const T>(&value, 1));
     }
 
     bool Dequeue(T& data) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        if (queue_.empty()) {
-            return false;
+        return DequeueBulk(std::span<T>(&data, 1));
+    }
+
+    // Enqueues the longest prefix of |values| that fits with a single claim on the
+    // cursor and returns its length, 0 if the queue is full.
+    size_t EnqueueBulk(std::span<const T> values) {
+        auto pos = enqueue_pos_.load(std::memory_order_relaxed);
+        size_t count;
+        while (true) {
+            count = ReadyPrefix(pos, 0, values.size());
+            if (count == kStale) {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (!count) {
+                return 0;
+            }
+            // On failure pos is reloaded, another producer took some of these slots.
+            // Sequentially consistent, see SleepWhileEqual.
+            if (enqueue_pos_.compare_exchange_weak(pos, pos + count)) {
+                break;
+            }
+        }
+        for (size_t i = 0; i < count; ++i) {
+            auto& slot = slots_[(pos + i) & mask_];
+            slot.value = values[i];
+            slot.sequence.store(pos + i + 1, std::memory_order_release);
+        }
+        WakeIfSleeping(enqueue_pos_, consumers_sleeping_);
+        return count;
+    }
+
+    // Dequeues into the longest prefix of |data| available with a single claim on the
+    // cursor and returns its length, 0 if the queue is empty.
+    size_t DequeueBulk(std::span<T> data) {
+        auto pos = dequeue_pos_.load(std::memory_order_relaxed);
+        size_t count;
+        while (true) {
+            count = ReadyPrefix(pos, 1, data.size());
+            if (count == kStale) {
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (!count) {
+                return 0;
+            }
+            if (dequeue_pos_.compare_exchange_weak(pos, pos + count)) {
+                break;
+            }
+        }
+        for (size_t i = 0; i < count; ++i) {
+            auto& slot = slots_[(pos + i) & mask_];
+            data[i] = std::move(slot.value);
+            slot.sequence.store(pos + i + mask_ + 1, std::memory_order_release);
+        }
+        WakeIfSleeping(dequeue_pos_, producers_sleeping_);
+        return count;
+    }
+
+    // Wait for room or for an element: spin for a while, then sleep until the other
+    // side moves its cursor.
+    void EnqueueBlocking(const T& value) {
+        for (int attempt = 0; !Enqueue(value); ++attempt) {
+            if (attempt < kSpinAttempts) {
+                continue;
+            }
+            auto dequeue_pos = dequeue_pos_.load();
+            // Unless the queue is full some slot is claimed but not yet released.
+            if (enqueue_pos_.load() != dequeue_pos + mask_ + 1) {
+                std::this_thread::yield();
+                continue;
+            }
+            SleepWhileEqual(dequeue_pos_, dequeue_pos, producers_sleeping_);
+        }
+    }
+
+    void DequeueBlocking(T& data) {
+        for (int attempt = 0; !Dequeue(data); ++attempt) {
+            if (attempt < kSpinAttempts) {
+                continue;
+            }
+            auto enqueue_pos = enqueue_pos_.load();
+            if (dequeue_pos_.load() != enqueue_pos) {
+                std::this_thread::yield();
+                continue;
+            }
+            SleepWhileEqual(enqueue_pos_, enqueue_pos, consumers_sleeping_);
         }
-        data = std::move(queue_.front());
-        queue_.pop();
-        return true;
     }
 
 private:
-    std::queue<T> queue_;
-    std::mutex mutex_;
-    int max_size_ = 0;
+    static constexpr size_t kCacheLineSize = 64;
+    static constexpr int kSpinAttempts = 128;
+    static constexpr size_t kStale = SIZE_MAX;
+
+    struct Slot {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    // How many slots from pos on are ready for the side whose turn comes |lag| after
+    // the sequence equals the position, at most |limit|. kStale if pos fell behind.
+    size_t ReadyPrefix(size_t pos, size_t lag, size_t limit) const {
+        size_t count = 0;
+        for (; count < limit; ++count) {
+            auto expected = pos + count + lag;
+            auto sequence = slots_[(pos + count) & mask_].sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<ptrdiff_t>(sequence - expected);
+            if (diff > 0) {
+                return kStale;
+            }
+            if (diff < 0) {
+                break;
+            }
+        }
+        return count;
+    }
+
+    // The flag is raised before the cursor is checked again and the other side reads it
+    // after moving the cursor, all sequentially consistent: either the cursor has moved
+    // or the other side sees the flag and wakes the sleepers. A thread that has to sleep
+    // again raises the flag again.
+    static void SleepWhileEqual(std::atomic<size_t>& cursor, size_t old,
+                                std::atomic<bool>& sleeping) {
+        sleeping.store(true);
+        cursor.wait(old);
+    }
+
+    // The fast path only pays a load of the flag. Clearing it makes the next moves of
+    // the cursor skip the wake-up while the woken threads get around to running.
+    static void WakeIfSleeping(std::atomic<size_t>& cursor, std::atomic<bool>& sleeping) {
+        if (sleeping.load() && sleeping.exchange(false)) {
+            cursor.notify_all();
+        }
+    }
+
+    const size_t mask_;
+    const std::unique_ptr<Slot[]> slots_;
+    // Each cursor gets a cache line of its own, so that producers don't invalidate the
+    // line consumers spin on and the other way round. The flag of the threads sleeping on
+    // a cursor sits next to it, with the threads that read it.
+    alignas(kCacheLineSize) std::atomic<size_t> enqueue_pos_ = 0;
+    std::atomic<bool> consumers_sleeping_ = false;
+    alignas(kCacheLineSize) std::atomic<size_t> dequeue_pos_ = 0;
+    std::atomic<bool> producers_sleeping_ = false;
 };
@@ -11,6 +11,9 @@ std::array<std::atomic<int>, 32> dequeued;
 std::atomic<int> counter;
 
 MPMCBoundedQueue<int> queue(64);
+MPMCBoundedQueue<int> blocking_queue(64);
+
+constexpr size_t kBatchSize = 16;
 
 void StressEnqueue(benchmark::State& state) {
     while (state.KeepRunning()) {
@@ -31,6 +34,36 @@ void StressEnqueueDequeue(benchmark::State& state) {
     }
 }
 
+void StressBulkEnqueueDequeue(benchmark::State& state) {
+    std::array<int, kBatchSize> batch = {};
+    size_t items = 0;
+    if (state.thread_index % 2) {
+        while (state.KeepRunning()) {
+            items += queue.EnqueueBulk(batch);
+        }
+    } else {
+        while (state.KeepRunning()) {
+            items += queue.DequeueBulk(batch);
+        }
+    }
+    state.SetItemsProcessed(items);
+}
+
+// Every thread makes as many iterations as the others, so each producer is matched by a
+// consumer taking exactly as many elements.
+void StressBlockingEnqueueDequeue(benchmark::State& state) {
+    if (state.thread_index % 2) {
+        while (state.KeepRunning()) {
+            blocking_queue.EnqueueBlocking(0);
+        }
+    } else {
+        int val;
+        while (state.KeepRunning()) {
+            blocking_queue.DequeueBlocking(val);
+        }
+    }
+}
+
 void CorrectnessEnqueueDequeue(benchmark::State& state) {
     ++counter;
     if (state.thread_index == 0) {
@@ -75,6 +108,8 @@ void CorrectnessEnqueueDequeue(benchmark::State& state) {
 
 BENCHMARK(StressEnqueue)->ThreadRange(1, 8)->UseRealTime();
 BENCHMARK(StressEnqueueDequeue)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK(StressBulkEnqueueDequeue)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK(StressBlockingEnqueueDequeue)->ThreadRange(2, 8)->UseRealTime();
 BENCHMARK(CorrectnessEnqueueDequeue)->ThreadRange(1, 8)->UseRealTime();
 
 BENCHMARK_MAIN();
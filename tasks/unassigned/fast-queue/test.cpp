@@ -4,6 +4,7 @@
 #include <thread>
 #include <vector>
 #include <atomic>
+#include <span>
 
 #include <mpmc.h>
 
@@ -110,3 +111,65 @@ TEST(Correctness, NoQueueLock) {
     ASSERT_TRUE(queue.Dequeue(k));
     ASSERT_EQ(k, 0);
 }
+
+TEST(Correctness, Bulk) {
+    MPMCBoundedQueue<int> queue(4);
+    std::vector<int> values = {1, 2, 3, 4, 5, 6};
+    ASSERT_EQ(queue.EnqueueBulk(std::span<const int>(values).first(3)), 3u);
+    ASSERT_EQ(queue.EnqueueBulk(std::span<const int>(values).subspan(3)), 1u);
+    ASSERT_EQ(queue.EnqueueBulk(values), 0u);
+
+    std::vector<int> data(3);
+    ASSERT_EQ(queue.DequeueBulk(data), 3u);
+    ASSERT_EQ(data, std::vector<int>({1, 2, 3}));
+    ASSERT_EQ(queue.EnqueueBulk(std::span<const int>(values).subspan(4)), 2u);
+    ASSERT_EQ(queue.DequeueBulk(data), 3u);
+    ASSERT_EQ(data, std::vector<int>({4, 5, 6}));
+    ASSERT_EQ(queue.DequeueBulk(data), 0u);
+}
+
+TEST(Correctness, Blocking) {
+    const int n = 100000;
+    const int n_pairs = 4;
+    MPMCBoundedQueue<int> queue(8);
+
+    std::vector<std::thread> threads;
+    std::atomic<int64_t> sum = 0;
+    for (int i = 0; i < n_pairs; ++i) {
+        threads.emplace_back([&] {
+            std::vector<int> batch(5, 1);
+            for (int j = 0; j < n; j += batch.size()) {
+                for (size_t k = 0; k < batch.size();) {
+                    auto enqueued = queue.EnqueueBulk(std::span<const int>(batch).subspan(k));
+                    if (!enqueued) {
+                        std::this_thread::yield();
+                    }
+                    k += enqueued;
+                }
+            }
+        });
+        threads.emplace_back([&] {
+            for (int j = 0; j < n; ++j) {
+                int k;
+                queue.DequeueBlocking(k);
+                sum += k;
+            }
+        });
+    }
+    threads.emplace_back([&] {
+        for (int j = 0; j < n; ++j) {
+            queue.EnqueueBlocking(1);
+        }
+    });
+    int k;
+    for (int j = 0; j < n; ++j) {
+        queue.DequeueBlocking(k);
+        sum += k;
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+    ASSERT_EQ(sum, static_cast<int64_t>(n) * (n_pairs + 1));
+    ASSERT_FALSE(queue.Dequeue(k));
+}
@@ -0,0 +1,640 @@
+#include <fibers.h>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <exception>
+#include <thread>
+#include <utility>
+
+#if !defined(__x86_64__)
+#error "Fibers switch contexts on x86-64 only"
+#endif
+
+#if defined(__SANITIZE_THREAD__)
+#define FIBERS_TSAN 1
+#elif defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+#define FIBERS_TSAN 1
+#endif
+#endif
+
+#if defined(__SANITIZE_ADDRESS__)
+#define FIBERS_ASAN 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define FIBERS_ASAN 1
+#endif
+#endif
+
+#ifdef FIBERS_ASAN
+#include <sanitizer/asan_interface.h>
+#endif
+
+#ifdef FIBERS_TSAN
+extern "C" {
+void* __tsan_get_current_fiber();
+void* __tsan_create_fiber(unsigned flags);
+void __tsan_destroy_fiber(void* fiber);
+void __tsan_switch_to_fiber(void* fiber, unsigned flags);
+}
+#endif
+
+// Saves the callee-saved registers, the x87 control word and MXCSR on the current stack,
+// stores the stack pointer to *save_sp and restores the same from load_sp. A fiber's first
+// switch returns to FibersStart, which calls r13(r12).
+extern "C" void FibersSwitchContext(void** save_sp, void* load_sp);
+extern "C" void FibersStart();
+
+asm(R"(
+    .text
+    .globl FibersSwitchContext
+    .hidden FibersSwitchContext
+    .type FibersSwitchContext, @function
+FibersSwitchContext:
+    pushq %rbp
+    pushq %rbx
+    pushq %r12
+    pushq %r13
+    pushq %r14
+    pushq %r15
+    subq $16, %rsp
+    stmxcsr 8(%rsp)
+    fnstcw (%rsp)
+    movq %rsp, (%rdi)
+    movq %rsi, %rsp
+    fldcw (%rsp)
+    ldmxcsr 8(%rsp)
+    addq $16, %rsp
+    popq %r15
+    popq %r14
+    popq %r13
+    popq %r12
+    popq %rbx
+    popq %rbp
+    ret
+    .size FibersSwitchContext, .-FibersSwitchContext
+
+    .globl FibersStart
+    .hidden FibersStart
+    .type FibersStart, @function
+FibersStart:
+    movq %r12, %rdi
+    callq *%r13
+    ud2
+    .size FibersStart, .-FibersStart
+)");
+
+namespace fibers_internal {
+
+namespace {
+
+constexpr size_t kCacheLineSize = 64;
+// The injected fibers a worker takes at a time.
+constexpr size_t kInjectBatch = 32;
+// A busy worker still looks at the injected fibers every this many fibers it runs.
+constexpr uint64_t kInjectInterval = 61;
+// Stacks a worker keeps to itself, past which it gives half of them to the scheduler.
+constexpr size_t kCachedStacks = 64;
+// Fibers a worker runs in a row by handing its turn to the fiber just woken, after which
+// the one woken goes to the back of the queue: two fibers may wake each other forever.
+constexpr int kMaxHandoffs = 16;
+constexpr int kSpinsBeforeYield = 64;
+// The defaults of the x87 control word and MXCSR, which a fiber starts with.
+constexpr uint64_t kInitialFpuControl = 0x037f;
+constexpr uint64_t kInitialMxcsr = 0x1f80;
+
+size_t PageSize() {
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+    return page_size;
+}
+
+Stack MapStack(size_t size) {
+    auto page_size = PageSize();
+    size = (size + page_size - 1) / page_size * page_size;
+    auto* mapping = mmap(nullptr, size + page_size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK | MAP_NORESERVE, -1, 0);
+    if (mapping == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    if (mprotect(mapping, page_size, PROT_NONE)) {
+        munmap(mapping, size + page_size);
+        throw std::bad_alloc();
+    }
+    return {static_cast<char*>(mapping) + page_size, size};
+}
+
+void UnmapStack(Stack stack) {
+    munmap(stack.base - PageSize(), stack.size + PageSize());
+}
+
+[[noreturn]] void FiberMain(Fiber* fiber) noexcept;
+
+// A queue of pointers on a ring which doubles when full and never shrinks, unlike
+// std::deque, which allocates and frees its chunks as it moves along.
+class RingQueue {
+public:
+    bool IsEmpty() const {
+        return size_ == 0;
+    }
+
+    size_t Size() const {
+        return size_;
+    }
+
+    void Push(Fiber* fiber) {
+        if (size_ == slots_.size()) {
+            Grow();
+        }
+        slots_[(head_ + size_) & (slots_.size() - 1)] = fiber;
+        ++size_;
+    }
+
+    Fiber* Pop() {
+        auto* fiber = slots_[head_];
+        head_ = (head_ + 1) & (slots_.size() - 1);
+        --size_;
+        return fiber;
+    }
+
+private:
+    void Grow() {
+        std::vector<Fiber*> grown(slots_.empty() ? kInitialCapacity : 2 * slots_.size());
+        for (size_t i = 0; i < size_; ++i) {
+            grown[i] = slots_[(head_ + i) & (slots_.size() - 1)];
+        }
+        slots_.swap(grown);
+        head_ = 0;
+    }
+
+    static constexpr size_t kInitialCapacity = 256;
+
+    std::vector<Fiber*> slots_;
+    size_t head_ = 0;
+    size_t size_ = 0;
+};
+
+}  // namespace
+
+class alignas(kCacheLineSize) Worker {
+public:
+    // What the worker does once the fiber it runs switches back to it.
+    enum class After { kYield, kPark, kFinish };
+
+    Worker(Scheduler* scheduler, uint64_t index) : scheduler_(scheduler), random_(index * 2 + 1) {
+    }
+
+    void Start() {
+        thread_ = std::thread([this] { Loop(); });
+    }
+
+    void Join() {
+        thread_.join();
+    }
+
+    Scheduler* GetScheduler() const {
+        return scheduler_;
+    }
+
+    Fiber* GetCurrent() const {
+        return current_;
+    }
+
+    // A fiber pushed to run next displaces the previous one to the queue.
+    void Push(Fiber* fiber, bool next = false) {
+        lock_.Lock();
+        if (next) {
+            std::swap(fiber, next_);
+        }
+        if (fiber) {
+            queue_.Push(fiber);
+        }
+        lock_.Unlock();
+    }
+
+    bool HasRunnable() {
+        lock_.Lock();
+        auto has_runnable = next_ || !queue_.IsEmpty();
+        lock_.Unlock();
+        return has_runnable;
+    }
+
+    // Moves all of |fibers| to the queue and returns the first of them to run.
+    Fiber* Adopt(std::vector<Fiber*>& fibers) {
+        lock_.Lock();
+        for (size_t i = 1; i < fibers.size(); ++i) {
+            queue_.Push(fibers[i]);
+        }
+        lock_.Unlock();
+        return fibers.front();
+    }
+
+    // Called on the current fiber's stack, returns once the fiber is resumed.
+    void SwitchToLoop(After after, SpinLock* lock = nullptr) {
+        after_ = after;
+        unlock_after_ = lock;
+        auto* fiber = current_;
+#ifdef FIBERS_TSAN
+        __tsan_switch_to_fiber(tsan_fiber_, 0);
+#endif
+        FibersSwitchContext(&fiber->stack_pointer_, stack_pointer_);
+    }
+
+    static void Prepare(Fiber* fiber) {
+        // The fiber object is above, 16-aligned, so FibersStart calls FiberMain on a stack
+        // aligned as the ABI wants.
+        auto* frame = reinterpret_cast<uint64_t*>(fiber) - 9;
+        frame[0] = kInitialFpuControl;
+        frame[1] = kInitialMxcsr;
+        frame[2] = 0;  // r15
+        frame[3] = 0;  // r14
+        frame[4] = reinterpret_cast<uint64_t>(&FiberMain);  // r13
+        frame[5] = reinterpret_cast<uint64_t>(fiber);       // r12
+        frame[6] = 0;                                        // rbx
+        frame[7] = 0;                                        // rbp
+        frame[8] = reinterpret_cast<uint64_t>(&FibersStart);
+        fiber->stack_pointer_ = frame;
+    }
+
+    // Called by the worker itself.
+    void CacheStack(Stack stack, std::vector<Stack>* overflow) {
+        stacks_.push_back(stack);
+        if (stacks_.size() > kCachedStacks) {
+            overflow->assign(stacks_.end() - kCachedStacks / 2, stacks_.end());
+            stacks_.resize(stacks_.size() - kCachedStacks / 2);
+        }
+    }
+
+    std::optional<Stack> TakeCachedStack() {
+        if (stacks_.empty()) {
+            return std::nullopt;
+        }
+        auto stack = stacks_.back();
+        stacks_.pop_back();
+        return stack;
+    }
+
+    // After the thread has exited.
+    void UnmapStacks() {
+        for (auto stack : stacks_) {
+            UnmapStack(stack);
+        }
+        stacks_.clear();
+    }
+
+    std::vector<Fiber*>& Batch() {
+        batch_.clear();
+        return batch_;
+    }
+
+private:
+    void Loop();
+
+    Fiber* NextFiber();
+
+    Fiber* PopLocal() {
+        lock_.Lock();
+        Fiber* fiber = nullptr;
+        if (next_ && handoffs_ < kMaxHandoffs) {
+            ++handoffs_;
+            fiber = std::exchange(next_, nullptr);
+        } else {
+            handoffs_ = 0;
+            if (next_) {
+                queue_.Push(std::exchange(next_, nullptr));
+            }
+            fiber = queue_.IsEmpty() ? nullptr : queue_.Pop();
+        }
+        lock_.Unlock();
+        return fiber;
+    }
+
+    // Takes the older half of a random other worker's queue, or the fiber to run next if
+    // the queue is empty: the worker may be busy with a long one.
+    Fiber* Steal();
+
+    // xorshift64
+    uint64_t NextRandom() {
+        random_ ^= random_ << 13;
+        random_ ^= random_ >> 7;
+        random_ ^= random_ << 17;
+        return random_;
+    }
+
+    Scheduler* const scheduler_;
+    SpinLock lock_;
+    RingQueue queue_;
+    Fiber* next_ = nullptr;
+    // Owned by the worker's thread.
+    int handoffs_ = 0;
+
+    // The worker's own context, saved while a fiber runs.
+    void* stack_pointer_ = nullptr;
+    Fiber* current_ = nullptr;
+    After after_ = After::kYield;
+    SpinLock* unlock_after_ = nullptr;
+#ifdef FIBERS_TSAN
+    void* tsan_fiber_ = nullptr;
+#endif
+
+    std::vector<Stack> stacks_;
+    std::vector<Fiber*> batch_;
+    uint64_t random_;
+    uint64_t ticks_ = 0;
+    std::thread thread_;
+};
+
+namespace {
+
+thread_local Worker* current_worker = nullptr;
+
+// A fiber may move to another thread at any switch, so the address of the thread-local
+// must not be kept across one: the empty asm stops the compiler from merging the calls.
+[[gnu::noinline]] Worker* CurrentWorker() {
+    asm volatile("");
+    return current_worker;
+}
+
+void FiberMain(Fiber* fiber) noexcept {
+    fiber->Run();
+    CurrentWorker()->SwitchToLoop(Worker::After::kFinish);
+    __builtin_unreachable();
+}
+
+}  // namespace
+
+void Worker::Loop() {
+    current_worker = this;
+#ifdef FIBERS_TSAN
+    tsan_fiber_ = __tsan_get_current_fiber();
+#endif
+    while (auto* fiber = NextFiber()) {
+        current_ = fiber;
+#ifdef FIBERS_TSAN
+        __tsan_switch_to_fiber(fiber->sanitizer_context_, 0);
+#endif
+        FibersSwitchContext(&stack_pointer_, fiber->stack_pointer_);
+        current_ = nullptr;
+        switch (after_) {
+            case After::kYield:
+                Push(fiber);
+                break;
+            case After::kPark:
+                unlock_after_->Unlock();
+                break;
+            case After::kFinish:
+                scheduler_->Finish(fiber);
+                break;
+        }
+    }
+}
+
+Fiber* Worker::NextFiber() {
+    while (true) {
+        if (++ticks_ % kInjectInterval == 0) {
+            if (auto* fiber = scheduler_->TakeInjected(this)) {
+                return fiber;
+            }
+        }
+        if (auto* fiber = PopLocal()) {
+            return fiber;
+        }
+        if (auto* fiber = scheduler_->TakeInjected(this)) {
+            return fiber;
+        }
+        if (auto* fiber = Steal()) {
+            return fiber;
+        }
+        if (!scheduler_->Sleep()) {
+            return nullptr;
+        }
+    }
+}
+
+Fiber* Worker::Steal() {
+    auto& workers = scheduler_->workers_;
+    auto start = NextRandom();
+    for (size_t i = 0; i < workers.size(); ++i) {
+        auto* victim = workers[(start + i) % workers.size()].get();
+        if (victim == this) {
+            continue;
+        }
+        auto& batch = Batch();
+        victim->lock_.Lock();
+        auto count = (victim->queue_.Size() + 1) / 2;
+        for (size_t j = 0; j < count; ++j) {
+            batch.push_back(victim->queue_.Pop());
+        }
+        if (batch.empty() && victim->next_) {
+            batch.push_back(std::exchange(victim->next_, nullptr));
+        }
+        victim->lock_.Unlock();
+        if (!batch.empty()) {
+            return Adopt(batch);
+        }
+    }
+    return nullptr;
+}
+
+}  // namespace fibers_internal
+
+using fibers_internal::Fiber;
+using fibers_internal::Stack;
+using fibers_internal::Worker;
+
+Scheduler::Scheduler(int num_threads, size_t stack_size) : stack_size_(stack_size) {
+    if (num_threads < 1) {
+        throw std::invalid_argument("Scheduler needs a thread");
+    }
+    for (int i = 0; i < num_threads; ++i) {
+        workers_.push_back(std::make_unique<Worker>(this, i));
+    }
+    for (auto& worker : workers_) {
+        worker->Start();
+    }
+}
+
+Scheduler::~Scheduler() {
+    Wait();
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        stopping_ = true;
+    }
+    idle_.notify_all();
+    for (auto& worker : workers_) {
+        worker->Join();
+        worker->UnmapStacks();
+    }
+    for (auto stack : stacks_) {
+        fibers_internal::UnmapStack(stack);
+    }
+}
+
+void Scheduler::Wait() {
+    std::unique_lock<std::mutex> lock(idle_mutex_);
+    finished_.wait(lock, [this] { return live_.load() == 0; });
+}
+
+Stack Scheduler::AcquireStack() {
+    auto* worker = fibers_internal::CurrentWorker();
+    if (worker && worker->GetScheduler() == this) {
+        if (auto stack = worker->TakeCachedStack()) {
+            return *stack;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(stacks_mutex_);
+        if (!stacks_.empty()) {
+            auto stack = stacks_.back();
+            stacks_.pop_back();
+            return stack;
+        }
+    }
+    return fibers_internal::MapStack(stack_size_);
+}
+
+void Scheduler::ReleaseStack(Stack stack) {
+    std::lock_guard<std::mutex> lock(stacks_mutex_);
+    stacks_.push_back(stack);
+}
+
+void Scheduler::Start(Fiber* fiber, Stack stack) {
+    fiber->stack_ = stack;
+    fiber->scheduler_ = this;
+#ifdef FIBERS_ASAN
+    // The last frames of the stack's previous fiber never returned, their redzones are
+    // still poisoned.
+    ASAN_UNPOISON_MEMORY_REGION(stack.base, reinterpret_cast<char*>(fiber) - stack.base);
+#endif
+    Worker::Prepare(fiber);
+#ifdef FIBERS_TSAN
+    fiber->sanitizer_context_ = __tsan_create_fiber(0);
+#endif
+    live_.fetch_add(1);
+    Schedule(fiber, false);
+}
+
+void Scheduler::Schedule(Fiber* fiber, bool woken) {
+    auto* worker = fibers_internal::CurrentWorker();
+    if (worker && worker->GetScheduler() == this) {
+        worker->Push(fiber, woken);
+    } else {
+        std::lock_guard<std::mutex> lock(inject_mutex_);
+        injected_.push_back(fiber);
+        injected_size_.store(injected_.size(), std::memory_order_relaxed);
+    }
+    WakeWorker();
+}
+
+// A worker counts itself sleeping before it looks at the queues for the last time, and
+// Schedule looks at the count after it has queued the fiber, all sequentially consistent:
+// either the worker sees the fiber or Schedule sees the worker and wakes it.
+void Scheduler::WakeWorker() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping_.load() > 0) {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        idle_.notify_one();
+    }
+}
+
+void Scheduler::Finish(Fiber* fiber) {
+    auto* worker = fibers_internal::CurrentWorker();
+    auto stack = fiber->stack_;
+#ifdef FIBERS_TSAN
+    __tsan_destroy_fiber(fiber->sanitizer_context_);
+#endif
+    fiber->~Fiber();
+    std::vector<Stack> spare;
+    worker->CacheStack(stack, &spare);
+    if (!spare.empty()) {
+        std::lock_guard<std::mutex> lock(stacks_mutex_);
+        stacks_.insert(stacks_.end(), spare.begin(), spare.end());
+    }
+    if (live_.fetch_sub(1) == 1) {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        finished_.notify_all();
+    }
+}
+
+Fiber* Scheduler::TakeInjected(Worker* worker) {
+    if (injected_size_.load(std::memory_order_relaxed) == 0) {
+        return nullptr;
+    }
+    auto& batch = worker->Batch();
+    {
+        std::lock_guard<std::mutex> lock(inject_mutex_);
+        while (!injected_.empty() && batch.size() < fibers_internal::kInjectBatch) {
+            batch.push_back(injected_.front());
+            injected_.pop_front();
+        }
+        injected_size_.store(injected_.size(), std::memory_order_relaxed);
+    }
+    return batch.empty() ? nullptr : worker->Adopt(batch);
+}
+
+bool Scheduler::Sleep() {
+    std::unique_lock<std::mutex> lock(idle_mutex_);
+    sleeping_.fetch_add(1);
+    while (!stopping_) {
+        if (HasRunnable()) {
+            sleeping_.fetch_sub(1);
+            return true;
+        }
+        idle_.wait(lock);
+    }
+    sleeping_.fetch_sub(1);
+    return false;
+}
+
+bool Scheduler::HasRunnable() {
+    {
+        std::lock_guard<std::mutex> lock(inject_mutex_);
+        if (!injected_.empty()) {
+            return true;
+        }
+    }
+    for (auto& worker : workers_) {
+        if (worker->HasRunnable()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+namespace fibers_internal {
+
+void SpinLock::Relax(int spin) {
+    if (spin < kSpinsBeforeYield) {
+        __builtin_ia32_pause();
+    } else {
+        std::this_thread::yield();
+    }
+}
+
+Fiber* CurrentFiber() {
+    auto* worker = CurrentWorker();
+    return worker ? worker->GetCurrent() : nullptr;
+}
+
+void Park(WaitQueue& queue, SpinLock& lock) {
+    auto* fiber = CurrentFiber();
+    if (!fiber) {
+        lock.Unlock();
+        throw std::logic_error("Not called from a fiber");
+    }
+    queue.Push(fiber);
+    CurrentWorker()->SwitchToLoop(Worker::After::kPark, &lock);
+}
+
+void Unpark(Fiber* fiber) {
+    fiber->scheduler_->Schedule(fiber, true);
+}
+
+void Yield() {
+    if (!CurrentFiber()) {
+        throw std::logic_error("Not called from a fiber");
+    }
+    CurrentWorker()->SwitchToLoop(Worker::After::kYield);
+}
+
+}  // namespace fibers_internal
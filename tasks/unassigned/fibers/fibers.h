@@ -0,0 +1,427 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+class Scheduler;
+
+namespace fibers_internal {
+
+class Worker;
+
+// Guards the few instructions of a wait queue. A fiber must not put its worker's thread
+// to sleep, and one holding the lock may be switched out by the OS, so the waiting side
+// gives its CPU away after a while rather than spin on.
+class SpinLock {
+public:
+    void Lock() {
+        for (int spin = 0; locked_.exchange(true, std::memory_order_acquire); ++spin) {
+            while (locked_.load(std::memory_order_relaxed)) {
+                Relax(spin++);
+            }
+        }
+    }
+
+    void Unlock() {
+        locked_.store(false, std::memory_order_release);
+    }
+
+private:
+    static void Relax(int spin);
+
+    std::atomic<bool> locked_ = false;
+};
+
+// The part of a stack's mapping past its lowest page, which is a guard page.
+struct Stack {
+    char* base = nullptr;
+    size_t size = 0;
+};
+
+// A fiber lives at the top of its own stack, so that spawning one takes no allocation
+// once the stacks are pooled.
+class Fiber {
+public:
+    virtual ~Fiber() = default;
+
+    virtual void Run() = 0;
+
+private:
+    friend class WaitQueue;
+    friend class Worker;
+    friend class ::Scheduler;
+    friend void Unpark(Fiber* fiber);
+
+    // Where the context of a fiber that is not running is saved.
+    void* stack_pointer_ = nullptr;
+    Stack stack_;
+    Scheduler* scheduler_ = nullptr;
+    // The link of the wait queue the fiber is parked in.
+    Fiber* next_ = nullptr;
+    // The fiber as a sanitizer knows it, when built with one.
+    void* sanitizer_context_ = nullptr;
+};
+
+template <class Func>
+class FunctionFiber : public Fiber {
+public:
+    explicit FunctionFiber(Func fn) : fn_(std::move(fn)) {
+    }
+
+    // The callable is destroyed here too, on the fiber's own stack: whatever it captured
+    // may need to block on the way out.
+    void Run() override {
+        (*fn_)();
+        fn_.reset();
+    }
+
+private:
+    std::optional<Func> fn_;
+};
+
+// Fibers parked on a primitive, in the order they came. Guarded by the primitive's lock.
+class WaitQueue {
+public:
+    bool IsEmpty() const {
+        return !head_;
+    }
+
+    void Push(Fiber* fiber) {
+        fiber->next_ = nullptr;
+        (tail_ ? tail_->next_ : head_) = fiber;
+        tail_ = fiber;
+    }
+
+    // Returns nullptr if the queue is empty.
+    Fiber* Pop() {
+        auto* fiber = head_;
+        if (fiber) {
+            head_ = fiber->next_;
+            if (!head_) {
+                tail_ = nullptr;
+            }
+        }
+        return fiber;
+    }
+
+private:
+    Fiber* head_ = nullptr;
+    Fiber* tail_ = nullptr;
+};
+
+// The fiber running on the calling thread, nullptr outside of fibers.
+Fiber* CurrentFiber();
+
+// Puts the current fiber into |queue|, guarded by |lock|, which is held, and switches it
+// out until Unpark. The fiber's worker releases the lock once the fiber is off its stack,
+// so whoever pops the fiber may resume it right away. Outside of fibers releases the lock
+// and throws std::logic_error.
+void Park(WaitQueue& queue, SpinLock& lock);
+
+// Makes a parked fiber runnable again.
+void Unpark(Fiber* fiber);
+
+// Like Park, for a fiber that nobody waits for.
+void Yield();
+
+}  // namespace fibers_internal
+
+// Runs fibers on |num_threads| worker threads, M:N. Every worker takes fibers from a run
+// queue of its own, where the fibers it spawns and wakes go, and steals half of another
+// worker's queue once it runs dry. A fiber woken by the running one goes first, so that a
+// message passed between fibers is taken while it is hot. Fibers spawned from outside go
+// through a shared queue, which the workers look at now and then even while busy. Stacks
+// are mapped with a guard page below them and recycled through the workers: a fiber that
+// overflows its stack crashes rather than corrupt a neighbour.
+//
+// The fibers may block on the Mutex, ConditionVariable and Channel below, which park the
+// fiber and let its worker run others; a fiber that blocks its thread, say on std::mutex
+// or in a system call, takes a whole worker with it. An exception escaping a fiber
+// terminates the program, as with std::thread.
+class Scheduler {
+public:
+    static constexpr size_t kDefaultStackSize = 64 * 1024;
+
+    explicit Scheduler(int num_threads, size_t stack_size = kDefaultStackSize);
+
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    // Waits for all the fibers to finish.
+    ~Scheduler();
+
+    // May be called from fibers and from any thread.
+    template <class Func>
+    void Spawn(Func fn);
+
+    // Blocks the calling thread until all the fibers have finished, fibers spawned
+    // meanwhile included. Must not be called from a fiber of this scheduler.
+    void Wait();
+
+private:
+    friend class fibers_internal::Worker;
+    friend void fibers_internal::Unpark(fibers_internal::Fiber* fiber);
+
+    fibers_internal::Stack AcquireStack();
+    void ReleaseStack(fibers_internal::Stack stack);
+
+    // Prepares the stack of a fiber constructed on it and makes the fiber runnable.
+    void Start(fibers_internal::Fiber* fiber, fibers_internal::Stack stack);
+
+    // A fiber woken by another one on the same worker runs next, while what they share is
+    // likely in the cache still.
+    void Schedule(fibers_internal::Fiber* fiber, bool woken);
+    void WakeWorker();
+
+    // Called by the worker which switched off the finished fiber's stack.
+    void Finish(fibers_internal::Fiber* fiber);
+
+    // Moves up to a batch of the injected fibers to |worker| and returns one of them.
+    fibers_internal::Fiber* TakeInjected(fibers_internal::Worker* worker);
+
+    // Puts the calling worker to sleep until there may be fibers to run. Returns false once
+    // the scheduler stops.
+    bool Sleep();
+
+    bool HasRunnable();
+
+    const size_t stack_size_;
+    std::vector<std::unique_ptr<fibers_internal::Worker>> workers_;
+
+    std::mutex inject_mutex_;
+    std::deque<fibers_internal::Fiber*> injected_;
+    // A hint for the workers, which look at the queue without the mutex.
+    std::atomic<size_t> injected_size_ = 0;
+
+    std::mutex stacks_mutex_;
+    std::vector<fibers_internal::Stack> stacks_;
+
+    // Fibers spawned and not finished yet.
+    std::atomic<int64_t> live_ = 0;
+
+    std::mutex idle_mutex_;
+    std::condition_variable idle_;
+    std::condition_variable finished_;
+    std::atomic<int> sleeping_ = 0;
+    bool stopping_ = false;
+};
+
+namespace fibers_internal {
+
+// Reserves the top of |stack| for a T.
+template <class T>
+void* PlaceOnStack(const Stack& stack) {
+    constexpr uintptr_t kAlignment = std::max<uintptr_t>(alignof(T), 16);
+    auto base = reinterpret_cast<uintptr_t>(stack.base);
+    auto place = (base + stack.size - sizeof(T)) & ~(kAlignment - 1);
+    if (sizeof(T) > stack.size / 2 || place - base < stack.size / 2) {
+        throw std::length_error("Fiber's callable takes more than half of its stack");
+    }
+    return reinterpret_cast<void*>(place);
+}
+
+}  // namespace fibers_internal
+
+template <class Func>
+void Scheduler::Spawn(Func fn) {
+    using Fiber = fibers_internal::FunctionFiber<Func>;
+    auto stack = AcquireStack();
+    Fiber* fiber;
+    try {
+        fiber = new (fibers_internal::PlaceOnStack<Fiber>(stack)) Fiber(std::move(fn));
+    } catch (...) {
+        ReleaseStack(stack);
+        throw;
+    }
+    Start(fiber, stack);
+}
+
+namespace this_fiber {
+
+// Lets the other runnable fibers of the worker run first.
+inline void Yield() {
+    fibers_internal::Yield();
+}
+
+}  // namespace this_fiber
+
+// Blocks the fiber rather than its thread. Waiting fibers get the mutex in the order they
+// came: Unlock hands it to the first of them directly.
+class Mutex {
+public:
+    void Lock() {
+        lock_.Lock();
+        if (!locked_) {
+            locked_ = true;
+            lock_.Unlock();
+            return;
+        }
+        fibers_internal::Park(waiters_, lock_);
+    }
+
+    bool TryLock() {
+        lock_.Lock();
+        auto acquired = !locked_;
+        locked_ = true;
+        lock_.Unlock();
+        return acquired;
+    }
+
+    void Unlock() {
+        lock_.Lock();
+        auto* next = waiters_.Pop();
+        if (!next) {
+            locked_ = false;
+        }
+        lock_.Unlock();
+        if (next) {
+            fibers_internal::Unpark(next);
+        }
+    }
+
+    // For std::lock_guard and std::unique_lock.
+    void lock() {
+        Lock();
+    }
+
+    bool try_lock() {
+        return TryLock();
+    }
+
+    void unlock() {
+        Unlock();
+    }
+
+private:
+    fibers_internal::SpinLock lock_;
+    bool locked_ = false;
+    fibers_internal::WaitQueue waiters_;
+};
+
+class ConditionVariable {
+public:
+    // |mutex| is held by the calling fiber, which may wake up spuriously.
+    void Wait(Mutex& mutex) {
+        lock_.Lock();
+        mutex.Unlock();
+        fibers_internal::Park(waiters_, lock_);
+        mutex.Lock();
+    }
+
+    template <class Predicate>
+    void Wait(Mutex& mutex, Predicate stop_waiting) {
+        while (!stop_waiting()) {
+            Wait(mutex);
+        }
+    }
+
+    void NotifyOne() {
+        lock_.Lock();
+        auto* fiber = waiters_.Pop();
+        lock_.Unlock();
+        if (fiber) {
+            fibers_internal::Unpark(fiber);
+        }
+    }
+
+    void NotifyAll() {
+        lock_.Lock();
+        auto waiters = std::exchange(waiters_, {});
+        lock_.Unlock();
+        while (auto* fiber = waiters.Pop()) {
+            fibers_internal::Unpark(fiber);
+        }
+    }
+
+private:
+    fibers_internal::SpinLock lock_;
+    fibers_internal::WaitQueue waiters_;
+};
+
+// A bounded FIFO channel between fibers. Send blocks while the channel is full and Receive
+// while it is empty, every Send wakes one receiver and every Receive one sender. The queues
+// are guarded by a lock of the channel's own rather than a Mutex, so that passing a value
+// costs no more than a switch to the fiber which takes it.
+template <class T>
+class Channel {
+public:
+    explicit Channel(size_t capacity) : capacity_(capacity) {
+        if (capacity == 0) {
+            throw std::invalid_argument("Channel needs a capacity");
+        }
+    }
+
+    // Throws std::runtime_error if the channel is closed.
+    void Send(T value) {
+        lock_.Lock();
+        while (buffer_.size() == capacity_ && !closed_) {
+            fibers_internal::Park(senders_, lock_);
+            lock_.Lock();
+        }
+        if (closed_) {
+            lock_.Unlock();
+            throw std::runtime_error("Send to a closed channel");
+        }
+        buffer_.push_back(std::move(value));
+        auto* receiver = receivers_.Pop();
+        lock_.Unlock();
+        if (receiver) {
+            fibers_internal::Unpark(receiver);
+        }
+    }
+
+    // Returns std::nullopt once the channel is closed and the values sent before are taken.
+    std::optional<T> Receive() {
+        lock_.Lock();
+        while (buffer_.empty() && !closed_) {
+            fibers_internal::Park(receivers_, lock_);
+            lock_.Lock();
+        }
+        if (buffer_.empty()) {
+            lock_.Unlock();
+            return std::nullopt;
+        }
+        std::optional<T> value(std::move(buffer_.front()));
+        buffer_.pop_front();
+        auto* sender = senders_.Pop();
+        lock_.Unlock();
+        if (sender) {
+            fibers_internal::Unpark(sender);
+        }
+        return value;
+    }
+
+    // Wakes all the waiting fibers. May be called more than once.
+    void Close() {
+        lock_.Lock();
+        closed_ = true;
+        auto senders = std::exchange(senders_, {});
+        auto receivers = std::exchange(receivers_, {});
+        lock_.Unlock();
+        while (auto* fiber = senders.Pop()) {
+            fibers_internal::Unpark(fiber);
+        }
+        while (auto* fiber = receivers.Pop()) {
+            fibers_internal::Unpark(fiber);
+        }
+    }
+
+private:
+    const size_t capacity_;
+    fibers_internal::SpinLock lock_;
+    std::deque<T> buffer_;
+    bool closed_ = false;
+    fibers_internal::WaitQueue senders_;
+    fibers_internal::WaitQueue receivers_;
+};
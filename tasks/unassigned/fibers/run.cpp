@@ -0,0 +1,129 @@
+#include <benchmark/benchmark.h>
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include <fibers.h>
+
+static void BenchmarkSpawn(benchmark::State& state) {
+    Scheduler scheduler(state.range(0));
+    for (auto _ : state) {
+        for (int i = 0; i < 1000; ++i) {
+            scheduler.Spawn([] {});
+        }
+        scheduler.Wait();
+    }
+    state.SetItemsProcessed(state.iterations() * 1000);
+}
+
+BENCHMARK(BenchmarkSpawn)->Arg(1)->Arg(2)->Arg(4)->UseRealTime();
+
+// Pairs of fibers pass a value back and forth through two channels.
+static void BenchmarkPingPong(benchmark::State& state) {
+    Scheduler scheduler(state.range(0));
+    const int pairs = state.range(1);
+    const int rounds = 100;
+    for (auto _ : state) {
+        for (int i = 0; i < pairs; ++i) {
+            auto ping = std::make_shared<Channel<int>>(1);
+            auto pong = std::make_shared<Channel<int>>(1);
+            scheduler.Spawn([ping, pong] {
+                while (auto value = ping->Receive()) {
+                    pong->Send(*value + 1);
+                }
+            });
+            scheduler.Spawn([ping, pong, rounds] {
+                int value = 0;
+                for (int round = 0; round < rounds; ++round) {
+                    ping->Send(value);
+                    value = *pong->Receive();
+                }
+                ping->Close();
+                benchmark::DoNotOptimize(value);
+            });
+        }
+        scheduler.Wait();
+    }
+    state.SetItemsProcessed(state.iterations() * pairs * rounds);
+}
+
+BENCHMARK(BenchmarkPingPong)
+    ->Args({1, 100})
+    ->Args({1, 10000})
+    ->Args({4, 100})
+    ->Args({4, 10000})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+// The same on a thread per handler, for comparison.
+template <class T>
+class BlockingChannel {
+public:
+    void Send(T value) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        values_.push_back(value);
+        not_empty_.notify_one();
+    }
+
+    std::optional<T> Receive() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [this] { return closed_ || !values_.empty(); });
+        if (values_.empty()) {
+            return std::nullopt;
+        }
+        auto value = values_.front();
+        values_.pop_front();
+        return value;
+    }
+
+    void Close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        not_empty_.notify_all();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::deque<T> values_;
+    bool closed_ = false;
+};
+
+static void BenchmarkThreadPingPong(benchmark::State& state) {
+    const int pairs = state.range(0);
+    const int rounds = 100;
+    for (auto _ : state) {
+        std::vector<BlockingChannel<int>> pings(pairs);
+        std::vector<BlockingChannel<int>> pongs(pairs);
+        std::vector<std::thread> threads;
+        for (int i = 0; i < pairs; ++i) {
+            threads.emplace_back([&ping = pings[i], &pong = pongs[i]] {
+                while (auto value = ping.Receive()) {
+                    pong.Send(*value + 1);
+                }
+            });
+            threads.emplace_back([&ping = pings[i], &pong = pongs[i], rounds] {
+                int value = 0;
+                for (int round = 0; round < rounds; ++round) {
+                    ping.Send(value);
+                    value = *pong.Receive();
+                }
+                ping.Close();
+                benchmark::DoNotOptimize(value);
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * pairs * rounds);
+}
+
+BENCHMARK(BenchmarkThreadPingPong)->Arg(100)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,244 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fibers.h>
+
+#if defined(__SANITIZE_THREAD__)
+#define FIBERS_TSAN 1
+#elif defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+#define FIBERS_TSAN 1
+#endif
+#endif
+
+struct FibersTest : public testing::TestWithParam<int> {
+    Scheduler scheduler{GetParam()};
+};
+
+TEST_P(FibersTest, Destructor) {
+}
+
+TEST_P(FibersTest, Spawn) {
+    std::atomic<int> counter = 0;
+    for (int i = 0; i < 1000; ++i) {
+        scheduler.Spawn([&] { ++counter; });
+    }
+    scheduler.Wait();
+    EXPECT_EQ(1000, counter.load());
+}
+
+TEST_P(FibersTest, SpawnFromFiber) {
+    std::atomic<int> counter = 0;
+    scheduler.Spawn([&] {
+        for (int i = 0; i < 100; ++i) {
+            scheduler.Spawn([&] {
+                for (int j = 0; j < 10; ++j) {
+                    scheduler.Spawn([&] { ++counter; });
+                }
+            });
+        }
+    });
+    scheduler.Wait();
+    EXPECT_EQ(1000, counter.load());
+}
+
+TEST_P(FibersTest, MoveOnlyCallable) {
+    auto value = std::make_unique<int>(42);
+    std::atomic<int> seen = 0;
+    scheduler.Spawn([&seen, value = std::move(value)] { seen = *value; });
+    scheduler.Wait();
+    EXPECT_EQ(42, seen.load());
+}
+
+TEST_P(FibersTest, DeepStack) {
+    std::atomic<int> sum = 0;
+    for (int i = 0; i < 100; ++i) {
+        scheduler.Spawn([&] {
+            volatile char frame[32 * 1024];
+            for (size_t j = 0; j < sizeof(frame); ++j) {
+                frame[j] = 1;
+            }
+            int local = 0;
+            for (size_t j = 0; j < sizeof(frame); ++j) {
+                local += frame[j];
+            }
+            sum += local;
+        });
+    }
+    scheduler.Wait();
+    EXPECT_EQ(100 * 32 * 1024, sum.load());
+}
+
+TEST_P(FibersTest, Mutex) {
+    Mutex mutex;
+    int counter = 0;
+    for (int i = 0; i < 100; ++i) {
+        scheduler.Spawn([&] {
+            for (int j = 0; j < 100; ++j) {
+                std::lock_guard<Mutex> guard(mutex);
+                auto value = counter;
+                this_fiber::Yield();
+                counter = value + 1;
+            }
+        });
+    }
+    scheduler.Wait();
+    EXPECT_EQ(10000, counter);
+}
+
+TEST_P(FibersTest, ConditionVariable) {
+    Mutex mutex;
+    ConditionVariable cv;
+    std::vector<int> queue;
+    bool done = false;
+    std::atomic<int> sum = 0;
+
+    for (int i = 0; i < 10; ++i) {
+        scheduler.Spawn([&] {
+            std::unique_lock<Mutex> lock(mutex);
+            while (true) {
+                cv.Wait(mutex, [&] { return done || !queue.empty(); });
+                if (queue.empty()) {
+                    return;
+                }
+                sum += queue.back();
+                queue.pop_back();
+            }
+        });
+    }
+    scheduler.Spawn([&] {
+        for (int i = 1; i <= 1000; ++i) {
+            std::lock_guard<Mutex> guard(mutex);
+            queue.push_back(i);
+            cv.NotifyOne();
+        }
+        std::lock_guard<Mutex> guard(mutex);
+        done = true;
+        cv.NotifyAll();
+    });
+    scheduler.Wait();
+    EXPECT_EQ(1000 * 1001 / 2, sum.load());
+}
+
+TEST_P(FibersTest, Channel) {
+    Channel<int> numbers(4);
+    Channel<std::string> strings(1);
+    std::vector<std::string> received;
+
+    scheduler.Spawn([&] {
+        for (int i = 0; i < 1000; ++i) {
+            numbers.Send(i);
+        }
+        numbers.Close();
+    });
+    scheduler.Spawn([&] {
+        while (auto number = numbers.Receive()) {
+            strings.Send(std::to_string(*number));
+        }
+        strings.Close();
+    });
+    scheduler.Spawn([&] {
+        while (auto string = strings.Receive()) {
+            received.push_back(std::move(*string));
+        }
+    });
+    scheduler.Wait();
+
+    ASSERT_EQ(1000u, received.size());
+    for (int i = 0; i < 1000; ++i) {
+        ASSERT_EQ(std::to_string(i), received[i]);
+    }
+}
+
+TEST_P(FibersTest, ChannelClose) {
+    Channel<int> channel(1);
+    std::atomic<int> closed = 0;
+    for (int i = 0; i < 10; ++i) {
+        scheduler.Spawn([&] {
+            if (!channel.Receive()) {
+                ++closed;
+            }
+        });
+    }
+    scheduler.Spawn([&] {
+        channel.Send(1);
+        channel.Close();
+        EXPECT_THROW(channel.Send(2), std::runtime_error);
+    });
+    scheduler.Wait();
+    EXPECT_EQ(9, closed.load());
+}
+
+// Every handler blocks on a channel of its own, way more of them than there are threads.
+// ThreadSanitizer keeps a large state for every fiber, fewer of them do there.
+TEST_P(FibersTest, ManyBlockedHandlers) {
+#ifdef FIBERS_TSAN
+    const int n = 1000;
+#else
+    const int n = 10000;
+#endif
+    std::vector<std::unique_ptr<Channel<int>>> requests;
+    for (int i = 0; i < n; ++i) {
+        requests.push_back(std::make_unique<Channel<int>>(1));
+    }
+    Channel<int> responses(16);
+
+    for (int i = 0; i < n; ++i) {
+        scheduler.Spawn([&, i] {
+            while (auto request = requests[i]->Receive()) {
+                responses.Send(*request * 2);
+            }
+        });
+    }
+    int64_t sum = 0;
+    scheduler.Spawn([&] {
+        for (int round = 0; round < 3; ++round) {
+            for (int i = 0; i < n; ++i) {
+                requests[i]->Send(i);
+            }
+            for (int i = 0; i < n; ++i) {
+                sum += *responses.Receive();
+            }
+        }
+        for (auto& channel : requests) {
+            channel->Close();
+        }
+    });
+    scheduler.Wait();
+    EXPECT_EQ(3 * int64_t{n} * (n - 1), sum);
+}
+
+INSTANTIATE_TEST_CASE_P(Scheduler, FibersTest, ::testing::Values(1, 2, 4));
+
+TEST(Fibers, OutsideOfFiber) {
+    Mutex mutex;
+    mutex.Lock();
+    EXPECT_THROW(mutex.Lock(), std::logic_error);
+    mutex.Unlock();
+    Channel<int> channel(1);
+    EXPECT_THROW(channel.Receive(), std::logic_error);
+    EXPECT_THROW(this_fiber::Yield(), std::logic_error);
+    EXPECT_THROW(Channel<int>(0), std::invalid_argument);
+}
+
+int Recurse(int depth) {
+    volatile char frame[1024];
+    frame[0] = static_cast<char>(depth);
+    return depth ? Recurse(depth - 1) + frame[0] : 0;
+}
+
+// Runs into the guard page rather than whatever is mapped below the stack.
+TEST(FibersDeathTest, StackOverflow) {
+    testing::FLAGS_gtest_death_test_style = "threadsafe";
+    EXPECT_DEATH(
+        {
+            Scheduler scheduler(1, 16 * 1024);
+            scheduler.Spawn([] { Recurse(1000); });
+        },
+        "");
+}
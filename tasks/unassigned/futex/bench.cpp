@@ -2,14 +2,31 @@
 
 #include "mutex.h"
 #include <memory>
+#include <mutex>
+
+// Gives std::mutex the interface of Mutex for comparison.
+class StdMutex {
+public:
+    void Lock() {
+        mutex_.lock();
+    }
+
+    void Unlock() {
+        mutex_.unlock();
+    }
+
+private:
+    std::mutex mutex_;
+};
 
 int counter;
-std::shared_ptr<Mutex> mutex;
 
+template <class TMutex>
 void Run(benchmark::State& state) {
+    static std::shared_ptr<TMutex> mutex;
     if (state.thread_index == 0) {
         counter = 0;
-        mutex = std::make_shared<Mutex>();
+        mutex = std::make_shared<TMutex>();
     }
     while (state.KeepRunning()) {
         mutex->Lock();
@@ -18,6 +35,7 @@ void Run(benchmark::State& state) {
     }
 }
 
-BENCHMARK(Run)->UseRealTime()->ThreadRange(1, 8);
+BENCHMARK_TEMPLATE(Run, Mutex)->UseRealTime()->Threads(1)->Threads(2)->Threads(8)->Threads(32);
+BENCHMARK_TEMPLATE(Run, StdMutex)->UseRealTime()->Threads(1)->Threads(2)->Threads(8)->Threads(32);
 
 BENCHMARK_MAIN();
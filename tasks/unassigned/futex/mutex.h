@@ -5,8 +5,10 @@
 #include <sys/time.h>
 #include <unistd.h>
 
-#include <mutex>
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <ctime>
 
 // Atomically do the following:
 //    if (*value == expected_value) {
@@ -21,16 +23,118 @@ void FutexWake(int *value, int count) {
     syscall(SYS_futex, value, FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
 }
 
+// Sleeps like FutexWait for at most |timeout|.
+void FutexWaitFor(int *value, int expected_value, std::chrono::nanoseconds timeout) {
+    auto seconds = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+    timespec relative{static_cast<time_t>(seconds.count()),
+                      static_cast<long>((timeout - seconds).count())};
+    syscall(SYS_futex, value, FUTEX_WAIT_PRIVATE, expected_value, &relative, nullptr, 0);
+}
+
+// Ulrich Drepper's three-state mutex from "Futexes Are Tricky". Unlock only makes a
+// system call when somebody may be asleep, and a contended Lock spins for a while first:
+// critical sections are usually shorter than a trip through the kernel. The spin budget
+// adapts to how long the lock was recently held, like glibc's adaptive mutexes.
 class Mutex {
 public:
     void Lock() {
-        mutex_.lock();
+        if (!TryLock()) {
+            LockSlow();
+        }
+    }
+
+    bool TryLock() {
+        int state = kUnlocked;
+        return state_.compare_exchange_strong(state, kLocked, std::memory_order_acquire);
+    }
+
+    template <class Rep, class Period>
+    bool LockFor(const std::chrono::duration<Rep, Period> &timeout) {
+        if (TryLock()) {
+            return true;
+        }
+        // Rounded up, so that a fractional or finer timeout is never cut short.
+        auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::ceil<std::chrono::steady_clock::duration>(timeout);
+        if (Spin()) {
+            return true;
+        }
+        while (state_.exchange(kContended, std::memory_order_acquire) != kUnlocked) {
+            auto left = deadline - std::chrono::steady_clock::now();
+            if (left <= left.zero()) {
+                // The state stays contended, which only costs the owner a spare wake-up.
+                return false;
+            }
+            // Rounded up too, or a remainder below a nanosecond would be waited for as zero
+            // over and over.
+            FutexWaitFor(StateAddress(), kContended,
+                         std::chrono::ceil<std::chrono::nanoseconds>(left));
+        }
+        return true;
     }
 
     void Unlock() {
-        mutex_.unlock();
+        if (state_.exchange(kUnlocked, std::memory_order_release) == kContended) {
+            FutexWake(StateAddress(), 1);
+        }
     }
 
 private:
-    std::mutex mutex_;
+    enum State : int {
+        kUnlocked,
+        kLocked,
+        // Locked and some threads may be asleep waiting for it.
+        kContended,
+    };
+
+    static constexpr int kMinSpins = 10;
+    static constexpr int kMaxSpins = 100;
+
+    void LockSlow() {
+        if (Spin()) {
+            return;
+        }
+        // Whoever takes the lock from here on marks it contended: the thread may not be
+        // the last sleeper, and the next unlock must wake the others.
+        while (state_.exchange(kContended, std::memory_order_acquire) != kUnlocked) {
+            FutexWait(StateAddress(), kContended);
+        }
+    }
+
+    // Tries to take the lock while it is held by a running thread. The budget grows
+    // towards the number of spins that recently sufficed, up to kMaxSpins.
+    bool Spin() {
+        auto budget = std::min(kMaxSpins, 2 * spins_.load(std::memory_order_relaxed) + kMinSpins);
+        for (int spin = 0; spin < budget; ++spin) {
+            if (state_.load(std::memory_order_relaxed) == kUnlocked && TryLock()) {
+                AdjustSpins(spin);
+                return true;
+            }
+            Pause();
+        }
+        AdjustSpins(budget);
+        return false;
+    }
+
+    void AdjustSpins(int spun) {
+        auto spins = spins_.load(std::memory_order_relaxed);
+        spins_.store(spins + (spun - spins) / 8, std::memory_order_relaxed);
+    }
+
+    static void Pause() {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
+
+    int *StateAddress() {
+        static_assert(sizeof(std::atomic<int>) == sizeof(int));
+        return reinterpret_cast<int *>(&state_);
+    }
+
+    std::atomic<int> state_ = kUnlocked;
+    // An estimate only, updated without synchronization.
+    std::atomic<int> spins_ = 0;
 };
@@ -88,3 +88,51 @@ TEST(Concurrency, Spinlock) {
     holder.join();
     waiter.join();
 }
+
+TEST(Correctness, TryLock) {
+    Mutex mutex;
+    ASSERT_TRUE(mutex.TryLock());
+    std::thread other([&mutex]() { ASSERT_FALSE(mutex.TryLock()); });
+    other.join();
+    mutex.Unlock();
+    ASSERT_TRUE(mutex.TryLock());
+    mutex.Unlock();
+}
+
+TEST(Correctness, LockFor) {
+    Mutex mutex;
+    mutex.Lock();
+    std::thread waiter([&mutex]() {
+        auto start = high_resolution_clock::now();
+        ASSERT_FALSE(mutex.LockFor(milliseconds(300)));
+        auto duration = duration_cast<milliseconds>(high_resolution_clock::now() - start).count();
+        ASSERT_LE(300, duration);
+        ASSERT_LT(duration, 500);
+
+        ASSERT_TRUE(mutex.LockFor(milliseconds(5000)));
+        mutex.Unlock();
+    });
+    std::this_thread::sleep_for(milliseconds(600));
+    mutex.Unlock();
+    waiter.join();
+    ASSERT_TRUE(mutex.TryLock());
+    mutex.Unlock();
+}
+
+TEST(Correctness, LockForFractional) {
+    Mutex mutex;
+    mutex.Lock();
+    std::thread waiter([&mutex]() {
+        auto start = high_resolution_clock::now();
+        ASSERT_FALSE(mutex.LockFor(std::chrono::duration<double>(0.1)));
+        auto duration = duration_cast<milliseconds>(high_resolution_clock::now() - start).count();
+        ASSERT_LE(100, duration);
+        ASSERT_LT(duration, 300);
+
+        ASSERT_TRUE(mutex.LockFor(std::chrono::duration<double, std::milli>(5000.5)));
+        mutex.Unlock();
+    });
+    std::this_thread::sleep_for(milliseconds(300));
+    mutex.Unlock();
+    waiter.join();
+}
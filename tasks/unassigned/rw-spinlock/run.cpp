@@ -1,5 +1,8 @@
 #include <benchmark/benchmark.h>
+#include <array>
 #include <atomic>
+#include <mutex>
+#include <shared_mutex>
 #include <stdexcept>
 
 #include <rw_spinlock.h>
@@ -43,8 +46,69 @@ void ReadsWrites(benchmark::State& state) {
     }
 }
 
+// A lookup in a small table, the kind of critical section the lock is meant for:
+// every 16th operation is a write.
+template <class TLock>
+void Lookups(benchmark::State& state) {
+    static TLock lookup_lock;
+    static std::array<int, 64> table = {};
+    size_t i = state.thread_index;
+    int sum = 0;
+    while (state.KeepRunning()) {
+        ++i;
+        if (i % 16) {
+            lookup_lock.Read([&] { sum += table[i % table.size()]; });
+        } else {
+            lookup_lock.Write([&] { ++table[i % table.size()]; });
+        }
+    }
+    benchmark::DoNotOptimize(sum);
+}
+
+// Lookups take the lock through callbacks, these give them RWSpinLock and, for comparison,
+// std::shared_mutex.
+class SpinLockAdapter {
+public:
+    template <class Func>
+    void Read(Func func) {
+        lock_.LockRead();
+        func();
+        lock_.UnlockRead();
+    }
+
+    template <class Func>
+    void Write(Func func) {
+        lock_.LockWrite();
+        func();
+        lock_.UnlockWrite();
+    }
+
+private:
+    RWSpinLock lock_;
+};
+
+class SharedMutexAdapter {
+public:
+    template <class Func>
+    void Read(Func func) {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        func();
+    }
+
+    template <class Func>
+    void Write(Func func) {
+        std::lock_guard<std::shared_mutex> lock(mutex_);
+        func();
+    }
+
+private:
+    std::shared_mutex mutex_;
+};
+
 BENCHMARK(Reads)->ThreadRange(1, 8)->UseRealTime();
 BENCHMARK(Writes)->ThreadRange(1, 8)->UseRealTime();
 BENCHMARK(ReadsWrites)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK_TEMPLATE(Lookups, SpinLockAdapter)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK_TEMPLATE(Lookups, SharedMutexAdapter)->ThreadRange(1, 8)->UseRealTime();
 
 BENCHMARK_MAIN();
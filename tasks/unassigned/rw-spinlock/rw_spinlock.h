@@ -1,17 +1,107 @@
 #pragma once
 
 #include <atomic>
+#include <cstdint>
+#include <thread>
 
+// The whole state is one word: the low bit is set while a writer holds the lock, the
+// next one while a writer waits for it, and the rest counts readers. New readers stay
+// out while a writer waits, so writers are not starved by overlapping reads. Waiting
+// spins with exponential backoff and yields the CPU once the backoff is at its limit.
 struct RWSpinLock {
     void LockRead() {
+        for (Backoff backoff; !TryLockRead(); backoff.Wait()) {
+        }
+    }
+
+    // Only fails because of writers, other readers just cost another attempt.
+    bool TryLockRead() {
+        auto state = state_.load(std::memory_order_relaxed);
+        while (!(state & (kWriter | kWriterWaiting))) {
+            if (state_.compare_exchange_weak(state, state + kReader, std::memory_order_acquire,
+                                             std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
     }
 
     void UnlockRead() {
+        state_.fetch_sub(kReader, std::memory_order_release);
     }
 
     void LockWrite() {
+        for (Backoff backoff;; backoff.Wait()) {
+            auto state = state_.load(std::memory_order_relaxed);
+            // Taking the lock clears the waiting bit, other waiting writers set it again.
+            if (!(state & ~kWriterWaiting) &&
+                state_.compare_exchange_weak(state, kWriter, std::memory_order_acquire,
+                                             std::memory_order_relaxed)) {
+                return;
+            }
+            if (!(state & kWriterWaiting)) {
+                state_.fetch_or(kWriterWaiting, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool TryLockWrite() {
+        auto state = state_.load(std::memory_order_relaxed);
+        return !(state & ~kWriterWaiting) &&
+               state_.compare_exchange_strong(state, kWriter, std::memory_order_acquire,
+                                              std::memory_order_relaxed);
     }
 
     void UnlockWrite() {
+        state_.fetch_and(~kWriter, std::memory_order_release);
+    }
+
+    // Turns the caller's read lock into the write lock if it is the only reader. Fails
+    // rather than waits for the others: two readers waiting for each other to leave
+    // would never get anywhere. The read lock is kept on failure.
+    bool TryUpgradeToWrite() {
+        auto state = state_.load(std::memory_order_relaxed);
+        return (state & ~kWriterWaiting) == kReader &&
+               state_.compare_exchange_strong(state, kWriter, std::memory_order_acquire,
+                                              std::memory_order_relaxed);
+    }
+
+    // Never fails: no writer can get in while the caller holds the write lock.
+    void DowngradeToRead() {
+        state_.fetch_add(kReader - kWriter, std::memory_order_release);
     }
+
+private:
+    static constexpr uint64_t kWriter = 1;
+    static constexpr uint64_t kWriterWaiting = 2;
+    static constexpr uint64_t kReader = 4;
+
+    class Backoff {
+    public:
+        void Wait() {
+            if (pauses_ > kMaxPauses) {
+                std::this_thread::yield();
+                return;
+            }
+            for (int i = 0; i < pauses_; ++i) {
+                Pause();
+            }
+            pauses_ *= 2;
+        }
+
+    private:
+        static constexpr int kMaxPauses = 1024;
+
+        static void Pause() {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#elif defined(__aarch64__)
+            asm volatile("yield");
+#endif
+        }
+
+        int pauses_ = 1;
+    };
+
+    std::atomic<uint64_t> state_ = 0;
 };
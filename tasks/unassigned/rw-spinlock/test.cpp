@@ -2,6 +2,7 @@
 #include <chrono>
 #include <thread>
 #include <atomic>
+#include <vector>
 
 #include <rw_spinlock.h>
 
@@ -67,3 +68,57 @@ TEST(Correctness, WriteRead) {
     t1.join();
     ASSERT_EQ(counter.load(), 1);
 }
+
+TEST(Correctness, TryLock) {
+    RWSpinLock lock;
+    ASSERT_TRUE(lock.TryLockRead());
+    ASSERT_TRUE(lock.TryLockRead());
+    ASSERT_FALSE(lock.TryLockWrite());
+    lock.UnlockRead();
+    lock.UnlockRead();
+    ASSERT_TRUE(lock.TryLockWrite());
+    ASSERT_FALSE(lock.TryLockRead());
+    ASSERT_FALSE(lock.TryLockWrite());
+    lock.UnlockWrite();
+    ASSERT_TRUE(lock.TryLockRead());
+    lock.UnlockRead();
+}
+
+TEST(Correctness, Upgrade) {
+    RWSpinLock lock;
+    lock.LockRead();
+    lock.LockRead();
+    ASSERT_FALSE(lock.TryUpgradeToWrite());
+    lock.UnlockRead();
+    ASSERT_TRUE(lock.TryUpgradeToWrite());
+    ASSERT_FALSE(lock.TryLockRead());
+    lock.DowngradeToRead();
+    ASSERT_TRUE(lock.TryLockRead());
+    ASSERT_FALSE(lock.TryLockWrite());
+    lock.UnlockRead();
+    lock.UnlockRead();
+    ASSERT_TRUE(lock.TryLockWrite());
+    lock.UnlockWrite();
+}
+
+TEST(Correctness, WriterIsNotStarved) {
+    RWSpinLock lock;
+    std::atomic<bool> done = {false};
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; ++i) {
+        readers.emplace_back([&] {
+            while (!done) {
+                lock.LockRead();
+                std::this_thread::sleep_for(1ms);
+                lock.UnlockRead();
+            }
+        });
+    }
+    std::this_thread::sleep_for(50ms);
+    lock.LockWrite();
+    done = true;
+    lock.UnlockWrite();
+    for (auto& reader : readers) {
+        reader.join();
+    }
+}